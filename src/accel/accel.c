@@ -68,6 +68,8 @@ void accel_task( void *pvParameters ){
 	signed int temp_x, temp_y, temp_z;
 	unsigned char tempString[10];
 	unsigned recordFlag;
+	struct tRecordAccelEntry logEntry;
+	portTickType lastLog = 0;
 	
 	debug_log(DEBUG_PRIORITY_INFO, DEBUG_SENDER_ACCEL, "Starting accel task...");
 	
@@ -120,6 +122,16 @@ void accel_task( void *pvParameters ){
 		accelData.filteredData.x = temp_x / entries;
 		accelData.filteredData.y = temp_y / entries;
 		accelData.filteredData.z = temp_z / entries;
+		
+		// Only recorded while a session is running
+		if( (xTaskGetTickCount() - lastLog) >= TASK_DELAY_MS(ACCEL_LOG_INTERVAL) ){
+			lastLog = xTaskGetTickCount();
+			
+			logEntry.x = accelData.filteredData.x;
+			logEntry.y = accelData.filteredData.y;
+			logEntry.z = accelData.filteredData.z;
+			stream_write(RECORD_STREAM_ACCEL, RECORD_ENTRY_ACCEL, &logEntry, sizeof(logEntry));
+		}
 	};
 }
 
@@ -147,6 +147,7 @@
 #define ACCEL_SELF_TEST_Z_MAX			872			// Counts
 
 #define ACCEL_READ_FIFO_INTERVAL		15			// Time in milliseconds to read the FIFO
+#define ACCEL_LOG_INTERVAL				100			// Time in milliseconds between readings logged to the record stream
 #define ACCEL_PCDA_READ_SIZE			7			// Number of bytes to read for PDCA transfers, (2 * 3B) + 1B
 
 
@@ -135,7 +135,7 @@
 #define FLASH_SPI_NPCS0_FUNCTION	AVR32_SPI0_NPCS_0_1_FUNCTION
 
 #define FLASH_SPI_NPCS				0
-#define FLASH_SPI_BAUDRATE			12000000	// 12MHz
+#define FLASH_SPI_BAUDRATE			12000000	// 12MHz, used until the part is identified
 
 #define FLASH_SPI_BITS_PER_XFER		8			// 8 Bits per transfer
 #define FLASH_SPI_SCLK_DELAY		0			// Delay from CS to first CLK
@@ -153,6 +153,8 @@
 
 #define FLASH_SPI_TX_PDCA_CHANNEL	0
 #define FLASH_SPI_RX_PDCA_CHANNEL	1
+#define FLASH_SPI_TX_PDCA_IRQ		AVR32_PDCA_IRQ_0
+#define FLASH_SPI_RX_PDCA_IRQ		AVR32_PDCA_IRQ_1
 
 
 // ------------------------------------------------------------
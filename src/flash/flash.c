@@ -29,11 +29,14 @@
 
 #include <asf.h>
 #include "hal.h"
+#include "string.h"
 
 //--------------------------
 // Queues
 //--------------------------
-xQueueHandle flashManagerQueue;
+xQueueHandle flashManagerQueue[FLASH_CLASS_COUNT];
+xSemaphoreHandle flashManagerDoorbell;		// Given on every queued request, no queue sets in this FreeRTOS
+xSemaphoreHandle flashPdcaSemaphore;
 
 //--------------------------
 // Structs
@@ -43,12 +46,46 @@ struct tFlashRequest	request;
 struct tUserPrefs		userPrefs;
 struct tFlash			flash;
 
+unsigned char trackCount = 0;		// Count the number of tracks
+
+extern struct tSessionLog session;
+
+//--------------------------
+// ISR's
+//--------------------------
+__attribute__((__interrupt__)) static void ISR_flash_pdca(void){
+	portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+	
+	// Transfer complete stays set, so mask it until the next transfer
+	pdca_disable_interrupt_transfer_complete(FLASH_SPI_TX_PDCA_CHANNEL);
+	pdca_disable_interrupt_transfer_complete(FLASH_SPI_RX_PDCA_CHANNEL);
+	
+	xSemaphoreGiveFromISR(flashPdcaSemaphore, &xHigherPriorityTaskWoken);
+}
+
 void flash_task_init( void ){
+	unsigned char i;
 	
 	flash_set_busy_flag();
 	flash_clr_full_flag();
 	
-	flashManagerQueue = xQueueCreate(FLASH_MANAGER_QUEUE_SIZE, sizeof(request));
+	for(i = 0; i < FLASH_CLASS_COUNT; i++){
+		flashManagerQueue[i] = xQueueCreate(FLASH_MANAGER_QUEUE_SIZE, sizeof(request));
+	}
+	
+	vSemaphoreCreateBinary(flashManagerDoorbell);
+	xSemaphoreTake(flashManagerDoorbell, 0);
+	
+	flash_cache_invalidate(0, FLASH_CACHE_EMPTY);
+	
+	// Pages of the other record streams are filled by their producers
+	stream_init();
+	
+	// PDCA completion wakes the flash task instead of it polling
+	vSemaphoreCreateBinary(flashPdcaSemaphore);
+	xSemaphoreTake(flashPdcaSemaphore, 0);
+	INTC_register_interrupt( (__int_handler) &ISR_flash_pdca, FLASH_SPI_TX_PDCA_IRQ, AVR32_INTC_INT0);
+	INTC_register_interrupt( (__int_handler) &ISR_flash_pdca, FLASH_SPI_RX_PDCA_IRQ, AVR32_INTC_INT0);
 	
 	flash_clr_wp();
 	flash_clr_hold();
@@ -64,20 +101,34 @@ void flash_task_init( void ){
 			debug_log(DEBUG_PRIORITY_INFO, DEBUG_SENDER_FLASH, "Detected Atmel AT25DF321");
 			break;
 			
+		case(GENERIC_DEVICE):
+			debug_log(DEBUG_PRIORITY_INFO, DEBUG_SENDER_FLASH, "Detected SFDP flash");
+			break;
+			
 		default:
 			debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Did not recognize flash");
 			break;	
 	}
+	
+	// Region sizes come from the part itself from here on
+	flash_load_partitions();
 
 	
 	// Read out the OTP registers, and check validity
-	flash_ReadOTP(OTP_START_INDEX, OTP_LENGTH, &flashOTP);
+	flash_ReadOTP(OTP_START_INDEX, OTP_LENGTH, (unsigned char *)&flashOTP);
 	if( flash_calculate_otp_crc() != flashOTP.crc ){
 		debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Invalid OTP CRC");
 	}
 	
-	// Load user preferences!
-	flash_ReadToBuffer(flash.layout.userPrefsStart, sizeof(userPrefs), &userPrefs);
+	// Rebuild the metadata index and load user preferences!
+	if( journal_mount() == DATAFLASH_RESPONSE_FAILURE ){
+		debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Journal mount failed");
+	}
+	
+	flash_wear_load();
+	flash_badmap_load();
+	
+	journal_read(JOURNAL_TYPE_USERPREFS, 0, (unsigned char *)&userPrefs, sizeof(userPrefs));
 	if(flash_calculate_userPrefs_crc() != userPrefs.crc){
 		// If CRC is bad, load defaults!
 		debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Invalid User Prefs CRC");
@@ -87,217 +138,392 @@ void flash_task_init( void ){
 		userPrefs.screenOffTime = BACKLIGHT_DEFAULT_OFFTIME;
 	}
 	
+	flash_read_stop();
+	
 	// Finally schedule the dataflash task
 	xTaskCreate(flash_task, configTSK_DATAFLASH_TASK_NAME, configTSK_DATAFLASH_TASK_STACK_SIZE, NULL, configTSK_DATAFLASH_TASK_PRIORITY, configTSK_DATAFLASH_TASK_HANDLE);
 }
 
 void flash_task( void *pvParameters ){
-	unsigned char recordTableIndex = 0;	// Index of first empty record table
-	unsigned char trackCount = 0;		// Count the number of tracks
-	struct tRecordsEntry recordTable, prevRecordTable;
-	struct tTracklist trackList;
-
-	unsigned char flashIsFull = FALSE;
+	( void ) pvParameters;
 	
 	debug_log(DEBUG_PRIORITY_INFO, DEBUG_SENDER_FLASH, "Task Started");
 	
 	flash_GlobalUnprotect();
 	flash_WriteEnable();
 	
-	//--------------------------
-	// Record Table Initialization
-	//--------------------------
-	while( recordTableIndex < RECORDS_TOTAL_POSSIBLE ){
-		flash_ReadToBuffer(flash.layout.recordTableStart + (sizeof(recordTable) * recordTableIndex), sizeof(recordTable), &recordTable);
-		if(recordTable.recordEmpty) break;
-		recordTableIndex++;
+	if(flash.layout.formatPending){
+		flash_migrate_v130();
+		flash_write_partitions();
 	}
 	
-	// Figure out the start address of the new record table entry
-	if(recordTableIndex == 0){
-		// There is no previous record table entry
-		recordTable.startAddress = flash.layout.recordDataStart;
-		recordTable.endAddress = flash.layout.recordDataStart;
-	}else{
-		// Peek at the last available record
-		flash_ReadToBuffer(flash.layout.recordTableStart + (sizeof(prevRecordTable) * (recordTableIndex - 1)), sizeof(prevRecordTable), &prevRecordTable);
-		recordTable.startAddress = (prevRecordTable.endAddress + 1);
-		recordTable.endAddress = recordTable.startAddress;
-	}
+	//--------------------------
+	// Record Data Log Initialization
+	//--------------------------
+	session_mount();
 	
 	//--------------------------
 	// Track Initialization
 	//--------------------------
 	trackCount = 0;
 	
-	/*while( trackCount < TRACKLIST_TOTAL_NUM ){
-		flash_ReadToBuffer(FLASH_ADDR_TRACKLIST_START + (sizeof(trackList) * trackCount), sizeof(trackList), &trackList);
-		if(trackList.isEmpty) break;
+	while( (trackCount < flash.layout.trackSlots) && journal_exists(JOURNAL_TYPE_TRACK, trackCount) ){
 		trackCount++;
-	}*/
+	}
 	
+	flash_read_stop();
 	flash_set_wp();
 	flash_clr_busy_flag();
 	
+	flash.powerStateSince = xTaskGetTickCount();
+	
 	while(TRUE){
-		xQueueReceive(flashManagerQueue, &request, portMAX_DELAY);
+		if( flash_next_request(&request) == FALSE ){
+			// Everything is served, sleep until the next request rings
+			if( journal_pending() ){
+				// Let more small writes join the staged journal page before programming it
+				if( xSemaphoreTake(flashManagerDoorbell, TASK_DELAY_MS(JOURNAL_FLUSH_TIME)) == pdFALSE ){
+					flash_set_busy_flag();
+					flash_wakeUp();
+					flash_clr_wp();
+					journal_flush();
+					flash_set_wp();
+					flash_clr_busy_flag();
+				}
+			}else if( session_preerase_pending() ){
+				// Spend idle time erasing ahead of the record data write pointer
+				if( xSemaphoreTake(flashManagerDoorbell, TASK_DELAY_MS(DATAFLASH_PREERASE_IDLE_TIME)) == pdFALSE ){
+					flash_set_busy_flag();
+					flash_wakeUp();
+					flash_clr_wp();
+					session_preerase();
+					
+					if(flash.wearUnsaved >= FLASH_WEAR_SAVE_INTERVAL){
+						flash_wear_save();
+					}
+					
+					flash_set_wp();
+					flash_clr_busy_flag();
+				}
+			}else if( !flash.poweredDown ){
+				// Nothing left to do, go to deep power-down once requests stop coming
+				if( xSemaphoreTake(flashManagerDoorbell, TASK_DELAY_MS(DATAFLASH_POWERDOWN_IDLE_TIME)) == pdFALSE ){
+					flash_powerDown();
+				}
+			}else{
+				xSemaphoreTake(flashManagerDoorbell, portMAX_DELAY);
+			}
+			continue;
+		}
+		
+		if( !flash_request_in_ram(request.command) ){
+			flash_wakeUp();
+		}
 		
 		flash_set_busy_flag();
 		flash_clr_wp();
 		
-		switch(request.command){
-
-			case(FLASH_MGR_END_CURRENT_RECORD):
-				
-				recordTable.recordEmpty = FALSE;
-				recordTable.endAddress--;		// Really the last byte of the page
-				flash_UpdateSector(flash.layout.recordTableStart + (sizeof(recordTable) * recordTableIndex), sizeof(recordTable), &recordTable);
-				
-				// Get the new record table ready!
-				recordTableIndex++;
-				recordTable.endAddress++;
-				
-				recordTable.recordEmpty = TRUE;
-				recordTable.startAddress = recordTable.endAddress; 
-				recordTable.trackID = 0xFF;
-					
-				break;
-				
+		flash_dispatch_request(&request);
+		
+		// RAM requests leave the part in deep power-down, the save programs the journal
+		if(flash.wearUnsaved >= FLASH_WEAR_SAVE_INTERVAL){
+			flash_wakeUp();
+			flash_wear_save();
+		}
+		
+		flash_read_stop();
+		flash_set_wp();
+		flash_clr_busy_flag();
+		
+		flash_complete_request(&request);
+	}
+}
 
-			case(FLASH_MGR_ADD_RECORD_DATA):
-				if(recordTable.endAddress < flash.layout.recordDataEnd){
-					flash_WriteFromBuffer(recordTable.endAddress, request.length, request.pointer);
-					recordTable.endAddress += FLASH_PAGE_SIZE;
-				}				
-				break;
-				
-			case(FLASH_MGR_READ_PAGE):
-				flash_ReadToBuffer( request.index * FLASH_PAGE_SIZE, request.length, request.pointer);
-				break;
-				
-			case(FLASH_MGR_WRITE_PAGE):
-				flash_WriteFromBuffer( request.index * FLASH_PAGE_SIZE, request.length, request.pointer);
-				break;
-				
 
-			case(FLASH_MGR_ERASE_RECORD):
-				 // Not implemented yet!
-				break;
-				
+// Take the next request to serve. Recording always goes first, the other classes
+// go by priority unless one has been passed over too many times in a row.
+unsigned char flash_next_request(struct tFlashRequest *request){
+	enum tFlashClass class;
+	enum tFlashClass chosen = FLASH_CLASS_COUNT;
+	unsigned int latency;
+	
+	for(class = FLASH_CLASS_RECORD; class < FLASH_CLASS_COUNT; class++){
+		if( uxQueueMessagesWaiting(flashManagerQueue[class]) ){
+			if(chosen == FLASH_CLASS_COUNT){
+				chosen = class;
+			}else if( (chosen != FLASH_CLASS_RECORD) && (flash.classSkipped[class] >= FLASH_MANAGER_STARVATION_LIMIT) && (flash.classSkipped[chosen] < FLASH_MANAGER_STARVATION_LIMIT) ){
+				chosen = class;
+			}
+		}
+	}
+	
+	if(chosen == FLASH_CLASS_COUNT){
+		return FALSE;
+	}
+	
+	for(class = FLASH_CLASS_RECORD; class < FLASH_CLASS_COUNT; class++){
+		if( (class != chosen) && uxQueueMessagesWaiting(flashManagerQueue[class]) && (flash.classSkipped[class] < 0xFF) ){
+			flash.classSkipped[class]++;
+		}
+	}
+	flash.classSkipped[chosen] = 0;
+	
+	xQueueReceive(flashManagerQueue[chosen], request, 0);
+	
+	latency = (xTaskGetTickCount() - request->queued) * portTICK_RATE_MS;
+	flash.classStats[chosen].requests++;
+	flash.classStats[chosen].latencyTotal += latency;
+	if(latency > flash.classStats[chosen].latencyMax){
+		flash.classStats[chosen].latencyMax = latency;
+	}
+	
+	return TRUE;
+}
 
-			case(FLASH_MGR_READ_RECORDTABLE):
-				flash_ReadToBuffer(flash.layout.recordTableStart + ( request.index * sizeof(recordTable) ), sizeof(recordTable), request.pointer);
-				break;
-				
+enum tFlashClass flash_request_class(enum tFlashCommand command){
+	
+	switch(command){
+		case(FLASH_MGR_ADD_RECORD_DATA):
+		case(FLASH_MGR_END_CURRENT_RECORD):
+		case(FLASH_MGR_SET_TRACK):
+		case(FLASH_MGR_SET_DATESTAMP):
+		case(FLASH_MGR_ADD_SESSION_SUMMARY):
+		case(FLASH_MGR_SAVE_CHECKPOINT):		// Counts the pages queued ahead of it
+		case(FLASH_MGR_REQUEST_SHUTDOWN):		// Queued behind the last record pages
+			return FLASH_CLASS_RECORD;
+			
+		case(FLASH_MGR_READ_RECORDTABLE):
+		case(FLASH_MGR_RECORDTABLE_SIZE):
+		case(FLASH_MGR_READ_SESSION_SUMMARY):
+		case(FLASH_MGR_READ_TELEMETRY):
+		case(FLASH_MGR_READ_CACHE_STATS):
+		case(FLASH_MGR_READ_CHECKPOINT):
+		case(FLASH_MGR_READ_TRACK):
+		case(FLASH_MGR_READ_OTP):
+		case(FLASH_MGR_BUSY):
+		case(FLASH_MGR_IS_FLASH_FULL):
+		case(FLASH_MGR_USED_SPACE):
+		case(FLASH_MGR_WRITE_USER_PREFS):
+			return FLASH_CLASS_INTERACTIVE;
+			
+		case(FLASH_MGR_ERASE_RECORD):
+		case(FLASH_MGR_ERASE_RECORDED_DATA):
+		case(FLASH_MGR_CHIP_ERASE):
+		case(FLASH_MGR_SECTOR_ERASE):
+		case(FLASH_MGR_WRITE_OTP):
+			return FLASH_CLASS_MAINTENANCE;
+			
+		default:
+			return FLASH_CLASS_BULK;
+	}
+}
 
-			case(FLASH_MGR_READ_RECORDATA):
-				flash_ReadToBuffer(flash.layout.recordDataStart + (request.index * FLASH_PAGE_SIZE), FLASH_PAGE_SIZE, request.pointer);
-				break;
-				
+void flash_dispatch_request(struct tFlashRequest *request){
+	
+	switch(request->command){
 
-			case(FLASH_MGR_READ_TRACK):
-				flash_ReadToBuffer(flash.layout.trackListStart + (request.index * sizeof(trackList)), sizeof(trackList), request.pointer);
-				break;
-				
+		case(FLASH_MGR_END_CURRENT_RECORD):
+			session_close();
+			break;
+			
 
-			case(FLASH_MGR_ADD_TRACK):
-				flash_UpdateSector(flash.layout.trackListStart + (trackCount * sizeof(trackList)), sizeof(trackList), request.pointer);
-				trackCount++;
-				break;
-				
+		case(FLASH_MGR_ADD_RECORD_DATA):
+			session_add_page(request->pointer, request->length);
+			break;
+			
+		case(FLASH_MGR_ADD_SESSION_SUMMARY):
+			session_add_summary((struct tSessionSummary *)request->pointer);
+			break;
+			
+		case(FLASH_MGR_READ_SESSION_SUMMARY):
+			session_read_summary(request->index, (struct tSessionSummary *)request->pointer);
+			break;
+			
+		case(FLASH_MGR_READ_PAGE):
+			flash_ReadToBuffer( request->index * FLASH_PAGE_SIZE, request->length, request->pointer);
+			break;
+			
+		case(FLASH_MGR_WRITE_PAGE):
+			flash_WriteFromBuffer( request->index * FLASH_PAGE_SIZE, request->length, request->pointer);
+			break;
+			
 
-			case(FLASH_MGR_ERASE_TRACKS):
-				flash_eraseTracks();
-				trackCount = 0;
-				break;
-				
+		case(FLASH_MGR_ERASE_RECORD):
+			session_delete(request->index);
+			break;
+			
 
-			case(FLASH_MGR_READ_OTP):
-				flash_ReadOTP(request.index, request.length, request.pointer);
-				break;
-				
+		case(FLASH_MGR_READ_RECORDTABLE):
+			session_read_entry(request->index, (struct tRecordsEntry *)request->pointer);
+			break;
+			
 
-			case(FLASH_MGR_SECTOR_ERASE):
-				flash_eraseBlock(FLASH_CMD_BLOCK_ERASE_4KB, (request.index * FLASH_4KB) );
-				break;
-				
+		case(FLASH_MGR_READ_RANGE):
+			flash_ReadRange((struct tFlashRange *)request->pointer);
+			break;
+			
 
-			case(FLASH_MGR_BUSY):
-				*(request.pointer) = flash_is_busy();
-				break;
-				
+		case(FLASH_MGR_RECORDTABLE_SIZE):
+			*((unsigned short *)request->pointer) = session_count();
+			break;
+			
 
-			case(FLASH_MGR_CHIP_ERASE):
-				recordTableIndex = 0;
-				recordTable.startAddress = flash.layout.recordDataStart;
-				recordTable.endAddress = flash.layout.recordDataStart;
-				flash_chipErase();
-				break;
-				
+		case(FLASH_MGR_READ_TELEMETRY):
+			((struct tFlashTelemetry *)request->pointer)->wear = flash.wear;
+			memcpy(((struct tFlashTelemetry *)request->pointer)->opStats, flash.opStats, sizeof(flash.opStats));
+			((struct tFlashTelemetry *)request->pointer)->remapped = flash.badMap.count;
+			((struct tFlashTelemetry *)request->pointer)->sparesUsed = flash.badMap.sparesUsed;
+			((struct tFlashTelemetry *)request->pointer)->sparesTotal = (flash.layout.partEnd - flash.layout.recordDataEnd) / FLASH_4KB;
+			break;
+			
+		case(FLASH_MGR_READ_CACHE_STATS):
+			*((struct tFlashCacheStats *)request->pointer) = flash.cacheStats;
+			break;
+			
 
-			case(FLASH_MGR_IS_FLASH_FULL):
-				*(request.pointer) = flashIsFull;
-				break;
-				
+		case(FLASH_MGR_READ_RECORDATA):
+			flash_ReadToBuffer(session_page_address(request->index), FLASH_PAGE_SIZE, request->pointer);
+			break;
+			
+		case(FLASH_MGR_READ_RECORD_SAMPLES):
+			session_read_samples(request->index >> 16, request->index & 0xFFFF, (struct tRecordDataPage *)request->pointer);
+			break;
+			
+		case(FLASH_MGR_SAVE_CHECKPOINT):
+			session_checkpoint((struct tSessionCheckpoint *)request->pointer);
+			break;
+			
+		case(FLASH_MGR_READ_CHECKPOINT):
+			if(session.resumed){
+				*((struct tSessionCheckpoint *)request->pointer) = session.checkpoint;
+			}else{
+				((struct tSessionCheckpoint *)request->pointer)->startAddress = SESSION_NO_CHECKPOINT;
+			}
+			break;
+			
 
-			case(FLASH_MGR_USED_SPACE):				
-				*(request.pointer) = (((recordTable.endAddress - flash.layout.recordDataStart) * 100) / (flash.layout.recordDataEnd - flash.layout.recordDataStart));
-				break;
-				
+		case(FLASH_MGR_READ_TRACK):
+			journal_read(JOURNAL_TYPE_TRACK, request->index, request->pointer, sizeof(struct tTracklist));
+			break;
+			
 
-			case(FLASH_MGR_ERASE_RECORDED_DATA):
-				recordTableIndex = 0;
-				recordTable.startAddress = flash.layout.recordDataStart;
-				recordTable.endAddress = flash.layout.recordDataStart;
+		case(FLASH_MGR_ADD_TRACK):
+			if( journal_write(JOURNAL_TYPE_TRACK, trackCount, request->pointer, sizeof(struct tTracklist)) == DATAFLASH_RESPONSE_OK ){
+				trackCount++;
+			}
+			break;
+			
 
-				flash_eraseRecordedData();
-				break;
-				
+		case(FLASH_MGR_ERASE_TRACKS):
+			flash_eraseTracks();
+			trackCount = 0;
+			break;
+			
 
-			case(FLASH_MGR_WRITE_USER_PREFS):
-				userPrefs.crc = flash_calculate_userPrefs_crc();
-				flash_UpdateSector(flash.layout.userPrefsStart, sizeof(userPrefs), &userPrefs);
-				break;
+		case(FLASH_MGR_READ_OTP):
+			flash_ReadOTP(request->index, request->length, request->pointer);
+			break;
 			
 
-			case(FLASH_MGR_SET_TRACK):
-				recordTable.trackID = (unsigned char)request.index;
-				break;
-				
+		case(FLASH_MGR_SECTOR_ERASE):
+			flash_eraseBlock(FLASH_CMD_BLOCK_ERASE_4KB, (request->index * FLASH_4KB) );
+			break;
+			
 
-			case(FLASH_MGR_SET_DATESTAMP):
-				recordTable.datestamp = request.index;
-				break;
-				
+		case(FLASH_MGR_BUSY):
+			*(request->pointer) = flash_is_busy();
+			break;
+			
 
-			case(FLASH_MGR_REQUEST_SHUTDOWN):
-				if(recordTable.startAddress != recordTable.endAddress){
-					// Need to close current record
-					recordTable.recordEmpty = FALSE;
-					flash_UpdateSector(flash.layout.recordTableStart + (sizeof(recordTable) * recordTableIndex), sizeof(recordTable), &recordTable);
-				}
-				debug_log(DEBUG_PRIORITY_INFO, DEBUG_SENDER_FLASH, "Task shut down");
-				wdt_send_request(WDT_REQUEST_DATAFLASH_SHUTDOWN_COMPLETE, NULL);
-				vTaskSuspend(NULL);
-				break;
-		}
-		
-		flash_set_wp();
-		flash_clr_busy_flag();
-		
-		// Resume requesting task if it has been suspended
-		if(request.resume == TRUE){
-			vTaskResume(request.handle);
-		}
+		case(FLASH_MGR_CHIP_ERASE):
+			// A blank part gets the full layout for its size, legacy parts included
+			flash_chipErase();
+			flash_default_layout();
+			flash_write_partitions();
+			journal_mount();
+			journal_invalidate();
+			flash_wear_save();
+			flash_badmap_prune();
+			flash_badmap_save();
+			flash_clr_full_flag();
+			session_mount();
+			trackCount = 0;
+			break;
+			
+
+		case(FLASH_MGR_IS_FLASH_FULL):
+			*(request->pointer) = flash_full_flag();
+			break;
+			
+
+		case(FLASH_MGR_USED_SPACE):				
+			*(request->pointer) = session_used_percent();
+			break;
+			
+
+		case(FLASH_MGR_ERASE_RECORDED_DATA):
+			session_erase_all();
+			break;
+			
+
+		case(FLASH_MGR_WRITE_OTP):				// Not implemented yet, the requester is resumed with the OTP untouched
+		case(FLASH_MGR_UPDATE_DATE):			// Superseded by FLASH_MGR_SET_DATESTAMP
+			break;
+			
+
+		case(FLASH_MGR_WRITE_USER_PREFS):
+			userPrefs.crc = flash_calculate_userPrefs_crc();
+			journal_write(JOURNAL_TYPE_USERPREFS, 0, (unsigned char *)&userPrefs, sizeof(userPrefs));
+			break;
 		
+
+		case(FLASH_MGR_SET_TRACK):
+			session.current.trackID = (unsigned char)request->index;
+			break;
+			
+
+		case(FLASH_MGR_SET_DATESTAMP):
+			session.current.datestamp = request->index;
+			break;
+			
+
+		case(FLASH_MGR_REQUEST_SHUTDOWN):
+			// Need to close current record
+			session_close();
+			flash_wear_save();
+			journal_flush();
+			flash_powerDown();
+			debug_log(DEBUG_PRIORITY_INFO, DEBUG_SENDER_FLASH, "Task shut down");
+			wdt_send_request(WDT_REQUEST_DATAFLASH_SHUTDOWN_COMPLETE, 0);
+			vTaskSuspend(NULL);
+			break;
+	}
+}
+
+// Resume requesting task if it has been suspended, or hand the buffer back to an asynchronous requester
+void flash_complete_request(struct tFlashRequest *request){
+	
+	if(request->resume == TRUE){
+		vTaskResume(request->handle);
+	}
+	
+	if(request->callback != NULL){
+		request->callback(request->pointer);
 	}
 }
 
 
 enum tFlashDevice flash_initDevice(void){
 	unsigned short spiResponse[3];
+	
+	// A reset of the MCU alone can leave the part in deep power-down, where it ignores the ID read
+	flash_select();
+	spi_write(FLASH_SPI, DATAFLASH_CMD_WAKEUP);
+	spi_unselectChip(FLASH_SPI, FLASH_SPI_NPCS);
+	
+	cpu_delay_us(DATAFLASH_WAKEUP_TIME, APPL_CPU_SPEED);
 		
-	spi_selectChip(FLASH_SPI, FLASH_SPI_NPCS);
+	flash_select();
 	spi_write(FLASH_SPI, DATAFLASH_CMD_READ_DEVICE_ID);
 	
 	spi_write(FLASH_SPI, DATAFLASH_CMD_DUMMY);
@@ -314,179 +540,496 @@ enum tFlashDevice flash_initDevice(void){
 	if( (spiResponse[0] == FLASH_ATMEL_AT25DF321_MAN_ID) & (spiResponse[1] == FLASH_ATMEL_AT25DF321_ID0) & (spiResponse[2] == FLASH_ATMEL_AT25DF321_ID1) ){
 		flash.device = ATMEL_AT25DF321;
 		
-		flash.layout.userPrefsStart		= FLASH_AT25DF321_USERPREFS_START;
-		flash.layout.userPrefsEnd		= FLASH_AT25DF321_USERPREFS_END;
-		flash.layout.trackListStart		= FLASH_AT25DF321_TRACKLIST_START;
-		flash.layout.trackListEnd		= FLASH_AT25DF321_TRACKLIST_END;
-		flash.layout.recordTableStart	= FLASH_AT25DF321_RECORDTABLE_START;
-		flash.layout.recordTableEnd		= FLASH_AT25DF321_RECORDTABLE_END;
-		flash.layout.recordDataStart	= FLASH_AT25DF321_RECORDDATA_START;
-		flash.layout.recordDataEnd		= FLASH_AT25DF321_RECORDDATA_END;
+		flash_at25df_part(FLASH_AT25DF321_END + 1);
+		flash.readCommand				= DATAFLASH_CMD_READ_ARRAY_FAST;
+		flash.readDummyBytes			= 1;
+		flash_setupSpi(FLASH_ATMEL_AT25DF321_MAX_CLOCK);
 		
 	}else if( (spiResponse[0] == FLASH_ATMEL_AT25DF161_MAN_ID) & (spiResponse[1] == FLASH_ATMEL_AT25DF161_ID0) & (spiResponse[2] == FLASH_ATMEL_AT25DF161_ID1) ){
 		flash.device = ATMEL_AT25DF161;
 		
-		flash.layout.userPrefsStart		= FLASH_AT25DF161_USERPREFS_START;
-		flash.layout.userPrefsEnd		= FLASH_AT25DF161_USERPREFS_END;
-		flash.layout.trackListStart		= FLASH_AT25DF161_TRACKLIST_START;
-		flash.layout.trackListEnd		= FLASH_AT25DF161_TRACKLIST_END;
-		flash.layout.recordTableStart	= FLASH_AT25DF161_RECORDTABLE_START;
-		flash.layout.recordTableEnd		= FLASH_AT25DF161_RECORDTABLE_END;
-		flash.layout.recordDataStart	= FLASH_AT25DF161_RECORDDATA_START;
-		flash.layout.recordDataEnd		= FLASH_AT25DF161_RECORDDATA_END;
+		flash_at25df_part(FLASH_AT25DF161_END + 1);
+		flash.readCommand				= DATAFLASH_CMD_READ_ARRAY_FAST;
+		flash.readDummyBytes			= 1;
+		flash_setupSpi(FLASH_ATMEL_AT25DF161_MAX_CLOCK);
+		
+	}else if( flash_probe_part(spiResponse[0], spiResponse[2]) ){
+		flash.device = GENERIC_DEVICE;
+		
+		flash.readCommand				= DATAFLASH_CMD_READ_ARRAY_FAST;
+		flash.readDummyBytes			= 1;
+		flash_setupSpi(FLASH_GENERIC_MAX_CLOCK);
 		
 	}else{
 		flash.device = UNKNOWN_DEVICE;
 		
-		flash.layout.userPrefsStart		= NULL;
-		flash.layout.userPrefsEnd		= NULL;
-		flash.layout.trackListStart		= NULL;
-		flash.layout.trackListEnd		= NULL;
-		flash.layout.recordTableStart	= NULL;
-		flash.layout.recordTableEnd		= NULL;
-		flash.layout.recordDataStart	= NULL;
-		flash.layout.recordDataEnd		= NULL;
+		// Standard opcodes at least, on the conservative identification clock and plain read
+		sfdp_family_defaults(spiResponse[0], 0, &flash.part);
+		flash.readCommand				= DATAFLASH_CMD_READ_ARRAY;
+		flash.readDummyBytes			= 0;
+		flash_setupSpi(FLASH_SPI_BAUDRATE);
 	}
 	
+	// Starting point for the busy time averages
+	flash.busyAverage[FLASH_OP_PROGRAM]		= flash.part.programTime << DATAFLASH_BUSY_AVERAGE_SHIFT;
+	flash.busyAverage[FLASH_OP_ERASE_4KB]	= flash.part.eraseTime[FLASH_ERASE_4KB] << DATAFLASH_BUSY_AVERAGE_SHIFT;
+	flash.busyAverage[FLASH_OP_ERASE_32KB]	= flash.part.eraseTime[FLASH_ERASE_32KB] << DATAFLASH_BUSY_AVERAGE_SHIFT;
+	flash.busyAverage[FLASH_OP_ERASE_64KB]	= flash.part.eraseTime[FLASH_ERASE_64KB] << DATAFLASH_BUSY_AVERAGE_SHIFT;
+	flash.busyAverage[FLASH_OP_CHIP_ERASE]	= flash.part.chipEraseTime << DATAFLASH_BUSY_AVERAGE_SHIFT;
+	
+	flash_default_layout();
+	
 	return flash.device;
 }
 
+// The AT25DF161/321 command set, typical times from their datasheets
+void flash_at25df_part(unsigned long size){
+	flash.part.size								= size;
+	flash.part.eraseCommand[FLASH_ERASE_4KB]	= FLASH_CMD_BLOCK_ERASE_4KB;
+	flash.part.eraseCommand[FLASH_ERASE_32KB]	= DATAFLASH_CMD_BLOCK_ERASE_32KB;
+	flash.part.eraseCommand[FLASH_ERASE_64KB]	= DATAFLASH_CMD_BLOCK_ERASE_64KB;
+	flash.part.suspendCommand					= DATAFLASH_CMD_PGM_ERASE_SUSPEND;
+	flash.part.resumeCommand					= DATAFLASH_CMD_PGM_ERASE_RESUME;
+	flash.part.powerDownCommand					= DATAFLASH_CMD_DEEP_POWER_DOWN;
+	flash.part.wakeUpCommand					= DATAFLASH_CMD_WAKEUP;
+	
+	flash.part.programTime						= DATAFLASH_PROGRAM_TIME;
+	flash.part.eraseTime[FLASH_ERASE_4KB]		= DATAFLASH_ERASE_4KB_TIME;
+	flash.part.eraseTime[FLASH_ERASE_32KB]		= DATAFLASH_ERASE_32KB_TIME;
+	flash.part.eraseTime[FLASH_ERASE_64KB]		= DATAFLASH_ERASE_64KB_TIME;
+	flash.part.chipEraseTime					= DATAFLASH_CHIP_ERASE_TIME;
+}
 
-union tDataflashStatus flash_readStatus(void){
-	unsigned short spiResponse[2];
-	union tDataflashStatus result;
-
-	spi_selectChip(FLASH_SPI, FLASH_SPI_NPCS);
-	spi_write(FLASH_SPI, DATAFLASH_CMD_READ_STATUS);
-	
-	spi_write(FLASH_SPI, DATAFLASH_CMD_DUMMY);
-	spi_read(FLASH_SPI, &spiResponse[0]);
+// Describe a part that isn't on the ID list from its SFDP tables, or failing that from the
+// defaults of its family. Runs on the identification clock before the scheduler starts.
+unsigned char flash_probe_part(unsigned char manufacturer, unsigned char capacity){
+	unsigned char header[SFDP_HEADER_LENGTH];
+	unsigned char table[SFDP_BASIC_MAX_DWORDS * 4];
+	unsigned long tableAddress;
+	unsigned char tableDwords;
+	unsigned char knownFamily;
 	
-	spi_write(FLASH_SPI, DATAFLASH_CMD_DUMMY);
-	spi_read(FLASH_SPI, &spiResponse[1]);
+	knownFamily = sfdp_family_defaults(manufacturer, capacity, &flash.part);
 	
-	spi_unselectChip(FLASH_SPI, FLASH_SPI_NPCS);
+	flash_read_sfdp(0, SFDP_HEADER_LENGTH, header);
 	
-	result.raw[0] = spiResponse[0];
-	result.raw[1] = spiResponse[1];
+	if( sfdp_find_basic(header, &tableAddress, &tableDwords) ){
+		flash_read_sfdp(tableAddress, tableDwords * 4, table);
+		
+		if( !sfdp_parse_basic(table, tableDwords, &flash.part) ){
+			debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "SFDP part not supported");
+			return FALSE;
+		}
+		
+	}else if(!knownFamily){
+		return FALSE;
+	}
 	
-	return result;
+	return (flash.part.size >= FLASH_GENERIC_MIN_SIZE);
 }
 
-
-unsigned char flash_GlobalUnprotect(void){
-	flash_WriteEnable();
+void flash_read_sfdp(unsigned long address, unsigned char length, unsigned char *bufferPointer){
+	unsigned char i;
+	unsigned short temp;
 	
-	spi_selectChip(FLASH_SPI, FLASH_SPI_NPCS);
-	spi_write(FLASH_SPI, DATAFLASH_CMD_WRITE_STATUS1);
-	spi_write(FLASH_SPI, DATAFLASH_STATUS_GLOBAL_UNPROTECT);
-	spi_unselectChip(FLASH_SPI, FLASH_SPI_NPCS);
+	flash_select();
+	spi_write(FLASH_SPI, SFDP_CMD_READ);
+	spi_write(FLASH_SPI, (address >> 16) & 0xFF);
+	spi_write(FLASH_SPI, (address >>  8) & 0xFF);
+	spi_write(FLASH_SPI, (address >>  0) & 0xFF);
+	spi_write(FLASH_SPI, DATAFLASH_CMD_DUMMY);
 	
-	return DATAFLASH_RESPONSE_OK;
-}
-
-
-unsigned char flash_WriteEnable(void){
-	spi_selectChip(FLASH_SPI, FLASH_SPI_NPCS);
-	spi_write(FLASH_SPI, DATAFLASH_CMD_WRITE_ENABLE);
-	spi_unselectChip(FLASH_SPI, FLASH_SPI_NPCS);
+	for(i = 0; i < length; i++){
+		spi_write(FLASH_SPI, DATAFLASH_CMD_DUMMY);
+		spi_read(FLASH_SPI, &temp);
+		bufferPointer[i] = temp & 0xFF;
+	}
 	
-	return DATAFLASH_RESPONSE_OK;
+	spi_unselectChip(FLASH_SPI, FLASH_SPI_NPCS);
 }
 
-
-unsigned char flash_WriteDisable(void){
-	spi_selectChip(FLASH_SPI, FLASH_SPI_NPCS);
-	spi_write(FLASH_SPI, DATAFLASH_CMD_WRITE_DISABLE);
-	spi_unselectChip(FLASH_SPI, FLASH_SPI_NPCS);
+// Layout a blank part of the detected type gets formatted with
+void flash_default_layout( void ){
 	
-	return DATAFLASH_RESPONSE_OK;
+	switch(flash.device){
+		case(ATMEL_AT25DF321):
+			flash.layout.journalStart		= FLASH_AT25DF321_JOURNAL_START;
+			flash.layout.journalEnd			= FLASH_AT25DF321_JOURNAL_END;
+			flash.layout.recordDataStart	= FLASH_AT25DF321_RECORDDATA_START;
+			flash.layout.recordDataEnd		= FLASH_AT25DF321_RECORDDATA_END;
+			flash.layout.partEnd			= FLASH_AT25DF321_END;
+			flash.layout.sessionSlots		= FLASH_AT25DF321_SESSION_SLOTS;
+			flash.layout.trackSlots			= FLASH_AT25DF321_TRACK_SLOTS;
+			break;
+			
+		case(ATMEL_AT25DF161):
+			flash.layout.journalStart		= FLASH_AT25DF161_JOURNAL_START;
+			flash.layout.journalEnd			= FLASH_AT25DF161_JOURNAL_END;
+			flash.layout.recordDataStart	= FLASH_AT25DF161_RECORDDATA_START;
+			flash.layout.recordDataEnd		= FLASH_AT25DF161_RECORDDATA_END;
+			flash.layout.partEnd			= FLASH_AT25DF161_END;
+			flash.layout.sessionSlots		= FLASH_AT25DF161_SESSION_SLOTS;
+			flash.layout.trackSlots			= FLASH_AT25DF161_TRACK_SLOTS;
+			break;
+			
+		case(GENERIC_DEVICE):
+			flash.layout.journalStart		= FLASH_GENERIC_JOURNAL_START;
+			flash.layout.journalEnd			= FLASH_GENERIC_JOURNAL_END;
+			flash.layout.recordDataStart	= FLASH_GENERIC_RECORDDATA_START;
+			flash.layout.partEnd			= flash.part.size - 1;
+			flash.layout.recordDataEnd		= flash.layout.partEnd - (FLASH_GENERIC_SPARE_SECTORS * FLASH_4KB);
+			flash.layout.sessionSlots		= FLASH_GENERIC_SESSION_SLOTS;
+			flash.layout.trackSlots			= FLASH_GENERIC_TRACK_SLOTS;
+			break;
+			
+		default:
+			flash.layout.journalStart		= 0;
+			flash.layout.journalEnd			= 0;
+			flash.layout.recordDataStart	= 0;
+			flash.layout.recordDataEnd		= 0;
+			flash.layout.partEnd			= 0;
+			flash.layout.sessionSlots		= 0;
+			flash.layout.trackSlots			= 0;
+			break;
+	}
+	
+	flash.layout.formatPending = FALSE;
 }
 
-
-unsigned char flash_UpdateSector(unsigned long startAddress, unsigned short length, unsigned char *bufferPointer){
-	unsigned char sectorBuffer[FLASH_4KB];
-	unsigned long sectorAddress = startAddress & 0xFFFFF000; // Mask off address bits A11 through A0 for 4KB sector address
-	unsigned short offset = startAddress & 0x0FFF;
-	unsigned short i;
-	
-	flash_ReadToBuffer(sectorAddress, FLASH_4KB, &sectorBuffer);
+// Pick up the layout the part was formatted with. Only reads, safe before the scheduler runs.
+unsigned char flash_load_partitions( void ){
+	struct tFlashPartitionTable table;
+	unsigned char i;
 	
-	// Erase the sector
-	if( flash_eraseBlock(FLASH_CMD_BLOCK_ERASE_4KB, sectorAddress) == DATAFLASH_RESPONSE_FAILURE ){
-		debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Erase Failed");
+	if(flash.device == UNKNOWN_DEVICE){
+		return DATAFLASH_RESPONSE_FAILURE;
 	}
 	
-	// Copy new data to buffer
-	for(i = 0; i < length; i++){
-		sectorBuffer[ i + offset ] = bufferPointer[i];
+	for(i = 0; i < FLASH_PARTITION_COPIES; i++){
+		flash_ReadToBuffer(FLASH_PARTITION_ADDRESS + (i * FLASH_PAGE_SIZE), sizeof(table), (unsigned char *)&table);
+		
+		if( flash_partition_valid(&table) ){
+			flash.layout.journalStart		= table.journalStart;
+			flash.layout.journalEnd			= table.journalEnd;
+			flash.layout.recordDataStart	= table.recordDataStart;
+			flash.layout.recordDataEnd		= table.recordDataEnd;
+			flash.layout.sessionSlots		= table.sessionSlots;
+			flash.layout.trackSlots			= table.trackSlots;
+			return DATAFLASH_RESPONSE_OK;
+		}
 	}
 	
-	// Write new data back
-	for(i = 0; i < FLASH_4KB; i += FLASH_PAGE_SIZE){
-		if( flash_WriteFromBuffer(sectorAddress + i, FLASH_PAGE_SIZE, &(sectorBuffer[i])) == DATAFLASH_RESPONSE_FAILURE ){
-			debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Write Failed");
-		}
-	}	
+	// Blank part or one last written by 1.30, the flash task migrates it and writes the default layout out
+	flash.layout.formatPending = TRUE;
 	
-	return TRUE;
+	return DATAFLASH_RESPONSE_OK;
 }
 
+// Tables that don't fit the detected part are ignored
+unsigned char flash_partition_valid(struct tFlashPartitionTable *table){
+	unsigned long partEnd = flash.layout.partEnd;
+	unsigned short journalSectors;
+	
+	if( (table->magic != FLASH_PARTITION_MAGIC) || (table->crc != flash_partition_crc(table)) ){
+		return FALSE;
+	}
+	
+	if( (table->journalStart & (FLASH_4KB - 1)) || ((table->journalEnd + 1) & (FLASH_4KB - 1)) ||
+		(table->recordDataStart & (FLASH_4KB - 1)) || ((table->recordDataEnd + 1) & (FLASH_4KB - 1)) ){
+		return FALSE;
+	}
+	
+	if( (table->journalStart < FLASH_4KB) || (table->journalEnd >= table->recordDataStart) ||
+		(table->recordDataStart >= table->recordDataEnd) || (table->recordDataEnd > partEnd) ){
+		return FALSE;
+	}
+	
+	journalSectors = (table->journalEnd - table->journalStart + 1) / FLASH_4KB;
+	if( (journalSectors < 2) || (journalSectors > JOURNAL_MAX_SECTORS) ){
+		return FALSE;
+	}
+	
+	// Session numbers wrap at 16 bits, slots have to divide that evenly
+	if( (table->sessionSlots == 0) || (table->sessionSlots > RECORDS_TOTAL_POSSIBLE) || (table->sessionSlots & (table->sessionSlots - 1)) ){
+		return FALSE;
+	}
+	
+	return (table->trackSlots != 0) && (table->trackSlots <= TRACKLIST_TOTAL_NUM);
+}
 
-unsigned char flash_eraseTracks(){
-	unsigned short i;
-	unsigned char userPrefsBuffer[flash.layout.userPrefsEnd - flash.layout.userPrefsStart + 1];
+// Write the current layout out as the partition table, erases the first sector
+unsigned char flash_write_partitions( void ){
+	struct tFlashPartitionTable table;
+	unsigned char i;
+	unsigned char response = DATAFLASH_RESPONSE_OK;
 	
-	// Copy the user prefs to buffer
-	flash_ReadToBuffer(flash.layout.userPrefsStart, flash.layout.userPrefsEnd - flash.layout.userPrefsStart + 1, &userPrefsBuffer);
+	if(flash.device == UNKNOWN_DEVICE){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
 	
-	// Erase the sector
-	if( flash_eraseBlock(FLASH_CMD_BLOCK_ERASE_4KB, flash.layout.userPrefsStart) == DATAFLASH_RESPONSE_FAILURE ){
-		debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Erase Failed");
+	table.magic				= FLASH_PARTITION_MAGIC;
+	table.version			= FLASH_LAYOUT_VERSION;
+	table.journalStart		= flash.layout.journalStart;
+	table.journalEnd		= flash.layout.journalEnd;
+	table.recordDataStart	= flash.layout.recordDataStart;
+	table.recordDataEnd		= flash.layout.recordDataEnd;
+	table.sessionSlots		= flash.layout.sessionSlots;
+	table.trackSlots		= flash.layout.trackSlots;
+	table.crc				= flash_partition_crc(&table);
+	
+	if( flash_eraseBlock(FLASH_CMD_BLOCK_ERASE_4KB, FLASH_PARTITION_ADDRESS) == DATAFLASH_RESPONSE_FAILURE ){
+		response = DATAFLASH_RESPONSE_FAILURE;
 	}
 	
-	for(i = flash.layout.userPrefsStart; i < flash.layout.userPrefsEnd; i += FLASH_PAGE_SIZE){
-		if( flash_WriteFromBuffer(i, FLASH_PAGE_SIZE, &(userPrefsBuffer[i])) == DATAFLASH_RESPONSE_FAILURE ){
-			debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Write Failed");
+	for(i = 0; i < FLASH_PARTITION_COPIES; i++){
+		if( flash_WriteFromBuffer(FLASH_PARTITION_ADDRESS + (i * FLASH_PAGE_SIZE), sizeof(table), (unsigned char *)&table) == DATAFLASH_RESPONSE_FAILURE ){
+			response = DATAFLASH_RESPONSE_FAILURE;
 		}
 	}
 	
-	return DATAFLASH_RESPONSE_OK;
+	if(response == DATAFLASH_RESPONSE_FAILURE){
+		debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Partition table write failed");
+	}
+	
+	flash.layout.formatPending = FALSE;
+	
+	return response;
 }
 
-unsigned char flash_eraseRecordedData(){
-	unsigned short i;
-	unsigned char sectorBuffer[FLASH_4KB];
+// A part still on the 1.30 fixed layout keeps its user prefs and track list in the
+// first sector, copy them into the journal before the partition table erases it.
+// Recorded sessions come first, their table is in the journal's first sector.
+void flash_migrate_v130( void ){
+	struct tUserPrefs defaults = userPrefs;
+	struct tTracklist track;
+	unsigned char i;
+	
+	session_migrate_v130();
+	
+	flash_ReadToBuffer(FLASH_V130_USERPREFS_START, sizeof(userPrefs), (unsigned char *)&userPrefs);
+	
+	if( flash_calculate_userPrefs_crc() == userPrefs.crc ){
+		journal_write(JOURNAL_TYPE_USERPREFS, 0, (unsigned char *)&userPrefs, sizeof(userPrefs));
+	}else{
+		userPrefs = defaults;
+	}
+	
+	// Tracks were appended from the start, the first empty one ends the list
+	for(i = 0; (i < FLASH_V130_TRACKLIST_NUM) && (i < flash.layout.trackSlots); i++){
+		flash_ReadToBuffer(FLASH_V130_TRACKLIST_START + (i * sizeof(track)), sizeof(track), (unsigned char *)&track);
+		
+		if(track.isEmpty){
+			break;
+		}
+		
+		journal_write(JOURNAL_TYPE_TRACK, i, (unsigned char *)&track, sizeof(track));
+	}
+	
+	if(i){
+		debug_log(DEBUG_PRIORITY_INFO, DEBUG_SENDER_FLASH, "Tracks migrated from 1.30");
+	}
+	
+	journal_flush();
+	flash_read_stop();
+}
+
+unsigned short flash_partition_crc(struct tFlashPartitionTable *table){
+	unsigned char *data = (unsigned char *)table;
+	unsigned short crc = 0;
+	unsigned char i;
+	
+	for(i = 0; i < (sizeof(struct tFlashPartitionTable) - sizeof(table->crc)); i++){
+		crc = update_crc_ccitt(crc, data[i]);
+	}
+	
+	return crc;
+}
 
-	flash_ReadToBuffer(flash.layout.userPrefsStart, FLASH_4KB, &sectorBuffer);
+void flash_setupSpi(unsigned int maxClock){
+	unsigned int divisor;
 	
-	// Erase the flash
-	if( flash_chipErase() == DATAFLASH_RESPONSE_FAILURE){
-		debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Erase Failed");
+	// ASF getBaudDiv() rounds the divisor up past the nearest value, so program SCBR directly
+	// with the smallest divisor that keeps SCK at or below the limit
+	divisor = (APPL_PBA_SPEED + maxClock - 1) / maxClock;
+	if(divisor == 0){
+		divisor = 1;
+	}else if(divisor > DATAFLASH_SPI_MAX_DIVISOR){
+		divisor = DATAFLASH_SPI_MAX_DIVISOR;
 	}
+	
+	// Only called between transfers; the dataflash is always on NPCS0
+	FLASH_SPI->CSR0.scbr = divisor;
+	
+	flash.spiClock = APPL_PBA_SPEED / divisor;
+}
 
-	// Write new data back
-	for(i = 0; i < FLASH_4KB; i += FLASH_PAGE_SIZE){
-		if( flash_WriteFromBuffer(flash.layout.userPrefsStart + i, FLASH_PAGE_SIZE, &(sectorBuffer[i])) == DATAFLASH_RESPONSE_FAILURE ){
+
+union tDataflashStatus flash_readStatus(void){
+	unsigned short spiResponse[2];
+	union tDataflashStatus result;
+
+	flash_select();
+	spi_write(FLASH_SPI, DATAFLASH_CMD_READ_STATUS);
+	
+	spi_write(FLASH_SPI, DATAFLASH_CMD_DUMMY);
+	spi_read(FLASH_SPI, &spiResponse[0]);
+	
+	spi_write(FLASH_SPI, DATAFLASH_CMD_DUMMY);
+	spi_read(FLASH_SPI, &spiResponse[1]);
+	
+	spi_unselectChip(FLASH_SPI, FLASH_SPI_NPCS);
+	
+	result.raw[0] = spiResponse[0];
+	result.raw[1] = spiResponse[1];
+	
+	return result;
+}
+
+
+unsigned char flash_GlobalUnprotect(void){
+	flash_WriteEnable();
+	
+	flash_select();
+	spi_write(FLASH_SPI, DATAFLASH_CMD_WRITE_STATUS1);
+	spi_write(FLASH_SPI, DATAFLASH_STATUS_GLOBAL_UNPROTECT);
+	spi_unselectChip(FLASH_SPI, FLASH_SPI_NPCS);
+	
+	return DATAFLASH_RESPONSE_OK;
+}
+
+
+unsigned char flash_WriteEnable(void){
+	flash_select();
+	spi_write(FLASH_SPI, DATAFLASH_CMD_WRITE_ENABLE);
+	spi_unselectChip(FLASH_SPI, FLASH_SPI_NPCS);
+	
+	return DATAFLASH_RESPONSE_OK;
+}
+
+
+unsigned char flash_WriteDisable(void){
+	flash_select();
+	spi_write(FLASH_SPI, DATAFLASH_CMD_WRITE_DISABLE);
+	spi_unselectChip(FLASH_SPI, FLASH_SPI_NPCS);
+	
+	return DATAFLASH_RESPONSE_OK;
+}
+
+
+unsigned char flash_eraseTracks(){
+	unsigned short i;
+	unsigned char result = DATAFLASH_RESPONSE_OK;
+	
+	for(i = 0; i < flash.layout.trackSlots; i++){
+		if( journal_delete(JOURNAL_TYPE_TRACK, i) == DATAFLASH_RESPONSE_FAILURE ){
 			debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Write Failed");
+			result = DATAFLASH_RESPONSE_FAILURE;
 		}
-	}	
+	}
+	
+	return result;
+}
+
+unsigned char flash_eraseRecordedData(){
+	
+	if(flash.device == UNKNOWN_DEVICE){
+		return FALSE;
+	}
+	
+	flash_eraseRange(flash.layout.recordDataStart, flash.layout.recordDataEnd);
 	
 	return TRUE;
 }
 
+// Erase the 4KB sectors from startAddress through endAddress with the fewest block erases.
+// Taking the largest aligned block that fits at each step is optimal since the sizes nest.
+unsigned char flash_eraseRange(unsigned long startAddress, unsigned long endAddress){
+	unsigned long address = startAddress & ~(FLASH_4KB - 1);
+	unsigned char blockSize;
+	unsigned long blockLength;
+	unsigned char response = DATAFLASH_RESPONSE_OK;
+	
+	while( address <= endAddress ){
+		if( flash.part.eraseCommand[FLASH_ERASE_64KB] && !(address & (DATAFLASH_64KB - 1)) && ((address + DATAFLASH_64KB - 1) <= endAddress) ){
+			blockSize = DATAFLASH_CMD_BLOCK_ERASE_64KB;
+			blockLength = DATAFLASH_64KB;
+		}else if( flash.part.eraseCommand[FLASH_ERASE_32KB] && !(address & (DATAFLASH_32KB - 1)) && ((address + DATAFLASH_32KB - 1) <= endAddress) ){
+			blockSize = DATAFLASH_CMD_BLOCK_ERASE_32KB;
+			blockLength = DATAFLASH_32KB;
+		}else{
+			blockSize = FLASH_CMD_BLOCK_ERASE_4KB;
+			blockLength = FLASH_4KB;
+		}
+		
+		if( flash_eraseBlock(blockSize, address) == DATAFLASH_RESPONSE_FAILURE ){
+			debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Erase Failed");
+			response = DATAFLASH_RESPONSE_FAILURE;
+		}
+		
+		address += blockLength;
+	}
+	
+	return response;
+}
+
+// The menus and USB read the partition table and journal over and over, those go through the cache
 unsigned char flash_ReadToBuffer(unsigned long startAddress, unsigned short length, unsigned char *bufferPointer){
-	unsigned short dummyData;
+	
+	if( (startAddress + length) <= flash.layout.recordDataStart ){
+		return flash_cache_read(startAddress, length, bufferPointer);
+	}
+	
+	return flash_read_mapped(startAddress, length, bufferPointer);
+}
 
-	spi_selectChip(FLASH_SPI, FLASH_SPI_NPCS);
+// Reads record log addresses from wherever their sector lives, split at remapped sectors
+unsigned char flash_read_mapped(unsigned long startAddress, unsigned short length, unsigned char *bufferPointer){
+	unsigned short chunk;
 	
-	spi_write(FLASH_SPI, DATAFLASH_CMD_READ_ARRAY);
-	spi_write(FLASH_SPI, (startAddress >> 16) & 0xFF);
-	spi_write(FLASH_SPI, (startAddress >>  8) & 0xFF);
-	spi_write(FLASH_SPI, (startAddress & 0xFF) );
-	spi_read(FLASH_SPI, &dummyData);	// Dummy read required to clear the SPI->RDR register before enabling PDCA
+	if(flash.badMap.count == 0){
+		return flash_read_array(startAddress, length, bufferPointer);
+	}
 	
-	while( !spi_writeEndCheck(FLASH_SPI) );
+	while(length){
+		chunk = FLASH_4KB - (startAddress & (FLASH_4KB - 1));
+		if(chunk > length) chunk = length;
+		
+		if( flash_read_array(flash_remap(startAddress), chunk, bufferPointer) == DATAFLASH_RESPONSE_FAILURE ){
+			return DATAFLASH_RESPONSE_FAILURE;
+		}
+		
+		startAddress += chunk;
+		bufferPointer += chunk;
+		length -= chunk;
+	}
+	
+	return DATAFLASH_RESPONSE_OK;
+}
+
+unsigned char flash_read_array(unsigned long startAddress, unsigned short length, unsigned char *bufferPointer){
+	portTickType start = xTaskGetTickCount();
+	unsigned short dummyData;
+	unsigned char dummyBytes;
+
+	// A read that starts where the open one stopped just keeps clocking, the array read never ends on its own
+	if( (flash.readStream == FALSE) || (startAddress != flash.readStreamAddress) ){
+		flash_select();
+		
+		spi_write(FLASH_SPI, flash.readCommand);
+		spi_write(FLASH_SPI, (startAddress >> 16) & 0xFF);
+		spi_write(FLASH_SPI, (startAddress >>  8) & 0xFF);
+		spi_write(FLASH_SPI, (startAddress & 0xFF) );
+		
+		for(dummyBytes = 0; dummyBytes < flash.readDummyBytes; dummyBytes++){
+			spi_write(FLASH_SPI, DATAFLASH_CMD_DUMMY);
+		}
+		
+		spi_read(FLASH_SPI, &dummyData);	// Dummy read required to clear the SPI->RDR register before enabling PDCA
+		
+		while( !spi_writeEndCheck(FLASH_SPI) );
+		
+		flash.readStream = TRUE;
+	}
 	
 	pdca_load_channel(FLASH_SPI_RX_PDCA_CHANNEL, bufferPointer, length);
 	pdca_load_channel(FLASH_SPI_TX_PDCA_CHANNEL, (void *)0x80000000, length); // Use start of Flash as Dummy Bytes to Clock Out
@@ -494,32 +1037,179 @@ unsigned char flash_ReadToBuffer(unsigned long startAddress, unsigned short leng
 	pdca_enable(FLASH_SPI_RX_PDCA_CHANNEL);
 	pdca_enable(FLASH_SPI_TX_PDCA_CHANNEL);
 	
-	while( !(pdca_get_transfer_status(FLASH_SPI_TX_PDCA_CHANNEL) & PDCA_TRANSFER_COMPLETE) ){
-		if( xTaskGetSchedulerState() == taskSCHEDULER_RUNNING ) {
-			vTaskDelay( (portTickType)TASK_DELAY_MS( DATAFLASH_PDCA_CHECK_TIME ) );
+	// Receive finishes last
+	flash_pdca_wait(FLASH_SPI_RX_PDCA_CHANNEL);
+	
+	// Leave chip select asserted, flash_select() or flash_read_stop() ends the read
+	flash.readStreamAddress = startAddress + length;
+	flash.spiStats.bytesRead += length;
+	
+	flash_stats_record(FLASH_OP_READ, (xTaskGetTickCount() - start) * portTICK_RATE_MS, FALSE);
+	
+	return DATAFLASH_RESPONSE_OK;
+}
+
+// Whole pages are cached, a miss reads the page and replaces the least recently used one
+unsigned char flash_cache_read(unsigned long startAddress, unsigned short length, unsigned char *bufferPointer){
+	struct tFlashCacheLine *line;
+	unsigned long pageAddress;
+	unsigned short offset, chunk;
+	unsigned char i;
+	
+	while(length){
+		pageAddress = startAddress & ~(FLASH_PAGE_SIZE - 1);
+		offset = startAddress - pageAddress;
+		
+		line = &flash.cache[0];
+		for(i = 0; i < FLASH_CACHE_PAGES; i++){
+			if(flash.cache[i].address == pageAddress){
+				line = &flash.cache[i];
+				break;
+			}
+			
+			if( (line->address != FLASH_CACHE_EMPTY) &&
+				((flash.cache[i].address == FLASH_CACHE_EMPTY) || (flash.cache[i].lastUsed < line->lastUsed)) ){
+				line = &flash.cache[i];
+			}
+		}
+		
+		if(line->address == pageAddress){
+			flash.cacheStats.hits++;
 		}else{
-			asm("nop");
-		}			
+			line->address = FLASH_CACHE_EMPTY;
+			
+			if( flash_read_mapped(pageAddress, FLASH_PAGE_SIZE, line->data) == DATAFLASH_RESPONSE_FAILURE ){
+				return DATAFLASH_RESPONSE_FAILURE;
+			}
+			
+			line->address = pageAddress;
+			flash.cacheStats.misses++;
+		}
+		
+		line->lastUsed = ++flash.cacheClock;
+		
+		chunk = FLASH_PAGE_SIZE - offset;
+		if(chunk > length) chunk = length;
+		
+		memcpy(bufferPointer, &line->data[offset], chunk);
+		
+		startAddress += chunk;
+		bufferPointer += chunk;
+		length -= chunk;
 	}
 	
-	spi_unselectChip(FLASH_SPI, FLASH_SPI_NPCS);
+	return DATAFLASH_RESPONSE_OK;
+}
+
+// Drops the cached pages from startAddress up to and including endAddress
+void flash_cache_invalidate(unsigned long startAddress, unsigned long endAddress){
+	unsigned char i;
 	
-	if(flash_operation_failed()){
+	for(i = 0; i < FLASH_CACHE_PAGES; i++){
+		if( (flash.cache[i].address != FLASH_CACHE_EMPTY) &&
+			(flash.cache[i].address <= endAddress) && ((flash.cache[i].address + FLASH_PAGE_SIZE - 1) >= startAddress) ){
+			flash.cache[i].address = FLASH_CACHE_EMPTY;
+		}
+	}
+}
+
+// Stream a contiguous range under a single read command, the chunk callback hands back the buffer for the next chunk
+unsigned char flash_ReadRange(struct tFlashRange *range){
+	unsigned long address = range->address;
+	unsigned long remaining = range->length;
+	unsigned char *buffer = range->buffer;
+	unsigned short chunkLength;
+	
+	if( (range->chunkLength == 0) || (range->chunk == NULL) ){
 		return DATAFLASH_RESPONSE_FAILURE;
 	}
 	
+	while( remaining && (buffer != NULL) ){
+		chunkLength = range->chunkLength;
+		if(chunkLength > remaining) chunkLength = remaining;
+		
+		if( flash_ReadToBuffer(address, chunkLength, buffer) == DATAFLASH_RESPONSE_FAILURE ){
+			return DATAFLASH_RESPONSE_FAILURE;
+		}
+		
+		address += chunkLength;
+		remaining -= chunkLength;
+		
+		// Chip select stays asserted while the caller consumes the chunk
+		buffer = range->chunk(buffer, chunkLength);
+	}
+	
+	flash_read_stop();
+	
+	if(remaining){
+		return DATAFLASH_RESPONSE_FAILURE;	// Caller stopped early
+	}
+	
 	return DATAFLASH_RESPONSE_OK;
 }
 
+// Every other command has to end an open array read first
+void flash_select( void ){
+	flash_read_stop();
+	spi_selectChip(FLASH_SPI, FLASH_SPI_NPCS);
+	flash.spiStats.commands++;
+}
+
+void flash_read_stop( void ){
+	if(flash.readStream == TRUE){
+		spi_unselectChip(FLASH_SPI, FLASH_SPI_NPCS);
+		flash.readStream = FALSE;
+	}
+}
+
+// Record log programs are read back, a sector that fails is retired to a spare and the program retried once
 unsigned char flash_WriteFromBuffer(unsigned long startAddress, unsigned short length, unsigned char *bufferPointer){
+	unsigned char response;
 
-	while( flash_is_busy() ){
-		vTaskDelay( (portTickType)TASK_DELAY_MS( DATAFLASH_PROGRAM_TIME ) );
+	flash_cache_invalidate(startAddress, startAddress + length - 1);
+	
+	if( !flash_in_record_log(startAddress) ){
+		return flash_program(startAddress, length, bufferPointer);
+	}
+	
+	response = flash_program_verified(flash_remap(startAddress), length, bufferPointer);
+	
+	if(response == DATAFLASH_RESPONSE_OK){
+		return response;
+	}
+	
+	if( flash_retire_sector(startAddress) == DATAFLASH_RESPONSE_FAILURE ){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+	
+	// One spare per program, a second failure is reported instead of burning through them
+	response = flash_program_verified(flash_remap(startAddress), length, bufferPointer);
+	
+	if(response == DATAFLASH_RESPONSE_FAILURE){
+		debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Spare sector program failed");
 	}
 	
+	return response;
+}
+
+// Page program at a physical address, read back to check every byte took
+unsigned char flash_program_verified(unsigned long startAddress, unsigned short length, unsigned char *bufferPointer){
+	
+	if( flash_program(startAddress, length, bufferPointer) == DATAFLASH_RESPONSE_FAILURE ){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+	
+	return flash_verify(startAddress, length, bufferPointer) ? DATAFLASH_RESPONSE_OK : DATAFLASH_RESPONSE_FAILURE;
+}
+
+// Page program at a physical address
+unsigned char flash_program(unsigned long startAddress, unsigned short length, unsigned char *bufferPointer){
+	
+	flash_wait_ready();
+	
 	flash_WriteEnable();
 	
-	spi_selectChip(FLASH_SPI, FLASH_SPI_NPCS);
+	flash_select();
 	
 	spi_write(FLASH_SPI, DATAFLASH_CMD_PAGE_PROGRAM);
 	spi_write(FLASH_SPI, (startAddress >> 16) & 0xFF);
@@ -531,34 +1221,51 @@ unsigned char flash_WriteFromBuffer(unsigned long startAddress, unsigned short l
 	pdca_load_channel(FLASH_SPI_TX_PDCA_CHANNEL, bufferPointer, length);
 	pdca_enable(FLASH_SPI_TX_PDCA_CHANNEL);
 	
-	while( !(pdca_get_transfer_status(FLASH_SPI_TX_PDCA_CHANNEL) & PDCA_TRANSFER_COMPLETE) ){
-		if( xTaskGetSchedulerState() == taskSCHEDULER_RUNNING ) {
-			vTaskDelay( (portTickType)TASK_DELAY_MS( DATAFLASH_PDCA_CHECK_TIME ) );
-		}else{
-			asm("nop");
-		}			
-	}
+	flash_pdca_wait(FLASH_SPI_TX_PDCA_CHANNEL);
 	
 	spi_unselectChip(FLASH_SPI, FLASH_SPI_NPCS);
 	
+	flash.spiStats.bytesWritten += length;
+	
 	// Wait for dataflash to become ready again.
-	vTaskDelay( (portTickType)TASK_DELAY_MS( DATAFLASH_PROGRAM_TIME ) );
-	while( flash_is_busy() ){
-		vTaskDelay( (portTickType)TASK_DELAY_MS( DATAFLASH_PROGRAM_TIME ) );
-	}
+	return flash_wait_operation(FLASH_OP_PROGRAM);
+}
+
+// Compares a programmed range against the buffer it was written from
+unsigned char flash_verify(unsigned long startAddress, unsigned short length, unsigned char *bufferPointer){
+	unsigned char readBack[FLASH_VERIFY_CHUNK];
+	unsigned short chunk;
+	
+	while(length){
+		chunk = (length > FLASH_VERIFY_CHUNK) ? FLASH_VERIFY_CHUNK : length;
 		
-	if(flash_operation_failed()){
-		return DATAFLASH_RESPONSE_FAILURE;
+		flash_read_array(startAddress, chunk, readBack);
+		if( memcmp(readBack, bufferPointer, chunk) != 0 ){
+			flash_read_stop();
+			return FALSE;
+		}
+		
+		startAddress += chunk;
+		bufferPointer += chunk;
+		length -= chunk;
 	}
 	
-	return DATAFLASH_RESPONSE_OK;
+	flash_read_stop();
+	
+	return TRUE;
 }
 
 unsigned char flash_ReadOTP(unsigned char startAddress, unsigned char length, unsigned char *bufferPointer){
 	unsigned char i;
 	unsigned short temp;
 	
-	spi_selectChip(FLASH_SPI, FLASH_SPI_NPCS);
+	// The factory data lives in the AT25DF security register, other parts have none
+	if( !flash_is_at25df() ){
+		memset(bufferPointer, 0xFF, length);
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+	
+	flash_select();
 	spi_write(FLASH_SPI, DATAFLASH_CMD_READ_OTP);
 	spi_write(FLASH_SPI, 0x00);
 	spi_write(FLASH_SPI, 0x00);
@@ -580,13 +1287,15 @@ unsigned char flash_ReadOTP(unsigned char startAddress, unsigned char length, un
 unsigned char flash_WriteOTP(unsigned char startAddress, unsigned char length, unsigned char *bufferPointer){
 	unsigned char i;
 	
-	while( flash_is_busy() ){
-		vTaskDelay( (portTickType)TASK_DELAY_MS( DATAFLASH_PROGRAM_TIME ) );
+	if( !flash_is_at25df() ){
+		return DATAFLASH_RESPONSE_FAILURE;
 	}
 	
+	flash_wait_ready();
+	
 	flash_WriteEnable();
 
-	spi_selectChip(FLASH_SPI, FLASH_SPI_NPCS);
+	flash_select();
 	spi_write(FLASH_SPI, DATAFLASH_CMD_PROGRAM_OTP);
 	spi_write(FLASH_SPI, 0x00);
 	spi_write(FLASH_SPI, 0x00);
@@ -599,46 +1308,112 @@ unsigned char flash_WriteOTP(unsigned char startAddress, unsigned char length, u
 	spi_unselectChip(FLASH_SPI, FLASH_SPI_NPCS);
 	
 	// Wait for dataflash to become ready again.
-	vTaskDelay( (portTickType)TASK_DELAY_MS( DATAFLASH_PROGRAM_TIME ) );
-	while( flash_is_busy() ){
-		vTaskDelay( (portTickType)TASK_DELAY_MS( DATAFLASH_PROGRAM_TIME ) );
+	return flash_wait_operation(FLASH_OP_PROGRAM);
+}
+
+// Record log blocks erase in place plus the spares standing in for their sectors. A failed
+// 4KB erase retires the sector, a failed larger erase is redone a sector at a time.
+unsigned char flash_eraseBlock(unsigned char blockSize, unsigned long startAddress){
+	unsigned long blockStart, blockEnd, address;
+	unsigned char response, i;
+	
+	if(blockSize == DATAFLASH_CMD_BLOCK_ERASE_64KB){
+		blockStart = startAddress & ~(DATAFLASH_64KB - 1);
+		blockEnd = blockStart + DATAFLASH_64KB - 1;
+	}else if(blockSize == DATAFLASH_CMD_BLOCK_ERASE_32KB){
+		blockStart = startAddress & ~(DATAFLASH_32KB - 1);
+		blockEnd = blockStart + DATAFLASH_32KB - 1;
+	}else if(blockSize == FLASH_CMD_BLOCK_ERASE_4KB){
+		blockStart = startAddress & ~(FLASH_4KB - 1);
+		blockEnd = blockStart + FLASH_4KB - 1;
+	}else{
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+	
+	flash_cache_invalidate(blockStart, blockEnd);
+	
+	if( !flash_in_record_log(blockStart) ){
+		return flash_erase(blockSize, startAddress);
 	}
+	
+	if(blockSize == FLASH_CMD_BLOCK_ERASE_4KB){
+		response = flash_erase(blockSize, flash_remap(blockStart));
 		
-	if( flash_operation_failed() ){
-		return DATAFLASH_RESPONSE_FAILURE;
+		if( (response == DATAFLASH_RESPONSE_FAILURE) && (flash_retire_sector(blockStart) == DATAFLASH_RESPONSE_OK) ){
+			response = DATAFLASH_RESPONSE_OK;	// The spare came back erased
+		}
+		
+		return response;
 	}
 	
-	return DATAFLASH_RESPONSE_OK;
+	response = flash_erase(blockSize, blockStart);
+	
+	if(response == DATAFLASH_RESPONSE_FAILURE){
+		response = DATAFLASH_RESPONSE_OK;
+		
+		for(address = blockStart; address < blockEnd; address += FLASH_4KB){
+			if( flash_eraseBlock(FLASH_CMD_BLOCK_ERASE_4KB, address) == DATAFLASH_RESPONSE_FAILURE ){
+				response = DATAFLASH_RESPONSE_FAILURE;
+			}
+		}
+		
+		return response;
+	}
+	
+	for(i = 0; i < flash.badMap.count; i++){
+		address = (unsigned long)flash.badMap.remap[i].logical * FLASH_4KB;
+		
+		if( (address >= blockStart) && (address <= blockEnd) &&
+			(flash_eraseBlock(FLASH_CMD_BLOCK_ERASE_4KB, address) == DATAFLASH_RESPONSE_FAILURE) ){
+			response = DATAFLASH_RESPONSE_FAILURE;
+		}
+	}
+	
+	return response;
 }
 
-unsigned char flash_eraseBlock(unsigned char blockSize, unsigned long startAddress){
-	if( (blockSize == FLASH_CMD_BLOCK_ERASE_4KB) | (blockSize == DATAFLASH_CMD_BLOCK_ERASE_32KB) | (blockSize == DATAFLASH_CMD_BLOCK_ERASE_64KB) ){
+// Block erase at a physical address. blockSize names the AT25DF opcode, the part's own is sent.
+unsigned char flash_erase(unsigned char blockSize, unsigned long startAddress){
+	enum tFlashEraseSize eraseSize = flash_erase_size(blockSize);
+	unsigned char response;
+	
+	if( (eraseSize != FLASH_ERASE_SIZES) && flash.part.eraseCommand[eraseSize] ){
 		
-		while( flash_is_busy() ){
-			vTaskDelay( (portTickType)TASK_DELAY_MS( DATAFLASH_PROGRAM_TIME ) );
-		}
+		flash_wait_ready();
 		
 		flash_WriteEnable();
 		
-		spi_selectChip(FLASH_SPI, FLASH_SPI_NPCS);
+		flash_select();
 		
-		spi_write(FLASH_SPI, blockSize);
+		spi_write(FLASH_SPI, flash.part.eraseCommand[eraseSize]);
 		spi_write(FLASH_SPI, (startAddress >> 16) & 0xFF);
 		spi_write(FLASH_SPI, (startAddress >>  8) & 0xFF);
 		spi_write(FLASH_SPI, (startAddress >>  0) & 0xFF);
 		
 		spi_unselectChip(FLASH_SPI, FLASH_SPI_NPCS);
 		
-		// Wait for dataflash to become ready again.
-		vTaskDelay( (portTickType)TASK_DELAY_MS( DATAFLASH_ERASE_TIME ) );
-		while( flash_is_busy() ){
-			vTaskDelay( (portTickType)TASK_DELAY_MS( DATAFLASH_ERASE_TIME ) );
-		}
+		// Wait for dataflash to become ready again. Reads outside the block may suspend the erase meanwhile.
+		flash.eraseSuspendable = (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) && flash.part.suspendCommand;
 		
-		if(flash_operation_failed()){
-			return DATAFLASH_RESPONSE_FAILURE;
+		if(blockSize == DATAFLASH_CMD_BLOCK_ERASE_64KB){
+			flash.eraseStart = startAddress & ~(DATAFLASH_64KB - 1);
+			flash.eraseEnd = flash.eraseStart + DATAFLASH_64KB - 1;
+			response = flash_wait_operation(FLASH_OP_ERASE_64KB);
+		}else if(blockSize == DATAFLASH_CMD_BLOCK_ERASE_32KB){
+			flash.eraseStart = startAddress & ~(DATAFLASH_32KB - 1);
+			flash.eraseEnd = flash.eraseStart + DATAFLASH_32KB - 1;
+			response = flash_wait_operation(FLASH_OP_ERASE_32KB);
+		}else{
+			flash.eraseStart = startAddress & ~(FLASH_4KB - 1);
+			flash.eraseEnd = flash.eraseStart + FLASH_4KB - 1;
+			response = flash_wait_operation(FLASH_OP_ERASE_4KB);
 		}
-		return DATAFLASH_RESPONSE_OK;
+		
+		flash.eraseSuspendable = FALSE;
+		
+		flash_wear_count(flash.eraseStart, (flash.eraseEnd - flash.eraseStart + 1) / FLASH_4KB);
+		
+		return response;
 		
 	}else{
 		return DATAFLASH_RESPONSE_FAILURE;
@@ -646,55 +1421,117 @@ unsigned char flash_eraseBlock(unsigned char blockSize, unsigned long startAddre
 	}
 }
 
-unsigned char flash_chipErase( void ){
-	while( flash_is_busy() ){
-		vTaskDelay( (portTickType)TASK_DELAY_MS( DATAFLASH_PROGRAM_TIME ) );
+enum tFlashEraseSize flash_erase_size(unsigned char blockSize){
+	
+	switch(blockSize){
+		case(FLASH_CMD_BLOCK_ERASE_4KB):
+			return FLASH_ERASE_4KB;
+			
+		case(DATAFLASH_CMD_BLOCK_ERASE_32KB):
+			return FLASH_ERASE_32KB;
+			
+		case(DATAFLASH_CMD_BLOCK_ERASE_64KB):
+			return FLASH_ERASE_64KB;
+			
+		default:
+			return FLASH_ERASE_SIZES;
 	}
+}
+
+unsigned char flash_chipErase( void ){
+	flash_wait_ready();
 	
 	flash_WriteEnable();
 	
-	spi_selectChip(FLASH_SPI, FLASH_SPI_NPCS);
+	flash_select();
 	spi_write(FLASH_SPI, DATAFLASH_CMD_CHIP_ERASE);
 	spi_unselectChip(FLASH_SPI, FLASH_SPI_NPCS);
 	
+	flash_cache_invalidate(0, FLASH_CACHE_EMPTY);
 	
-	// Wait for dataflash to become ready again.
-	vTaskDelay( (portTickType)TASK_DELAY_MS( DATAFLASH_ERASE_TIME ) );
-	while( flash_is_busy() ){
-		vTaskDelay( (portTickType)TASK_DELAY_MS( DATAFLASH_ERASE_TIME ) );
-	}
-		
-	if(flash_operation_failed()){
-		return DATAFLASH_RESPONSE_FAILURE;
+	// Every region takes one more erase, counted against the layout the chip had
+	if(flash.device != UNKNOWN_DEVICE){
+		flash_wear_count(0, flash.layout.journalStart / FLASH_4KB);
+		flash_wear_count(flash.layout.journalStart, (flash.layout.journalEnd - flash.layout.journalStart + 1) / FLASH_4KB);
+		flash_wear_count(flash.layout.recordDataStart, (flash.layout.recordDataEnd - flash.layout.recordDataStart + 1) / FLASH_4KB);
 	}
-	return DATAFLASH_RESPONSE_OK;
+	
+	// Wait for dataflash to become ready again.
+	return flash_wait_operation(FLASH_OP_CHIP_ERASE);
 }
 
 unsigned char flash_powerDown( void ){
-		while( flash_is_busy() ){
-			vTaskDelay( (portTickType)TASK_DELAY_MS( DATAFLASH_PROGRAM_TIME ) );
+		
+		// Parts without deep power-down just stay in standby
+		if(flash.poweredDown || !flash.part.powerDownCommand){
+			return DATAFLASH_RESPONSE_OK;
 		}
 		
-		spi_selectChip(FLASH_SPI, FLASH_SPI_NPCS);
-		spi_write(FLASH_SPI, DATAFLASH_CMD_DEEP_POWER_DOWN);
+		flash_wait_ready();
+		
+		flash_select();
+		spi_write(FLASH_SPI, flash.part.powerDownCommand);
 		spi_unselectChip(FLASH_SPI, FLASH_SPI_NPCS);
 		
+		flash_power_account();
+		flash.poweredDown = TRUE;
+		
 		return DATAFLASH_RESPONSE_OK;
 }
 
 unsigned char flash_wakeUp( void ){
-	
-		while( flash_is_busy() ){
-			vTaskDelay( (portTickType)TASK_DELAY_MS( DATAFLASH_PROGRAM_TIME ) );
+		
+		if(!flash.poweredDown){
+			return DATAFLASH_RESPONSE_OK;
 		}
 		
-		spi_selectChip(FLASH_SPI, FLASH_SPI_NPCS);
-		spi_write(FLASH_SPI, DATAFLASH_CMD_WAKEUP);
+		// Status reads are ignored in deep power-down, so no busy check here
+		flash_select();
+		spi_write(FLASH_SPI, flash.part.wakeUpCommand);
 		spi_unselectChip(FLASH_SPI, FLASH_SPI_NPCS);
 		
+		cpu_delay_us(DATAFLASH_WAKEUP_TIME, APPL_CPU_SPEED);
+		
+		flash_power_account();
+		flash.poweredDown = FALSE;
+		flash.power.wakeups++;
+		
 		return DATAFLASH_RESPONSE_OK;
 }
 
+// Add the time since the last power state change to the state being left
+void flash_power_account( void ){
+	portTickType now = xTaskGetTickCount();
+	
+	if(flash.poweredDown){
+		flash.power.timePoweredDown += (now - flash.powerStateSince) * portTICK_RATE_MS;
+	}else{
+		flash.power.timeActive += (now - flash.powerStateSince) * portTICK_RATE_MS;
+	}
+	
+	flash.powerStateSince = now;
+}
+
+// Requests answered from RAM, these don't need the device awake
+unsigned char flash_request_in_ram(enum tFlashCommand command){
+	
+	switch(command){
+		case(FLASH_MGR_READ_RECORDTABLE):
+		case(FLASH_MGR_RECORDTABLE_SIZE):
+		case(FLASH_MGR_READ_TELEMETRY):
+		case(FLASH_MGR_READ_CACHE_STATS):
+		case(FLASH_MGR_READ_CHECKPOINT):
+		case(FLASH_MGR_IS_FLASH_FULL):
+		case(FLASH_MGR_USED_SPACE):
+		case(FLASH_MGR_SET_TRACK):
+		case(FLASH_MGR_SET_DATESTAMP):
+			return TRUE;
+			
+		default:
+			return FALSE;
+	}
+}
+
 
 unsigned char flash_is_busy( void ){
 	union tDataflashStatus status;
@@ -708,9 +1545,382 @@ unsigned char flash_is_busy( void ){
 	}		
 }
 
+// Only used ahead of an operation, the previous one has normally finished already
+void flash_wait_ready( void ){
+	while( flash_is_busy() ){
+		vTaskDelay( (portTickType)TASK_DELAY_MS( DATAFLASH_STATUS_CHECK_TIME ) );
+	}
+}
+
+// Sleep through half of the time this operation took on average, then poll
+// RDY/BSY at an eighth of it. Sleeping only half keeps the average able to drop.
+unsigned char flash_wait_operation(enum tFlashOperation operation){
+	portTickType start = xTaskGetTickCount();
+	portTickType suspended = 0;
+	unsigned int expected = flash.busyAverage[operation] >> DATAFLASH_BUSY_AVERAGE_SHIFT;
+	unsigned int pollTime = expected >> 3;
+	unsigned int elapsed;
+	
+	if(pollTime < DATAFLASH_STATUS_CHECK_TIME){
+		pollTime = DATAFLASH_STATUS_CHECK_TIME;
+	}
+	
+	if(expected >= 2){
+		suspended += flash_wait_sleep(expected >> 1);
+	}
+	
+	while( flash_is_busy() ){
+		suspended += flash_wait_sleep(pollTime);
+	}
+	
+	// Time spent suspended is not part of the operation
+	elapsed = (xTaskGetTickCount() - start - suspended) * portTICK_RATE_MS;
+	flash.busyAverage[operation] = flash.busyAverage[operation] - (flash.busyAverage[operation] >> 2) + ((elapsed << DATAFLASH_BUSY_AVERAGE_SHIFT) >> 2);
+	
+	if(flash_operation_failed()){
+		flash_stats_record(operation, elapsed, TRUE);
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+	
+	flash_stats_record(operation, elapsed, FALSE);
+	
+	return DATAFLASH_RESPONSE_OK;
+}
+
+void flash_stats_record(enum tFlashOperation operation, unsigned int elapsed, unsigned char failed){
+	struct tFlashOpStats *stats = &flash.opStats[operation];
+	unsigned char bucket = 0;
+	
+	stats->count++;
+	stats->busyTime += elapsed;
+	
+	if(failed){
+		stats->failures++;
+	}
+	
+	while( elapsed && (bucket < (FLASH_LATENCY_BUCKETS - 1)) ){
+		elapsed >>= 1;
+		bucket++;
+	}
+	
+	if(stats->histogram[bucket] < 0xFFFF){
+		stats->histogram[bucket]++;
+	}
+}
+
+// Charge erased sectors to the region they belong to
+void flash_wear_count(unsigned long address, unsigned long sectors){
+	
+	if(address < flash.layout.journalStart){
+		flash.wear.partition += sectors;
+	}else if(address <= flash.layout.journalEnd){
+		flash.wear.journal += sectors;
+	}else{
+		flash.wear.recordData += sectors;
+	}
+	
+	if( (flash.wearUnsaved + sectors) < 0xFFFF ){
+		flash.wearUnsaved += sectors;
+	}else{
+		flash.wearUnsaved = 0xFFFF;
+	}
+}
+
+void flash_wear_load( void ){
+	
+	if( journal_read(JOURNAL_TYPE_WEAR, 0, (unsigned char *)&flash.wear, sizeof(flash.wear)) == DATAFLASH_RESPONSE_FAILURE ){
+		memset(&flash.wear, 0, sizeof(flash.wear));
+	}
+	
+	flash.wearUnsaved = 0;
+}
+
+// Never called from inside an erase, a journal write may erase a journal sector itself
+unsigned char flash_wear_save( void ){
+	
+	flash.wearUnsaved = 0;
+	
+	return journal_write(JOURNAL_TYPE_WEAR, 0, (unsigned char *)&flash.wear, sizeof(flash.wear));
+}
+
+unsigned char flash_in_record_log(unsigned long address){
+	return (flash.layout.recordDataEnd != 0) && (address >= flash.layout.recordDataStart) && (address <= flash.layout.recordDataEnd);
+}
+
+// Physical address of a record log address, most parts never retire a sector
+unsigned long flash_remap(unsigned long address){
+	unsigned short sector;
+	unsigned char i;
+	
+	if(flash.badMap.count == 0){
+		return address;
+	}
+	
+	sector = address / FLASH_4KB;
+	
+	for(i = 0; i < flash.badMap.count; i++){
+		if(flash.badMap.remap[i].logical == sector){
+			return ((unsigned long)flash.badMap.remap[i].physical * FLASH_4KB) + (address & (FLASH_4KB - 1));
+		}
+	}
+	
+	return address;
+}
+
+// Spares are handed out in order from the end of the record log, a spare that fails is never reused
+unsigned long flash_take_spare( void ){
+	unsigned long spare = flash.layout.recordDataEnd + 1 + ((unsigned long)flash.badMap.sparesUsed * FLASH_4KB);
+	
+	if( (spare > flash.layout.partEnd) || (flash.badMap.sparesUsed == 0xFF) ){
+		return FLASH_NO_SPARE;
+	}
+	
+	flash.badMap.sparesUsed++;
+	
+	return spare;
+}
+
+// Move the record log sector holding address to a fresh spare. Pages ahead of address are
+// copied over so the data already logged in the sector survives. Leaves the spare erased
+// from address on and the map saved to the journal.
+unsigned char flash_retire_sector(unsigned long address){
+	unsigned long logical = address & ~(FLASH_4KB - 1);
+	unsigned long from = flash_remap(logical);
+	unsigned long copyEnd = address & ~(FLASH_PAGE_SIZE - 1);
+	unsigned long spare, offset;
+	unsigned char page[FLASH_PAGE_SIZE];
+	unsigned char i, copied;
+	
+	for(i = 0; i < flash.badMap.count; i++){
+		if(flash.badMap.remap[i].logical == (logical / FLASH_4KB)) break;
+	}
+	
+	if(i == FLASH_REMAP_MAX){
+		debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Bad sector map full");
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+	
+	do{
+		spare = flash_take_spare();
+		if(spare == FLASH_NO_SPARE){
+			debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "No spare sector left");
+			return DATAFLASH_RESPONSE_FAILURE;
+		}
+		
+		copied = (flash_erase(FLASH_CMD_BLOCK_ERASE_4KB, spare) == DATAFLASH_RESPONSE_OK);
+		
+		for(offset = 0; copied && ((logical + offset) < copyEnd); offset += FLASH_PAGE_SIZE){
+			flash_read_array(from + offset, FLASH_PAGE_SIZE, page);
+			copied = (flash_program(spare + offset, FLASH_PAGE_SIZE, page) == DATAFLASH_RESPONSE_OK);
+		}
+	}while( !copied );
+	
+	flash.badMap.remap[i].logical = logical / FLASH_4KB;
+	flash.badMap.remap[i].physical = spare / FLASH_4KB;
+	if(i == flash.badMap.count){
+		flash.badMap.count++;
+	}
+	
+	debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Retired bad sector");
+	
+	return flash_badmap_save();
+}
+
+void flash_badmap_load( void ){
+	
+	if( (journal_read(JOURNAL_TYPE_BADMAP, 0, (unsigned char *)&flash.badMap, sizeof(flash.badMap)) == DATAFLASH_RESPONSE_FAILURE) ||
+		(flash.badMap.count > FLASH_REMAP_MAX) ){
+		memset(&flash.badMap, 0, sizeof(flash.badMap));
+		return;
+	}
+	
+	flash_badmap_prune();
+}
+
+// Entries that don't point from the record log into the spares of the mounted layout are dropped
+void flash_badmap_prune( void ){
+	unsigned char i, kept = 0;
+	
+	for(i = 0; i < flash.badMap.count; i++){
+		if( flash_in_record_log((unsigned long)flash.badMap.remap[i].logical * FLASH_4KB) &&
+			(((unsigned long)flash.badMap.remap[i].physical * FLASH_4KB) > flash.layout.recordDataEnd) &&
+			(((unsigned long)flash.badMap.remap[i].physical * FLASH_4KB) < flash.layout.partEnd) ){
+			flash.badMap.remap[kept++] = flash.badMap.remap[i];
+		}
+	}
+	
+	if(kept != flash.badMap.count){
+		debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Dropped stale bad sector entries");
+		flash.badMap.count = kept;
+		
+		// Spares of another layout say nothing about this one
+		if(kept == 0){
+			flash.badMap.sparesUsed = 0;
+		}
+	}
+}
+
+// Flushed straight away, the remapped sector is in use as soon as this returns
+unsigned char flash_badmap_save( void ){
+	
+	if( journal_write(JOURNAL_TYPE_BADMAP, 0, (unsigned char *)&flash.badMap, sizeof(flash.badMap)) == DATAFLASH_RESPONSE_FAILURE ){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+	
+	return journal_flush();
+}
+
+// Sleep while an operation runs. During a suspendable erase wake up every few
+// milliseconds to let queued reads in. Returns the ticks spent suspended.
+// Page programs are never suspended: one takes DATAFLASH_PROGRAM_TIME, less than
+// DATAFLASH_SUSPEND_CHECK_TIME, so it's done before a queued read would be looked at.
+portTickType flash_wait_sleep(unsigned int time){
+	portTickType suspended = 0;
+	unsigned int step;
+	
+	if( !flash.eraseSuspendable ){
+		vTaskDelay( (portTickType)TASK_DELAY_MS( time ) );
+		return 0;
+	}
+	
+	while(time){
+		step = time;
+		if(step > DATAFLASH_SUSPEND_CHECK_TIME){
+			step = DATAFLASH_SUSPEND_CHECK_TIME;
+		}
+		
+		vTaskDelay( (portTickType)TASK_DELAY_MS( step ) );
+		time -= step;
+		
+		suspended += flash_service_reads();
+	}
+	
+	return suspended;
+}
+
+// Suspend the running erase for reads at the front of the queue. Anything else
+// keeps its place in line until the erase is done. Returns the ticks spent suspended.
+portTickType flash_service_reads( void ){
+	struct tFlashRequest pending;
+	portTickType start = 0;
+	unsigned char suspended = FALSE;
+	enum tFlashClass class;
+	
+	for(class = FLASH_CLASS_INTERACTIVE; class <= FLASH_CLASS_BULK; class++){
+		while( (xQueuePeek(flashManagerQueue[class], &pending, 0) == pdTRUE) && flash_request_suspend_safe(&pending) ){
+			if(!suspended){
+				start = xTaskGetTickCount();
+				flash_suspend();
+				suspended = TRUE;
+			}
+			
+			xQueueReceive(flashManagerQueue[class], &pending, 0);
+			
+			flash_dispatch_request(&pending);
+			flash_read_stop();
+			flash_complete_request(&pending);
+		}
+	}
+	
+	if(!suspended){
+		return 0;
+	}
+	
+	flash_resume();
+	
+	return xTaskGetTickCount() - start;
+}
+
+// Requests that can run while an erase is suspended: RAM answers and array reads outside the erasing block
+unsigned char flash_request_suspend_safe(struct tFlashRequest *request){
+	unsigned long address;
+	unsigned long length;
+	
+	if( flash_request_in_ram(request->command) ){
+		return TRUE;
+	}
+	
+	switch(request->command){
+		case(FLASH_MGR_READ_PAGE):
+			address = request->index * FLASH_PAGE_SIZE;
+			length = request->length;
+			break;
+			
+		case(FLASH_MGR_READ_RECORDATA):
+			address = session_page_address(request->index);
+			length = FLASH_PAGE_SIZE;
+			break;
+			
+		case(FLASH_MGR_READ_RANGE):
+			address = ((struct tFlashRange *)request->pointer)->address;
+			length = ((struct tFlashRange *)request->pointer)->length;
+			break;
+			
+		case(FLASH_MGR_READ_SESSION_SUMMARY):
+			address = session_summary_address(request->index);
+			length = (address == SESSION_NO_SUMMARY) ? 0 : FLASH_PAGE_SIZE;
+			break;
+			
+		default:
+			return FALSE;
+	}
+	
+	if(length == 0){
+		return TRUE;
+	}
+	
+	// Reads that cross into another sector may be split between a sector and its spare
+	if( flash.badMap.count && ((address & ~(FLASH_4KB - 1)) != ((address + length - 1) & ~(FLASH_4KB - 1))) ){
+		return FALSE;
+	}
+	
+	address = flash_remap(address);
+	
+	// The block being erased reads back undefined while suspended
+	return (address > flash.eraseEnd) || ((address + length - 1) < flash.eraseStart);
+}
+
+void flash_suspend( void ){
+	flash_select();
+	spi_write(FLASH_SPI, flash.part.suspendCommand);
+	spi_unselectChip(FLASH_SPI, FLASH_SPI_NPCS);
+	
+	// Takes effect within tens of microseconds
+	while( flash_is_busy() );
+}
+
+void flash_resume( void ){
+	flash_select();
+	spi_write(FLASH_SPI, flash.part.resumeCommand);
+	spi_unselectChip(FLASH_SPI, FLASH_SPI_NPCS);
+}
+
+// Sleep until the PDCA channel is done, the transfer complete interrupt gives the semaphore
+void flash_pdca_wait(unsigned int channel){
+	
+	if( xTaskGetSchedulerState() == taskSCHEDULER_RUNNING ){
+		pdca_enable_interrupt_transfer_complete(channel);
+		
+		while( !(pdca_get_transfer_status(channel) & PDCA_TRANSFER_COMPLETE) ){
+			xSemaphoreTake(flashPdcaSemaphore, (portTickType)TASK_DELAY_MS( DATAFLASH_PDCA_CHECK_TIME ));
+		}
+		
+		pdca_disable_interrupt_transfer_complete(channel);
+	}else{
+		while( !(pdca_get_transfer_status(channel) & PDCA_TRANSFER_COMPLETE) ){
+			asm("nop");
+		}
+	}
+}
+
 unsigned char flash_operation_failed( void ){
 	union tDataflashStatus status;
 	
+	// Only the AT25DF report failures in the status register
+	if( !flash_is_at25df() ){
+		return FALSE;
+	}
+	
 	status = flash_readStatus();
 	
 	return status.registers.EPE;
@@ -752,16 +1962,46 @@ unsigned char flash_send_request(unsigned char command, unsigned char *pointer,
 	request.length = length;
 	request.index = index;
 	request.resume = resume;
+	request.callback = NULL;
 	
 	if(resume == TRUE){
 		request.handle = xTaskGetCurrentTaskHandle();
 	}
 	
-	success = xQueueSend(flashManagerQueue, &request, delay);
+	success = flash_queue_request(&request, delay);
 	
 	if( (success == TRUE) && (resume == TRUE) ){
 		vTaskSuspend(NULL);
 	}
 	
 	return success;
+}
+
+// Queue a request without waiting for it. The flash task calls back with the
+// pointer once it is done with it, so the caller can reuse the buffer.
+unsigned char flash_send_request_async(unsigned char command, unsigned char *pointer, unsigned short length, unsigned int index, void (*callback)(unsigned char *pointer), unsigned char delay){
+	struct tFlashRequest request;
+	
+	request.command = command;
+	request.pointer = pointer;
+	request.length = length;
+	request.index = index;
+	request.resume = FALSE;
+	request.callback = callback;
+	
+	return flash_queue_request(&request, delay);
+}
+
+// Put a request in the queue of its class and wake the flash task
+unsigned char flash_queue_request(struct tFlashRequest *request, unsigned char delay){
+	
+	request->queued = xTaskGetTickCount();
+	
+	if( xQueueSend(flashManagerQueue[flash_request_class(request->command)], request, delay) != pdTRUE ){
+		return FALSE;
+	}
+	
+	xSemaphoreGive(flashManagerDoorbell);
+	
+	return TRUE;
 }
\ No newline at end of file
@@ -33,7 +33,7 @@
 
 #include "hal.h"
 
-#define FLASH_VERSION					"1.20"
+#define FLASH_VERSION					"1.30"
 
 #define flash_clr_wp()					gpio_set_gpio_pin(DATAFLASH_WP)
 #define flash_set_wp()					gpio_clr_gpio_pin(DATAFLASH_WP)
@@ -49,19 +49,28 @@
 #define flash_clr_full_flag()			flash.flags.isFull = FALSE
 #define flash_full_flag()				flash.flags.isFull
 
+#define flash_is_at25df()				((flash.device == ATMEL_AT25DF161) || (flash.device == ATMEL_AT25DF321))
+
 // Device IDs for AT25DF321
 #define FLASH_ATMEL_AT25DF321_MAN_ID		0x1F
 #define FLASH_ATMEL_AT25DF321_ID0			0x47
 #define FLASH_ATMEL_AT25DF321_ID1			0x01
+#define FLASH_ATMEL_AT25DF321_MAX_CLOCK		66000000	// Fast read limit
 
 // Device IDs for AT25DF161
 #define FLASH_ATMEL_AT25DF161_MAN_ID		0x1F
 #define FLASH_ATMEL_AT25DF161_ID0			0x46
 #define FLASH_ATMEL_AT25DF161_ID1			0x02
+#define FLASH_ATMEL_AT25DF161_MAX_CLOCK		85000000	// Fast read limit
+
+// Other parts are described by their SFDP tables or their family defaults
+#define FLASH_GENERIC_MAX_CLOCK				50000000	// Fast read limit every SFDP era part meets
+#define FLASH_GENERIC_MIN_SIZE				0x00200000	// Smaller parts don't fit the default layout
 
 
 // Read Commands
 #define DATAFLASH_CMD_READ_ARRAY			0x03	// Up to 50MHz operation
+#define DATAFLASH_CMD_READ_ARRAY_FAST		0x0B	// Up to 85MHz operation, one dummy byte after the address
 
 // Program and Erase Commands
 #define FLASH_CMD_BLOCK_ERASE_4KB			0x20
@@ -102,6 +111,8 @@
 #define DATAFLASH_CMD_DUMMY					0xFF
 #define DATAFLASH_OTP_RESERVED				0xAA
 
+#define DATAFLASH_SPI_MAX_DIVISOR			255		// Largest SCBR value
+
 #define DATAFLASH_SECTOR_PROTECTED			1	// Sector is protected and cannot be programmed or erased. This is the default state
 #define DATAFLASH_SECTOR_UNPROTECTED		0	// Sector is unprotected and can be programmed and erased
 
@@ -172,12 +183,31 @@
 
 #define FLASH_4KB							4096	// Number of bytes in 4KB
 #define DATAFLASH_32KB						32768	// Number of bytes in 32KB
+#define DATAFLASH_64KB						65536	// Number of bytes in 64KB
+
+
+#define DATAFLASH_PDCA_CHECK_TIME			5	// Time in milliseconds to wait for the PDCA interrupt before checking status again
+#define DATAFLASH_STATUS_CHECK_TIME			1	// Time in milliseconds to suspend task before checking status register again
+#define DATAFLASH_SUSPEND_CHECK_TIME		5	// Time in milliseconds between checks for reads that may suspend an erase
+#define DATAFLASH_POWERDOWN_IDLE_TIME		20	// Time in milliseconds without requests before entering deep power-down
+#define DATAFLASH_WAKEUP_TIME				30	// Time in microseconds from resume to the first command
+#define DATAFLASH_PREERASE_IDLE_TIME		50	// Time in milliseconds without requests before erasing ahead of the write pointer
 
+#define FLASH_LATENCY_BUCKETS				14	// Bucket 0 is under 1ms, bucket n holds 2^(n-1) up to 2^n ms, the last one is open ended
+#define FLASH_WEAR_SAVE_INTERVAL			16	// Sector erases between saving the erase counters
+#define FLASH_CACHE_PAGES					4	// Pages of metadata kept in RAM, the least recently used one is replaced
+#define FLASH_CACHE_EMPTY					0xFFFFFFFF
+#define FLASH_VERIFY_CHUNK					32	// Bytes read back at a time when verifying a record log program
+#define FLASH_NO_SPARE						0xFFFFFFFF
 
-#define DATAFLASH_PDCA_CHECK_TIME			5	// Time in milliseconds to suspend task before checking PDCA status again
-#define DATAFLASH_STATUS_CHECK_TIME			10	// Time in milliseconds to suspend task before checking status register again
-#define DATAFLASH_PROGRAM_TIME				2
-#define DATAFLASH_ERASE_TIME				20
+// Typical busy times from the AT25DF161/321 datasheets, starting point for the busy time averages
+#define DATAFLASH_PROGRAM_TIME				1
+#define DATAFLASH_ERASE_4KB_TIME			50
+#define DATAFLASH_ERASE_32KB_TIME			250
+#define DATAFLASH_ERASE_64KB_TIME			400
+#define DATAFLASH_CHIP_ERASE_TIME			16000
+
+#define DATAFLASH_BUSY_AVERAGE_SHIFT		3	// Busy time averages are kept in 1/8 ms
 
 struct tDataflashStatusRegisters{
 	unsigned SPRL	: 1;		// Sector Protection Registers Locked
@@ -210,39 +240,142 @@ struct tFlashFlags {
 enum tFlashDevice {
 	ATMEL_AT25DF161,
 	ATMEL_AT25DF321,
+	GENERIC_DEVICE,						// Any other part with usable SFDP tables or a known family
 	UNKNOWN_DEVICE
 };
 
 struct tFlashLayout {
-	unsigned int userPrefsStart;
-	unsigned int userPrefsEnd;
-	
-	unsigned int trackListStart;
-	unsigned int trackListEnd;
-	
-	unsigned int recordTableStart;
-	unsigned int recordTableEnd;
+	unsigned int journalStart;
+	unsigned int journalEnd;
 	
 	unsigned int recordDataStart;
 	unsigned int recordDataEnd;
+	unsigned int partEnd;				// Last byte of the part, sectors past recordDataEnd are spares
+	
+	unsigned short sessionSlots;
+	unsigned short trackSlots;
+	unsigned char formatPending;		// No partition table on the part yet, write this layout out
+};
+
+enum tFlashOperation {
+	FLASH_OP_PROGRAM,
+	FLASH_OP_ERASE_4KB,
+	FLASH_OP_ERASE_32KB,
+	FLASH_OP_ERASE_64KB,
+	FLASH_OP_CHIP_ERASE,
+	FLASH_OP_READ,
+	FLASH_OP_COUNT
+};
+
+struct tFlashOpStats {
+	unsigned int count;							// Operations issued, erases of each block size count separately
+	unsigned int busyTime;						// Milliseconds the part reported busy or reads spent clocking, suspended time excluded
+	unsigned int failures;						// Programs and erases the part flagged with EPE
+	unsigned short histogram[FLASH_LATENCY_BUCKETS];	// Operations by duration, saturates at 0xFFFF
+};
+
+// Snapshot handed to the host
+struct tFlashTelemetry {
+	struct tFlashWear wear;
+	struct tFlashOpStats opStats[FLASH_OP_COUNT];
+	unsigned char remapped;						// Record log sectors served from a spare
+	unsigned char sparesUsed;
+	unsigned short sparesTotal;
+};
+
+struct tFlashSpiStats {
+	unsigned int commands;						// Chip select assertions
+	unsigned int bytesRead;						// Array data clocked in
+	unsigned int bytesWritten;					// Page data clocked out
+};
+
+struct tFlashPowerStats {
+	unsigned int wakeups;						// Exits from deep power-down, each costs DATAFLASH_WAKEUP_TIME
+	unsigned int timeActive;					// Milliseconds spent in standby or active
+	unsigned int timePoweredDown;				// Milliseconds spent in deep power-down
+};
+
+struct tFlashCacheLine {
+	unsigned long address;						// Page held, FLASH_CACHE_EMPTY if none
+	unsigned int lastUsed;						// Cache clock at the last read of the page
+	unsigned char data[FLASH_PAGE_SIZE];
+};
+
+struct tFlashCacheStats {
+	unsigned int hits;							// Pages read from RAM
+	unsigned int misses;						// Pages read from the part into the cache
 };
 
 struct tFlash {
 	enum tFlashDevice device;
+	struct tFlashPart part;						// Size, opcodes and typical times of the detected part
 	union tDataflashStatus status;
 	struct tFlashFlags flags;
 	struct tFlashLayout layout;
+	unsigned int busyAverage[FLASH_OP_COUNT];	// Running average of the busy time of each operation
+	struct tFlashOpStats opStats[FLASH_OP_COUNT];
+	struct tFlashSpiStats spiStats;
+	
+	struct tFlashWear wear;						// Persisted in the journal every FLASH_WEAR_SAVE_INTERVAL sector erases
+	unsigned short wearUnsaved;					// Sector erases since the counters were last saved
+	
+	struct tFlashBadMap badMap;					// Persisted in the journal whenever a sector is retired
+	
+	unsigned int spiClock;						// SCK frequency currently programmed for the dataflash
+	unsigned char readCommand;					// Array read opcode used for the detected part
+	unsigned char readDummyBytes;				// Dummy bytes the read opcode needs after the address
+	
+	unsigned char readStream;					// Array read still open with chip select asserted
+	unsigned long readStreamAddress;			// Address the open array read will return next
+	
+	struct tFlashClassStats classStats[FLASH_CLASS_COUNT];	// Queue latency per request class
+	unsigned char classSkipped[FLASH_CLASS_COUNT];			// Times each waiting class was passed over in a row
+	
+	unsigned char poweredDown;					// Device is in deep power-down
+	portTickType powerStateSince;				// Tick count of the last power state change
+	struct tFlashPowerStats power;
+	
+	unsigned char eraseSuspendable;				// A block erase is running that reads may suspend
+	unsigned long eraseStart;					// Block the running erase covers
+	unsigned long eraseEnd;
+	
+	struct tFlashCacheLine cache[FLASH_CACHE_PAGES];	// Partition table, journal and summary pages
+	unsigned int cacheClock;
+	struct tFlashCacheStats cacheStats;
+};
+
+struct tFlashRange {
+	unsigned long address;						// Start of the range
+	unsigned long length;						// Total bytes to read
+	unsigned char *buffer;						// First chunk buffer
+	unsigned short chunkLength;					// Bytes delivered per chunk
+	unsigned char *(*chunk)(unsigned char *buffer, unsigned short length);	// Runs in the flash task, returns the next buffer or NULL to stop. Must not make flash requests
 };
 
 void flash_task_init( void );
 void flash_task( void *pvParameters );
 enum tFlashDevice  flash_initDevice( void );
+void flash_at25df_part(unsigned long size);
+unsigned char flash_probe_part(unsigned char manufacturer, unsigned char capacity);
+void flash_read_sfdp(unsigned long address, unsigned char length, unsigned char *bufferPointer);
+void flash_default_layout( void );
+unsigned char flash_load_partitions( void );
+unsigned char flash_partition_valid(struct tFlashPartitionTable *table);
+unsigned char flash_write_partitions( void );
+void flash_migrate_v130( void );
+unsigned short flash_partition_crc(struct tFlashPartitionTable *table);
+void flash_setupSpi(unsigned int maxClock);
 union tDataflashStatus flash_readStatus( void );
 unsigned char flash_GlobalUnprotect( void );
 unsigned char flash_WriteEnable( void );
 unsigned char flash_WriteDisable( void );
-unsigned char flash_UpdateSector(unsigned long startAddress, unsigned short length, unsigned char *bufferPointer);
 unsigned char flash_ReadToBuffer(unsigned long startAddress, unsigned short length, unsigned char *bufferPointer);
+unsigned char flash_read_array(unsigned long startAddress, unsigned short length, unsigned char *bufferPointer);
+unsigned char flash_cache_read(unsigned long startAddress, unsigned short length, unsigned char *bufferPointer);
+void flash_cache_invalidate(unsigned long startAddress, unsigned long endAddress);
+unsigned char flash_ReadRange(struct tFlashRange *range);
+void flash_select( void );
+void flash_read_stop( void );
 unsigned char flash_WriteFromBuffer(unsigned long startAddress, unsigned short length, unsigned char *bufferPointer);
 unsigned char flash_ReadOTP(unsigned char startAddress, unsigned char length, unsigned char *bufferPointer);
 unsigned char flash_WriteOTP(unsigned char startAddress, unsigned char length, unsigned char *bufferPointer);
@@ -250,12 +383,46 @@ unsigned char flash_eraseBlock(unsigned char blockSize, unsigned long startAddre
 unsigned char flash_chipErase( void );
 unsigned char flash_powerDown( void );
 unsigned char flash_wakeUp( void );
+void flash_power_account( void );
+unsigned char flash_request_in_ram(enum tFlashCommand command);
 unsigned char flash_is_busy( void );
+void flash_wait_ready( void );
+unsigned char flash_wait_operation(enum tFlashOperation operation);
+void flash_pdca_wait(unsigned int channel);
+portTickType flash_wait_sleep(unsigned int time);
+portTickType flash_service_reads( void );
+unsigned char flash_request_suspend_safe(struct tFlashRequest *request);
+void flash_suspend( void );
+void flash_resume( void );
+enum tFlashClass flash_request_class(enum tFlashCommand command);
+unsigned char flash_queue_request(struct tFlashRequest *request, unsigned char delay);
+unsigned char flash_next_request(struct tFlashRequest *request);
+void flash_dispatch_request(struct tFlashRequest *request);
+void flash_complete_request(struct tFlashRequest *request);
 unsigned short flash_calculate_otp_crc( void );
 unsigned short flash_calculate_userPrefs_crc( void );
 unsigned char flash_send_request(unsigned char command, unsigned char *pointer, unsigned short length, unsigned int index, unsigned char resume, unsigned char delay);
+unsigned char flash_send_request_async(unsigned char command, unsigned char *pointer, unsigned short length, unsigned int index, void (*callback)(unsigned char *pointer), unsigned char delay);
 unsigned char flash_eraseRecordedData( void );
+unsigned char flash_eraseRange(unsigned long startAddress, unsigned long endAddress);
 unsigned char flash_operation_failed( void );
+void flash_stats_record(enum tFlashOperation operation, unsigned int elapsed, unsigned char failed);
+void flash_wear_count(unsigned long address, unsigned long sectors);
+void flash_wear_load( void );
+unsigned char flash_wear_save( void );
 unsigned char flash_eraseTracks( void );
+unsigned char flash_program(unsigned long startAddress, unsigned short length, unsigned char *bufferPointer);
+unsigned char flash_erase(unsigned char blockSize, unsigned long startAddress);
+enum tFlashEraseSize flash_erase_size(unsigned char blockSize);
+unsigned char flash_program_verified(unsigned long startAddress, unsigned short length, unsigned char *bufferPointer);
+unsigned char flash_verify(unsigned long startAddress, unsigned short length, unsigned char *bufferPointer);
+unsigned char flash_read_mapped(unsigned long startAddress, unsigned short length, unsigned char *bufferPointer);
+unsigned char flash_in_record_log(unsigned long address);
+unsigned long flash_remap(unsigned long address);
+unsigned long flash_take_spare( void );
+unsigned char flash_retire_sector(unsigned long address);
+void flash_badmap_load( void );
+void flash_badmap_prune( void );
+unsigned char flash_badmap_save( void );
 
 #endif /* DATAFLASH_H_ */
\ No newline at end of file
@@ -0,0 +1,176 @@
+/******************************************************************************
+ *
+ * Record Data Codec
+ *
+ * - Compiler:          GNU GCC for AVR32
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+
+#include "string.h"
+#include "flash_codec.h"
+
+
+unsigned char codec_put_varint(unsigned char *buffer, unsigned int value){
+	unsigned char length = 0;
+
+	while(value >= 0x80){
+		buffer[length++] = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+	buffer[length++] = value;
+
+	return length;
+}
+
+
+// Returns the bytes used, 0 if the varint runs past space
+unsigned char codec_get_varint(unsigned char *buffer, unsigned short space, unsigned int *value){
+	unsigned char length = 0;
+
+	*value = 0;
+
+	while( (length < space) && (length < CODEC_VARINT_MAX) ){
+		*value |= (unsigned int)(buffer[length] & 0x7F) << (7 * length);
+
+		if( !(buffer[length++] & 0x80) ){
+			return length;
+		}
+	}
+
+	return 0;
+}
+
+
+// Returns the bytes written, never more than CODEC_DELTA_MAX
+unsigned char codec_delta_encode(struct tRecordData *previous, struct tRecordData *sample, unsigned char *buffer){
+	unsigned char length = 0;
+
+	// Differences wrap like the fields do, so every pair of samples has one
+	length += codec_put_varint(&buffer[length], codec_zigzag((signed int)((unsigned int)sample->latitude - (unsigned int)previous->latitude)));
+	length += codec_put_varint(&buffer[length], codec_zigzag((signed int)((unsigned int)sample->longitude - (unsigned int)previous->longitude)));
+	length += codec_put_varint(&buffer[length], codec_zigzag((signed short)(sample->altitude - previous->altitude)));
+	length += codec_put_varint(&buffer[length], (codec_zigzag((signed short)(sample->speed - previous->speed)) << 1) | (sample->lapDetected ? 1 : 0));
+	length += codec_put_varint(&buffer[length], codec_zigzag((signed short)(sample->heading - previous->heading)));
+
+	return length;
+}
+
+
+// Returns the bytes used, 0 if the delta is cut short
+unsigned char codec_delta_decode(struct tRecordData *previous, unsigned char *buffer, unsigned short space, struct tRecordData *sample){
+	unsigned int value[5];
+	unsigned char length = 0;
+	unsigned char used;
+	unsigned char i;
+
+	for(i = 0; i < 5; i++){
+		used = codec_get_varint(&buffer[length], space - length, &value[i]);
+		if(used == 0){
+			return 0;
+		}
+		length += used;
+	}
+
+	sample->latitude = (signed int)((unsigned int)previous->latitude + (unsigned int)codec_unzigzag(value[0]));
+	sample->longitude = (signed int)((unsigned int)previous->longitude + (unsigned int)codec_unzigzag(value[1]));
+	sample->altitude = previous->altitude + codec_unzigzag(value[2]);
+	sample->lapDetected = value[3] & 1;
+	sample->reserved = previous->reserved;
+	sample->speed = previous->speed + codec_unzigzag(value[3] >> 1);
+	sample->heading = previous->heading + codec_unzigzag(value[4]);
+
+	return length;
+}
+
+
+// The header fields past the sample counts are left to the caller
+void codec_page_start(struct tRecordPackedPage *page, unsigned int firstSample){
+	page->pageType = RECORD_PAGE_PACKED;
+	page->sampleCount = 0;
+	page->firstSample = firstSample;
+	page->deltaLength = 0;
+	page->reserved = 0xFFFF;
+	memset(page->delta, 0xFF, sizeof(page->delta));
+}
+
+
+// Appends a sample, 0 once the page has no room for it. previous is the
+// last sample added and is not used for the first sample of a page.
+unsigned char codec_page_add(struct tRecordPackedPage *page, struct tRecordData *previous, struct tRecordData *sample){
+	unsigned char delta[CODEC_DELTA_MAX];
+	unsigned char length;
+
+	if(page->sampleCount == 0){
+		page->keyframe = *sample;
+		page->sampleCount = 1;
+		return 1;
+	}
+
+	if(page->sampleCount == 0xFF){
+		return 0;
+	}
+
+	length = codec_delta_encode(previous, sample, delta);
+
+	if( (page->deltaLength + length) > RECORD_PACKED_DELTA_SIZE ){
+		return 0;
+	}
+
+	memcpy(&page->delta[page->deltaLength], delta, length);
+	page->deltaLength += length;
+	page->sampleCount++;
+
+	return 1;
+}
+
+
+// Decodes count samples starting with sample number first of the page,
+// returns how many there were
+unsigned char codec_page_expand(struct tRecordPackedPage *page, unsigned char first, unsigned char count, struct tRecordData *samples){
+	struct tRecordData current = page->keyframe;
+	unsigned short offset = 0;
+	unsigned short space = (page->deltaLength < RECORD_PACKED_DELTA_SIZE) ? page->deltaLength : RECORD_PACKED_DELTA_SIZE;
+	unsigned char used;
+	unsigned char index = 0;
+	unsigned char stored = 0;
+
+	while( (index < page->sampleCount) && (stored < count) ){
+		if(index > 0){
+			used = codec_delta_decode(&current, &page->delta[offset], space - offset, &current);
+			if(used == 0){
+				break;
+			}
+			offset += used;
+		}
+
+		if(index >= first){
+			samples[stored++] = current;
+		}
+
+		index++;
+	}
+
+	return stored;
+}
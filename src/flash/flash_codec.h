@@ -0,0 +1,55 @@
+/******************************************************************************
+ *
+ * Record Data Codec Include
+ *
+ * - Compiler:          GNU GCC for AVR32
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+
+
+#ifndef FLASH_CODEC_H_
+#define FLASH_CODEC_H_
+
+// Only depends on the page layout, so host software can build it as it is
+#include "flash_layout.h"
+
+// A delta is five varints: latitude, longitude, altitude, speed with the lap
+// flag in its lowest bit, and heading. Each is the zig-zag mapped difference to
+// the previous sample, 7 bits per byte with the top bit set on all but the last byte.
+#define CODEC_VARINT_MAX			5			// Bytes for a full 32 bit value
+#define CODEC_DELTA_MAX				19			// Bytes for the worst case sample
+
+#define codec_zigzag(value)			(((unsigned int)(value) << 1) ^ (unsigned int)((signed int)(value) >> 31))
+#define codec_unzigzag(value)		((signed int)(((unsigned int)(value) >> 1) ^ (0 - ((unsigned int)(value) & 1))))
+
+unsigned char codec_put_varint(unsigned char *buffer, unsigned int value);
+unsigned char codec_get_varint(unsigned char *buffer, unsigned short space, unsigned int *value);
+unsigned char codec_delta_encode(struct tRecordData *previous, struct tRecordData *sample, unsigned char *buffer);
+unsigned char codec_delta_decode(struct tRecordData *previous, unsigned char *buffer, unsigned short space, struct tRecordData *sample);
+void codec_page_start(struct tRecordPackedPage *page, unsigned int firstSample);
+unsigned char codec_page_add(struct tRecordPackedPage *page, struct tRecordData *previous, struct tRecordData *sample);
+unsigned char codec_page_expand(struct tRecordPackedPage *page, unsigned char first, unsigned char count, struct tRecordData *samples);
+
+#endif /* FLASH_CODEC_H_ */
@@ -0,0 +1,570 @@
+/******************************************************************************
+ *
+ * Metadata Journal
+ *
+ * - Compiler:          GNU GCC for AVR32
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+#include <asf.h>
+#include "hal.h"
+#include "string.h"
+
+extern struct tFlash flash;
+
+//--------------------------
+// Structs
+//--------------------------
+struct tJournal journal;
+
+//--------------------------
+// Buffers
+//--------------------------
+unsigned char journalWindow[FLASH_PAGE_SIZE];		// Page currently cached while walking a sector
+unsigned long journalWindowAddress = JOURNAL_WINDOW_INVALID;
+unsigned char journalStage[FLASH_PAGE_SIZE];		// Entries waiting to be programmed together
+unsigned long journalStageAddress = JOURNAL_WINDOW_INVALID;
+unsigned short journalStageStart;					// First staged byte not programmed yet
+unsigned short journalStageEnd;						// One past the last staged byte
+unsigned char journalEntry[sizeof(struct tJournalEntryHeader) + JOURNAL_ENTRY_MAX_LENGTH];
+
+
+// Walk the journal sectors from oldest to newest and rebuild the location table.
+// Only reads the flash, so this is safe to call before the scheduler is running.
+unsigned char journal_mount( void ){
+	struct tJournalSectorHeader sectorHeader;
+	unsigned char order[JOURNAL_MAX_SECTORS];
+	unsigned char inUse = 0;
+	unsigned char sector, i, j;
+	unsigned short key;
+
+	journal.sectorCount = (flash.layout.journalEnd - flash.layout.journalStart + 1) / FLASH_4KB;
+	if(journal.sectorCount > JOURNAL_MAX_SECTORS){
+		journal.sectorCount = JOURNAL_MAX_SECTORS;
+	}
+
+	journal.sequence = 0;
+	journalWindowAddress = JOURNAL_WINDOW_INVALID;
+	journalStageAddress = JOURNAL_WINDOW_INVALID;
+
+	for(key = 0; key < JOURNAL_KEY_TOTAL; key++){
+		journal.location[key] = JOURNAL_LOCATION_EMPTY;
+	}
+
+	if(journal.sectorCount < 2){
+		journal.sectorCount = 0;
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	// Sort the sectors that carry a header by sequence number
+	for(sector = 0; sector < journal.sectorCount; sector++){
+		journal_window_read(journal_sector_address(sector), sizeof(sectorHeader), (unsigned char *)&sectorHeader);
+
+		if(sectorHeader.magic == JOURNAL_SECTOR_MAGIC){
+			journal.sectorState[sector] = JOURNAL_SECTOR_IN_USE;
+			journal.sectorSequence[sector] = sectorHeader.sequence;
+
+			for(i = inUse; (i > 0) && (journal.sectorSequence[order[i-1]] > sectorHeader.sequence); i--){
+				order[i] = order[i-1];
+			}
+			order[i] = sector;
+			inUse++;
+		}else{
+			journal.sectorState[sector] = JOURNAL_SECTOR_UNKNOWN;
+			journal.sectorSequence[sector] = 0;
+		}
+	}
+
+	if(inUse == 0){
+		// Blank journal, first write will open sector 0
+		journal.activeSector = journal.sectorCount - 1;
+		journal.writeOffset = FLASH_4KB;
+		return DATAFLASH_RESPONSE_OK;
+	}
+
+	// Replay, newer entries replace older ones
+	for(j = 0; j < inUse; j++){
+		journal.writeOffset = journal_scan_sector(order[j]);
+	}
+
+	journal.activeSector = order[inUse - 1];
+	journal.sequence = journal.sectorSequence[journal.activeSector];
+
+	return DATAFLASH_RESPONSE_OK;
+}
+
+
+// Forget everything in the journal after the whole chip has been erased
+void journal_invalidate( void ){
+	unsigned char sector;
+	unsigned short key;
+
+	for(sector = 0; sector < journal.sectorCount; sector++){
+		journal.sectorState[sector] = JOURNAL_SECTOR_ERASED;
+		journal.sectorSequence[sector] = 0;
+	}
+
+	for(key = 0; key < JOURNAL_KEY_TOTAL; key++){
+		journal.location[key] = JOURNAL_LOCATION_EMPTY;
+	}
+
+	journal.activeSector = journal.sectorCount - 1;
+	journal.writeOffset = FLASH_4KB;
+	journalWindowAddress = JOURNAL_WINDOW_INVALID;
+	journalStageAddress = JOURNAL_WINDOW_INVALID;		// Whatever was staged went with the chip
+}
+
+
+// Read the newest entry for a key. Missing keys read back as erased flash (0xFF)
+unsigned char journal_read(unsigned char type, unsigned short index, unsigned char *bufferPointer, unsigned short length){
+	struct tJournalEntryHeader *header = (struct tJournalEntryHeader *)journalEntry;
+	unsigned short key = journal_key(type, index);
+	unsigned short i, stored;
+
+	if( (key == JOURNAL_KEY_INVALID) || (journal.location[key] == JOURNAL_LOCATION_EMPTY) ){
+		memset(bufferPointer, 0xFF, length);
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	stored = (length < JOURNAL_ENTRY_MAX_LENGTH) ? length : JOURNAL_ENTRY_MAX_LENGTH;
+	journal_flush_range(flash.layout.journalStart + journal.location[key], sizeof(struct tJournalEntryHeader) + stored);
+	flash_ReadToBuffer(flash.layout.journalStart + journal.location[key], sizeof(struct tJournalEntryHeader) + stored, journalEntry);
+
+	if(header->length < stored){
+		stored = header->length;
+	}
+
+	for(i = 0; i < length; i++){
+		bufferPointer[i] = (i < stored) ? journalEntry[sizeof(struct tJournalEntryHeader) + i] : 0xFF;
+	}
+
+	return DATAFLASH_RESPONSE_OK;
+}
+
+
+// Append a new version of a key. Costs one or two page programs instead of a sector rewrite
+unsigned char journal_write(unsigned char type, unsigned short index, unsigned char *bufferPointer, unsigned char length){
+	struct tJournalEntryHeader *header = (struct tJournalEntryHeader *)journalEntry;
+	unsigned char oldest;
+
+	if( (journal.sectorCount == 0) || (journal_key(type, index) == JOURNAL_KEY_INVALID) ){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	// Finish a compaction that was interrupted by a power loss
+	oldest = (journal.activeSector + 1) % journal.sectorCount;
+	if( (journal.sectorState[oldest] == JOURNAL_SECTOR_IN_USE) && (journal_compact_sector(oldest) == DATAFLASH_RESPONSE_FAILURE) ){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	// Make room first, compaction uses the entry buffer
+	while( (journal.writeOffset + sizeof(struct tJournalEntryHeader) + length) > FLASH_4KB ){
+		if( journal_next_sector() == DATAFLASH_RESPONSE_FAILURE ){
+			return DATAFLASH_RESPONSE_FAILURE;
+		}
+	}
+
+	header->type = type;
+	header->length = length;
+	header->index = index;
+	header->reserved = 0xFFFF;
+	memcpy(&journalEntry[sizeof(struct tJournalEntryHeader)], bufferPointer, length);
+	header->crc = journal_entry_crc(journalEntry);
+
+	return journal_program_entry();
+}
+
+
+// Deleting is a zero length entry, the key reads back as erased afterwards
+unsigned char journal_delete(unsigned char type, unsigned short index){
+
+	if( !journal_exists(type, index) ){
+		return DATAFLASH_RESPONSE_OK;
+	}
+
+	return journal_write(type, index, NULL, 0);
+}
+
+
+unsigned char journal_exists(unsigned char type, unsigned short index){
+	unsigned short key = journal_key(type, index);
+
+	if( (key == JOURNAL_KEY_INVALID) || (journal.location[key] == JOURNAL_LOCATION_EMPTY) ){
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+unsigned short journal_key(unsigned char type, unsigned short index){
+	switch(type){
+		case(JOURNAL_TYPE_USERPREFS):
+			if(index == 0) return JOURNAL_KEY_USERPREFS;
+			break;
+
+		case(JOURNAL_TYPE_TRACK):
+			if(index < flash.layout.trackSlots) return JOURNAL_KEY_TRACK + index;
+			break;
+
+		case(JOURNAL_TYPE_RECORD):
+			if(index < flash.layout.sessionSlots) return JOURNAL_KEY_RECORD + index;
+			break;
+
+		case(JOURNAL_TYPE_SESSION_LOG):
+			if(index == 0) return JOURNAL_KEY_SESSION_LOG;
+			break;
+
+		case(JOURNAL_TYPE_WEAR):
+			if(index == 0) return JOURNAL_KEY_WEAR;
+			break;
+
+		case(JOURNAL_TYPE_BADMAP):
+			if(index == 0) return JOURNAL_KEY_BADMAP;
+			break;
+
+		case(JOURNAL_TYPE_CHECKPOINT):
+			if(index == 0) return JOURNAL_KEY_CHECKPOINT;
+			break;
+	}
+
+	return JOURNAL_KEY_INVALID;
+}
+
+
+unsigned long journal_sector_address(unsigned char sector){
+	return flash.layout.journalStart + ((unsigned long)sector * FLASH_4KB);
+}
+
+
+unsigned short journal_entry_crc(unsigned char *entry){
+	struct tJournalEntryHeader *header = (struct tJournalEntryHeader *)entry;
+	unsigned short crc = 0;
+	unsigned short i;
+
+	crc = update_crc_ccitt(crc, header->type);
+	crc = update_crc_ccitt(crc, header->length);
+	crc = update_crc_ccitt(crc, (header->index >> 8) & 0xFF);
+	crc = update_crc_ccitt(crc, header->index & 0xFF);
+
+	for(i = 0; i < header->length; i++){
+		crc = update_crc_ccitt(crc, entry[sizeof(struct tJournalEntryHeader) + i]);
+	}
+
+	return crc;
+}
+
+
+// Load the entry at address into the entry buffer
+enum tJournalEntryStatus journal_fetch_entry(unsigned long address, unsigned short space){
+	struct tJournalEntryHeader *header = (struct tJournalEntryHeader *)journalEntry;
+	unsigned char i;
+
+	if(space < sizeof(struct tJournalEntryHeader)){
+		return JOURNAL_ENTRY_FREE;
+	}
+
+	journal_window_read(address, sizeof(struct tJournalEntryHeader), journalEntry);
+
+	if(header->type == JOURNAL_TYPE_FREE){
+		// A torn header leaves some of the bytes programmed
+		for(i = 1; i < sizeof(struct tJournalEntryHeader); i++){
+			if(journalEntry[i] != 0xFF) return JOURNAL_ENTRY_CORRUPT;
+		}
+		return JOURNAL_ENTRY_FREE;
+	}
+
+	if( ((sizeof(struct tJournalEntryHeader) + header->length) > space) || (journal_key(header->type, header->index) == JOURNAL_KEY_INVALID) ){
+		return JOURNAL_ENTRY_CORRUPT;
+	}
+
+	journal_window_read(address + sizeof(struct tJournalEntryHeader), header->length, &journalEntry[sizeof(struct tJournalEntryHeader)]);
+
+	if(journal_entry_crc(journalEntry) != header->crc){
+		return JOURNAL_ENTRY_CORRUPT;
+	}
+
+	return JOURNAL_ENTRY_VALID;
+}
+
+
+// Replay one sector into the location table, returns the offset of the first free byte
+unsigned short journal_scan_sector(unsigned char sector){
+	struct tJournalEntryHeader *header = (struct tJournalEntryHeader *)journalEntry;
+	unsigned long sectorAddress = journal_sector_address(sector);
+	unsigned short offset = sizeof(struct tJournalSectorHeader);
+	enum tJournalEntryStatus status;
+
+	while(offset < FLASH_4KB){
+		status = journal_fetch_entry(sectorAddress + offset, FLASH_4KB - offset);
+
+		if(status == JOURNAL_ENTRY_FREE){
+			return offset;
+		}
+
+		if(status == JOURNAL_ENTRY_CORRUPT){
+			// Nothing after a bad entry can be trusted, close the sector
+			debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Journal entry CRC failed");
+			return FLASH_4KB;
+		}
+
+		if(header->length){
+			journal.location[journal_key(header->type, header->index)] = (sector * FLASH_4KB) + offset;
+		}else{
+			journal.location[journal_key(header->type, header->index)] = JOURNAL_LOCATION_EMPTY;
+		}
+
+		offset += sizeof(struct tJournalEntryHeader) + header->length;
+	}
+
+	return FLASH_4KB;
+}
+
+
+// Erase a sector if needed and stamp it with the next sequence number
+unsigned char journal_open_sector(unsigned char sector){
+	struct tJournalSectorHeader sectorHeader;
+
+	// A sector whose compaction failed may hold the only copy of live entries
+	if(journal.sectorState[sector] == JOURNAL_SECTOR_IN_USE){
+		debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Journal sector not compacted");
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	if(journal.sectorState[sector] != JOURNAL_SECTOR_ERASED){
+		if( flash_eraseBlock(FLASH_CMD_BLOCK_ERASE_4KB, journal_sector_address(sector)) == DATAFLASH_RESPONSE_FAILURE ){
+			debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Journal erase failed");
+			journal.sectorState[sector] = JOURNAL_SECTOR_UNKNOWN;
+			return DATAFLASH_RESPONSE_FAILURE;
+		}
+	}
+
+	journal.sequence++;
+	sectorHeader.magic = JOURNAL_SECTOR_MAGIC;
+	sectorHeader.sequence = journal.sequence;
+
+	journal.sectorState[sector] = JOURNAL_SECTOR_IN_USE;
+	journal.sectorSequence[sector] = journal.sequence;
+	journal.activeSector = sector;
+	journal.writeOffset = sizeof(sectorHeader);
+
+	return journal_program(journal_sector_address(sector), sizeof(sectorHeader), (unsigned char *)&sectorHeader);
+}
+
+
+// Copy the live entries of the oldest sector to the active sector and erase it.
+// Deletes are dropped here since there is no older entry left for them to hide.
+unsigned char journal_compact_sector(unsigned char sector){
+	struct tJournalEntryHeader *header = (struct tJournalEntryHeader *)journalEntry;
+	unsigned long sectorAddress = journal_sector_address(sector);
+	unsigned short offset = sizeof(struct tJournalSectorHeader);
+	unsigned short key;
+
+	while(offset < FLASH_4KB){
+		if( journal_fetch_entry(sectorAddress + offset, FLASH_4KB - offset) != JOURNAL_ENTRY_VALID ){
+			break;
+		}
+
+		key = journal_key(header->type, header->index);
+
+		if( header->length && (journal.location[key] == ((sector * FLASH_4KB) + offset)) ){
+			if( journal_program_entry() == DATAFLASH_RESPONSE_FAILURE ){
+				return DATAFLASH_RESPONSE_FAILURE;
+			}
+		}
+
+		offset += sizeof(struct tJournalEntryHeader) + header->length;
+	}
+
+	// The copies have to be on flash before the originals are gone
+	if( journal_flush() == DATAFLASH_RESPONSE_FAILURE ){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	if( flash_eraseBlock(FLASH_CMD_BLOCK_ERASE_4KB, sectorAddress) == DATAFLASH_RESPONSE_FAILURE ){
+		debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Journal erase failed");
+		journal.sectorState[sector] = JOURNAL_SECTOR_UNKNOWN;
+	}else{
+		journal.sectorState[sector] = JOURNAL_SECTOR_ERASED;
+	}
+
+	journal.sectorSequence[sector] = 0;
+	journalWindowAddress = JOURNAL_WINDOW_INVALID;
+
+	return DATAFLASH_RESPONSE_OK;
+}
+
+
+// Move to the next sector in the ring, always keeping one sector free
+unsigned char journal_next_sector( void ){
+	unsigned char next = (journal.activeSector + 1) % journal.sectorCount;
+	unsigned char oldest = (next + 1) % journal.sectorCount;
+
+	if( journal_open_sector(next) == DATAFLASH_RESPONSE_FAILURE ){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	if( journal.sectorState[oldest] == JOURNAL_SECTOR_IN_USE ){
+		return journal_compact_sector(oldest);
+	}
+
+	return DATAFLASH_RESPONSE_OK;
+}
+
+
+// Program the entry buffer at the end of the active sector
+unsigned char journal_program_entry( void ){
+	struct tJournalEntryHeader *header = (struct tJournalEntryHeader *)journalEntry;
+	unsigned short size = sizeof(struct tJournalEntryHeader) + header->length;
+	unsigned short location = (journal.activeSector * FLASH_4KB) + journal.writeOffset;
+
+	if( (journal.writeOffset + size) > FLASH_4KB ){
+		debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Journal full");
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	journal.writeOffset += size;
+
+	if( journal_program(flash.layout.journalStart + location, size, journalEntry) == DATAFLASH_RESPONSE_FAILURE ){
+		debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Journal write failed");
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	if(header->length){
+		journal.location[journal_key(header->type, header->index)] = location;
+	}else{
+		journal.location[journal_key(header->type, header->index)] = JOURNAL_LOCATION_EMPTY;
+	}
+
+	return DATAFLASH_RESPONSE_OK;
+}
+
+
+// Read through a one page window, sequential small reads cost one SPI transfer per page
+unsigned char journal_window_read(unsigned long address, unsigned short length, unsigned char *bufferPointer){
+	unsigned long pageAddress;
+	unsigned short offset, chunk;
+
+	while(length){
+		pageAddress = address & ~(FLASH_PAGE_SIZE - 1);
+		offset = address - pageAddress;
+
+		if(pageAddress != journalWindowAddress){
+			journal_flush_range(pageAddress, FLASH_PAGE_SIZE);
+			flash_ReadToBuffer(pageAddress, FLASH_PAGE_SIZE, journalWindow);
+			journalWindowAddress = pageAddress;
+		}
+
+		chunk = FLASH_PAGE_SIZE - offset;
+		if(chunk > length) chunk = length;
+
+		memcpy(bufferPointer, &journalWindow[offset], chunk);
+
+		address += chunk;
+		bufferPointer += chunk;
+		length -= chunk;
+	}
+
+	return DATAFLASH_RESPONSE_OK;
+}
+
+
+// Entries are appended back to back, so they are collected per page and programmed
+// together once the page fills or journal_flush() runs. Entries are free to straddle pages.
+unsigned char journal_program(unsigned long address, unsigned short length, unsigned char *bufferPointer){
+	unsigned long pageAddress;
+	unsigned short offset, chunk;
+
+	while(length){
+		pageAddress = address & ~(FLASH_PAGE_SIZE - 1);
+		offset = address - pageAddress;
+
+		// Only bytes that continue the staged run can join it
+		if( (pageAddress != journalStageAddress) || (offset != journalStageEnd) ){
+			if( journal_flush() == DATAFLASH_RESPONSE_FAILURE ){
+				return DATAFLASH_RESPONSE_FAILURE;
+			}
+
+			journalStageAddress = pageAddress;
+			journalStageStart = offset;
+			journalStageEnd = offset;
+		}
+
+		chunk = FLASH_PAGE_SIZE - offset;
+		if(chunk > length) chunk = length;
+
+		memcpy(&journalStage[offset], bufferPointer, chunk);
+		journalStageEnd += chunk;
+
+		if(journalStageEnd == FLASH_PAGE_SIZE){
+			if( journal_flush() == DATAFLASH_RESPONSE_FAILURE ){
+				return DATAFLASH_RESPONSE_FAILURE;
+			}
+		}
+
+		address += chunk;
+		bufferPointer += chunk;
+		length -= chunk;
+	}
+
+	return DATAFLASH_RESPONSE_OK;
+}
+
+
+// Program the staged bytes, they land in the erased remainder of their page
+unsigned char journal_flush( void ){
+	unsigned short length;
+
+	if( !journal_pending() ){
+		return DATAFLASH_RESPONSE_OK;
+	}
+
+	if(journalStageAddress == journalWindowAddress){
+		journalWindowAddress = JOURNAL_WINDOW_INVALID;
+	}
+
+	length = journalStageEnd - journalStageStart;
+	journalStageStart = journalStageEnd;
+
+	if( flash_WriteFromBuffer(journalStageAddress + (journalStageEnd - length), length, &journalStage[journalStageEnd - length]) == DATAFLASH_RESPONSE_FAILURE ){
+		debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Journal write failed");
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	return DATAFLASH_RESPONSE_OK;
+}
+
+
+unsigned char journal_pending( void ){
+	return (journalStageAddress != JOURNAL_WINDOW_INVALID) && (journalStageEnd != journalStageStart);
+}
+
+
+// Reads that touch the staged page need it on flash first
+void journal_flush_range(unsigned long address, unsigned short length){
+
+	if( journal_pending() && (address < (journalStageAddress + FLASH_PAGE_SIZE)) && ((address + length) > journalStageAddress) ){
+		journal_flush();
+	}
+}
@@ -0,0 +1,99 @@
+/******************************************************************************
+ *
+ * Metadata Journal Include
+ *
+ * - Compiler:          GNU GCC for AVR32
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+
+#ifndef FLASH_JOURNAL_H_
+#define FLASH_JOURNAL_H_
+
+#include "hal.h"
+
+#define JOURNAL_MAX_SECTORS			16			// Entry offsets are 16 bits, so 64KB at most
+
+// Every journal key gets a slot in the RAM location table. The table is sized
+// for the largest partition, the keys are packed by the mounted one.
+#define JOURNAL_KEY_USERPREFS		0
+#define JOURNAL_KEY_TRACK			(JOURNAL_KEY_USERPREFS + 1)
+#define JOURNAL_KEY_RECORD			(JOURNAL_KEY_TRACK + flash.layout.trackSlots)
+#define JOURNAL_KEY_SESSION_LOG		(JOURNAL_KEY_RECORD + flash.layout.sessionSlots)
+#define JOURNAL_KEY_WEAR			(JOURNAL_KEY_SESSION_LOG + 1)
+#define JOURNAL_KEY_BADMAP			(JOURNAL_KEY_WEAR + 1)
+#define JOURNAL_KEY_CHECKPOINT		(JOURNAL_KEY_BADMAP + 1)
+#define JOURNAL_KEY_TOTAL			(1 + TRACKLIST_TOTAL_NUM + RECORDS_TOTAL_POSSIBLE + 1 + 1 + 1 + 1)
+#define JOURNAL_KEY_INVALID			0xFFFF
+
+#define JOURNAL_LOCATION_EMPTY		0x0000		// Offset 0 is always a sector header, never an entry
+#define JOURNAL_WINDOW_INVALID		0xFFFFFFFF
+#define JOURNAL_FLUSH_TIME			10			// Time in milliseconds without requests before staged entries are programmed
+
+enum tJournalSectorState {
+	JOURNAL_SECTOR_UNKNOWN,			// Contents unknown, erase before use
+	JOURNAL_SECTOR_ERASED,
+	JOURNAL_SECTOR_IN_USE
+};
+
+enum tJournalEntryStatus {
+	JOURNAL_ENTRY_VALID,
+	JOURNAL_ENTRY_FREE,
+	JOURNAL_ENTRY_CORRUPT
+};
+
+struct tJournal {
+	unsigned char sectorCount;
+	unsigned char activeSector;
+	unsigned short writeOffset;		// Offset of the next entry within the active sector
+	unsigned int sequence;			// Sequence number of the active sector
+
+	enum tJournalSectorState sectorState[JOURNAL_MAX_SECTORS];
+	unsigned int sectorSequence[JOURNAL_MAX_SECTORS];
+
+	unsigned short location[JOURNAL_KEY_TOTAL];	// Offset from journal start of the newest entry of each key
+};
+
+unsigned char journal_mount( void );
+void journal_invalidate( void );
+unsigned char journal_read(unsigned char type, unsigned short index, unsigned char *bufferPointer, unsigned short length);
+unsigned char journal_write(unsigned char type, unsigned short index, unsigned char *bufferPointer, unsigned char length);
+unsigned char journal_delete(unsigned char type, unsigned short index);
+unsigned char journal_exists(unsigned char type, unsigned short index);
+unsigned short journal_key(unsigned char type, unsigned short index);
+unsigned long journal_sector_address(unsigned char sector);
+unsigned short journal_entry_crc(unsigned char *entry);
+enum tJournalEntryStatus journal_fetch_entry(unsigned long address, unsigned short space);
+unsigned short journal_scan_sector(unsigned char sector);
+unsigned char journal_open_sector(unsigned char sector);
+unsigned char journal_compact_sector(unsigned char sector);
+unsigned char journal_next_sector( void );
+unsigned char journal_program_entry( void );
+unsigned char journal_window_read(unsigned long address, unsigned short length, unsigned char *bufferPointer);
+unsigned char journal_program(unsigned long address, unsigned short length, unsigned char *bufferPointer);
+unsigned char journal_flush( void );
+unsigned char journal_pending( void );
+void journal_flush_range(unsigned long address, unsigned short length);
+
+#endif /* FLASH_JOURNAL_H_ */
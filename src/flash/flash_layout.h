@@ -31,8 +31,8 @@
 #ifndef DATAFLASH_LAYOUT_H_
 #define DATAFLASH_LAYOUT_H_
 
-#define FLASH_LAYOUT_VERSION		0x0130
-#define FLASH_LAYOUT_VERSION_ASCII	"1.30"
+#define FLASH_LAYOUT_VERSION		0x0145
+#define FLASH_LAYOUT_VERSION_ASCII	"1.45"
 
 #define FLASH_PAGE_SIZE		256
 
@@ -40,15 +40,20 @@
 struct __attribute__ ((packed)) tRecordsEntry {
 	unsigned char recordEmpty;
 	unsigned char trackID;
-	unsigned char reserved1[2];
+	unsigned char flags;			// Active low, see RECORD_FLAG_*
+	unsigned char reserved1;
 
 	unsigned int datestamp;
 	unsigned int startAddress;
 	unsigned int endAddress;
 };	// tRecordsEntry - 16 Bytes
 
+#define RECORD_FLAG_SUMMARY		0x01	// Cleared when the last page of the session is its tSessionSummary
+#define RECORD_FLAG_PACKED		0x02	// Cleared when the session's samples are on tRecordPackedPage pages
+#define RECORD_FLAG_HEADING		0x04	// Cleared when headings are in hundredths of a degree, older sessions hold the low 16 bits of the raw NAV-VELNED heading
+
 #define RECORD_ENTRY_SIZE		sizeof(tRecordsEntry)
-#define RECORDS_TOTAL_POSSIBLE	256
+#define RECORDS_TOTAL_POSSIBLE	512		// Largest record table any partition table may ask for
 #define RECORDS_ENTRY_PER_PAGE	16
 
 struct tRecordsEntryPage {
@@ -69,9 +74,24 @@ struct __attribute__ ((packed)) tRecordData {
 
 #define RECORD_DATA_PER_PAGE	15
 
+enum tRecordPageType {
+	RECORD_PAGE_DATA,
+	RECORD_PAGE_SUMMARY,
+	RECORD_PAGE_PACKED,
+	RECORD_PAGE_STREAM
+};
+
+// Every page of the record log has its type in byte 0 and a CRC in bytes 2-3.
+// The CRC covers the page's sequence number followed by the rest of the page,
+// so a page left over from an older session never checks out.
+#define RECORD_PAGE_CRC_OFFSET		2
+#define record_page_sequence(session, page)		(((unsigned int)(session) << 16) | ((page) & 0xFFFF))
+
 struct __attribute__ ((packed)) tRecordDataPage {
-	unsigned char pageType;			// TODO: Define enum states for this
-	unsigned char reserved[7];
+	unsigned char pageType;			// RECORD_PAGE_DATA
+	unsigned char reserved;
+	unsigned short crc;
+	unsigned int sequence;			// Session number in the upper half, page within the session in the lower
 	
 	unsigned int utc;
 	
@@ -82,6 +102,155 @@ struct __attribute__ ((packed)) tRecordDataPage {
 	struct tRecordData data[RECORD_DATA_PER_PAGE];
 }; // 256 bytes
 
+// Same header as tRecordDataPage. The first sample is stored as it is, every
+// following one as zig-zag varint deltas against the sample before it, see flash_codec.h
+#define RECORD_PACKED_DELTA_SIZE	216
+
+struct __attribute__ ((packed)) tRecordPackedPage {
+	unsigned char pageType;			// RECORD_PAGE_PACKED
+	unsigned char sampleCount;		// Samples on the page, the keyframe included
+	unsigned short crc;
+	unsigned int sequence;
+	
+	unsigned int utc;
+	
+	unsigned short hdop;
+	unsigned char currentMode;
+	unsigned char satellites;
+	
+	unsigned int firstSample;		// Samples of the session on the pages before this one
+	unsigned short deltaLength;		// Bytes of delta in use
+	unsigned short reserved;
+	
+	struct tRecordData keyframe;
+	unsigned char delta[RECORD_PACKED_DELTA_SIZE];
+}; // 256 bytes
+
+// Producers other than the GPS log to a stream of their own. Their pages are
+// interleaved with the GPS pages of a session in the order they fill up.
+enum tRecordStreamId {
+	RECORD_STREAM_ACCEL,
+	RECORD_STREAM_EVENT,
+	RECORD_STREAM_HEALTH,
+	RECORD_STREAM_COUNT
+};
+
+#define RECORD_STREAM_DATA_SIZE		240
+
+// Same first 8 bytes as every other page of a session. Entries are packed back
+// to back, each one a tRecordStreamEntry followed by its payload.
+struct __attribute__ ((packed)) tRecordStreamPage {
+	unsigned char pageType;			// RECORD_PAGE_STREAM
+	unsigned char stream;			// enum tRecordStreamId
+	unsigned short crc;
+	unsigned int sequence;
+	
+	unsigned short streamPage;		// Pages of this stream before this one in the session
+	unsigned short length;			// Bytes of data in use
+	unsigned int time;				// Milliseconds from the start of the session to the first entry
+	
+	unsigned char data[RECORD_STREAM_DATA_SIZE];
+}; // 256 bytes
+
+// Readers skip entry types they don't know by their length
+#define RECORD_ENTRY_ACCEL			0x01	// struct tRecordAccelEntry
+#define RECORD_ENTRY_LAP			0x02	// struct tRecordLapEntry
+#define RECORD_ENTRY_HEALTH			0x03	// struct tRecordHealthEntry
+
+struct __attribute__ ((packed)) tRecordStreamEntry {
+	unsigned char type;				// RECORD_ENTRY_*
+	unsigned char length;			// Bytes of payload after this header
+	unsigned short time;			// Milliseconds after the time of the page
+}; // 4 bytes
+
+struct __attribute__ ((packed)) tRecordAccelEntry {
+	signed short x;
+	signed short y;
+	signed short z;
+}; // 6 bytes
+
+struct __attribute__ ((packed)) tRecordLapEntry {
+	unsigned int utc;				// GPS time of week of the finish line crossing in milliseconds
+	unsigned int lapTime;			// Milliseconds, 0 for the crossing that starts the first lap
+	unsigned char lap;				// Laps completed with this crossing
+	unsigned char reserved[3];
+}; // 12 bytes
+
+struct __attribute__ ((packed)) tRecordHealthEntry {
+	unsigned short voltage;			// Battery voltage from the fuel gauge
+	signed short accumulatedCurrent;
+	unsigned short main;			// ADC readings of the supplies
+	unsigned short vcc;
+	unsigned short vee;
+	unsigned char chargeState;
+	unsigned char reserved;
+}; // 12 bytes
+
+#define SESSION_SUMMARY_MAX_LAPS	29
+#define SESSION_SUMMARY_NO_LAP		0xFF
+
+struct __attribute__ ((packed)) tSessionLap {
+	unsigned int time;				// Lap time in milliseconds
+	unsigned short startPage;		// GPS page of the session holding the finish line crossing
+	unsigned short reserved;
+}; // 8 bytes
+
+// Written as the last page of a session when recording stops
+struct __attribute__ ((packed)) tSessionSummary {
+	unsigned char pageType;			// RECORD_PAGE_SUMMARY
+	unsigned char lapCount;			// Completed laps, only the first SESSION_SUMMARY_MAX_LAPS are listed
+	unsigned short crc;
+	
+	unsigned short maxSpeed;		// cm/s
+	unsigned char bestLap;			// Lap number of the fastest lap, SESSION_SUMMARY_NO_LAP without laps
+	unsigned char trackID;
+	
+	unsigned int distance;			// Meters
+	unsigned int startUtc;			// GPS time of week of the first sample in milliseconds
+	unsigned int duration;			// Milliseconds from the first to the last sample
+	
+	struct tSessionLap lap[SESSION_SUMMARY_MAX_LAPS];
+	
+	unsigned int bestLapTime;		// Milliseconds
+}; // 256 bytes
+
+
+struct __attribute__ ((packed)) tCheckpointLap {
+	unsigned int time;				// Lap time in milliseconds
+	unsigned short startPage;
+}; // 6 bytes
+
+// Recording state of the open session, saved to the journal while recording. A reset
+// resumes the session from here, the pages programmed since are counted in on mount.
+struct __attribute__ ((packed)) tSessionCheckpoint {
+	unsigned short session;			// Number the open session gets once closed
+	unsigned char trackID;
+	unsigned char recordFlags;		// RECORD_FLAG_* of the open session
+	unsigned int datestamp;
+	unsigned int startAddress;		// First page of the open session
+	unsigned int endAddress;		// Next page to program when the checkpoint was taken
+	
+	unsigned int sampleCount;		// Samples on the GPS pages of the session
+	unsigned short pageCount;		// GPS pages of the session
+	unsigned short maxSpeed;		// cm/s
+	unsigned int distance;			// Centimeters
+	unsigned int startUtc;
+	unsigned int lastUtc;
+	
+	unsigned char lapStarted;		// The clock of the current lap is running
+	unsigned char lapCount;
+	unsigned char bestLap;
+	unsigned char reserved;
+	unsigned int lapStartUtc;
+	unsigned int bestLapTime;
+	unsigned short lapStartPage;
+	
+	unsigned short streamPages[RECORD_STREAM_COUNT];	// Pages of each stream of the session
+	unsigned int streamTime;		// Milliseconds since the streams started
+	
+	struct tCheckpointLap lap[SESSION_SUMMARY_MAX_LAPS];
+}; // 234 bytes
+
 
 
 
@@ -104,36 +273,136 @@ struct __attribute__ ((packed)) tTracklist {
 	
 	unsigned short heading;
 	unsigned char isEmpty;
-	unsigned char reserved;
+	unsigned char headingUnit;		// TRACKLIST_HEADING_*
 }; // 32 Bytes
 
-#define TRACKLIST_TOTAL_NUM					120		// Maximum number of tracks able to be stored
+#define TRACKLIST_HEADING_RAW		0xA5	// Low 16 bits of the raw NAV-VELNED heading, it can't be converted back
+#define TRACKLIST_HEADING_CENTI		0x5A	// Hundredths of a degree
+
+#define TRACKLIST_TOTAL_NUM					240		// Largest track list any partition table may ask for
+
+
+// Record data is a circular log of sessions. Session numbers only ever count up,
+// the record table slot for a session is its number modulo the partition's session slots
+struct __attribute__ ((packed)) tSessionLogState {
+	unsigned short tail;			// Number of the oldest session still stored
+	unsigned short head;			// Number the next closed session will get
+	unsigned int writeAddress;		// Next record data page to be programmed
+	unsigned int lap;				// Times the write pointer has wrapped around the region
+}; // 12 Bytes
+
+
+// Erase counts in 4KB sectors, a 64KB block erase counts 16
+struct __attribute__ ((packed)) tFlashWear {
+	unsigned int partition;			// Everything ahead of the journal
+	unsigned int journal;
+	unsigned int recordData;
+}; // 12 Bytes
 
-// Flash Memory Layout for Atmel AT25DF161
-#define FLASH_AT25DF161_USERPREFS_START		0x00000000
-#define FLASH_AT25DF161_USERPREFS_END		0x000000FF
 
-#define FLASH_AT25DF161_TRACKLIST_START		0x00000100
-#define FLASH_AT25DF161_TRACKLIST_END		0x00000FFF	// Align to 4KB sector
+// Record log sectors that failed a program or erase, each is served from a spare sector
+#define FLASH_REMAP_MAX					16
 
-#define FLASH_AT25DF161_RECORDTABLE_START	0x00001000
-#define FLASH_AT25DF161_RECORDTABLE_END		0x00001FFF	// Align to 4KB sector
+struct __attribute__ ((packed)) tFlashRemap {
+	unsigned short logical;			// 4KB sector number the record log addresses
+	unsigned short physical;		// Spare sector standing in for it
+}; // 4 Bytes
 
-#define FLASH_AT25DF161_RECORDDATA_START	0x00002000	// Size is remainder of flash
-#define FLASH_AT25DF161_RECORDDATA_END		0x001FFFFF	// Dataflash End Address
+struct __attribute__ ((packed)) tFlashBadMap {
+	unsigned char count;			// Entries in use
+	unsigned char sparesUsed;		// Spares handed out so far, failed spares included
+	unsigned short reserved;
+	struct tFlashRemap remap[FLASH_REMAP_MAX];
+}; // 68 Bytes
+
+
+// Metadata journal: user prefs, tracks and record table entries are appended
+// to a ring of 4KB sectors instead of being rewritten in place
+#define JOURNAL_SECTOR_MAGIC				0x4A524E4C	// "JRNL"
+#define JOURNAL_ENTRY_MAX_LENGTH			255
+
+struct __attribute__ ((packed)) tJournalSectorHeader {
+	unsigned int magic;
+	unsigned int sequence;		// Incremented each time a sector is opened, oldest sector has the lowest
+}; // 8 Bytes
+
+struct __attribute__ ((packed)) tJournalEntryHeader {
+	unsigned char type;			// enum tJournalType
+	unsigned char length;		// Payload length, zero marks the key as deleted
+	unsigned short index;		// Key index within the type (track number, record number)
+	unsigned short crc;			// CRC-CCITT over type, length, index and payload
+	unsigned short reserved;
+}; // 8 Bytes, followed by the payload
+
+enum tJournalType {
+	JOURNAL_TYPE_USERPREFS		= 0x01,
+	JOURNAL_TYPE_TRACK			= 0x02,
+	JOURNAL_TYPE_RECORD			= 0x03,
+	JOURNAL_TYPE_SESSION_LOG	= 0x04,
+	JOURNAL_TYPE_WEAR			= 0x05,
+	JOURNAL_TYPE_BADMAP			= 0x06,
+	JOURNAL_TYPE_CHECKPOINT		= 0x07,
+	JOURNAL_TYPE_FREE			= 0xFF		// Erased flash, end of the entries in a sector
+};
+
+// Partition table: the first sector holds copies of the layout the part was formatted with
+#define FLASH_PARTITION_MAGIC				0x50415254	// "PART"
+#define FLASH_PARTITION_ADDRESS				0x00000000
+#define FLASH_PARTITION_COPIES				2			// One per page, the second covers a torn write of the first
+
+struct __attribute__ ((packed)) tFlashPartitionTable {
+	unsigned int magic;
+	unsigned short version;			// FLASH_LAYOUT_VERSION that wrote the table
+	unsigned short sessionSlots;	// Record table entries, a power of two
+	unsigned int journalStart;
+	unsigned int journalEnd;
+	unsigned int recordDataStart;
+	unsigned int recordDataEnd;
+	unsigned short trackSlots;
+	unsigned short crc;				// CRC-CCITT over everything above
+}; // 24 Bytes
+
+
+// Flash Memory Layout for Atmel AT25DF161
+#define FLASH_AT25DF161_JOURNAL_START		0x00001000
+#define FLASH_AT25DF161_JOURNAL_END			0x00008FFF	// 8 x 4KB sectors
+
+#define FLASH_AT25DF161_RECORDDATA_START	0x00009000	// Size is remainder of flash
+#define FLASH_AT25DF161_RECORDDATA_END		0x001F7FFF	// 8 x 4KB spare sectors follow
+#define FLASH_AT25DF161_END				0x001FFFFF	// Dataflash End Address
+
+#define FLASH_AT25DF161_SESSION_SLOTS		256
+#define FLASH_AT25DF161_TRACK_SLOTS			120
 
 
 // Flash Memory Layout for Atmel AT25DF321
-#define FLASH_AT25DF321_USERPREFS_START		0x00000000
-#define FLASH_AT25DF321_USERPREFS_END		0x000000FF
+#define FLASH_AT25DF321_JOURNAL_START		0x00001000
+#define FLASH_AT25DF321_JOURNAL_END			0x00010FFF	// 16 x 4KB sectors
+
+#define FLASH_AT25DF321_RECORDDATA_START	0x00011000	// Size is remainder of flash
+#define FLASH_AT25DF321_RECORDDATA_END		0x003F7FFF	// 8 x 4KB spare sectors follow
+#define FLASH_AT25DF321_END				0x003FFFFF	// Dataflash End Address
+
+#define FLASH_AT25DF321_SESSION_SLOTS		512
+#define FLASH_AT25DF321_TRACK_SLOTS			240
+
+
+// Flash Memory Layout for parts described by SFDP, record data runs up to the spares at the end
+#define FLASH_GENERIC_JOURNAL_START			0x00001000
+#define FLASH_GENERIC_JOURNAL_END			0x00010FFF	// 16 x 4KB sectors
+
+#define FLASH_GENERIC_RECORDDATA_START		0x00011000	// Size is remainder of flash
+#define FLASH_GENERIC_SPARE_SECTORS			8
 
-#define FLASH_AT25DF321_TRACKLIST_START		0x00000100
-#define FLASH_AT25DF321_TRACKLIST_END		0x00000FFF	// Align to 4KB sector
+#define FLASH_GENERIC_SESSION_SLOTS			512
+#define FLASH_GENERIC_TRACK_SLOTS			240
 
-#define FLASH_AT25DF321_RECORDTABLE_START	0x00001000
-#define FLASH_AT25DF321_RECORDTABLE_END		0x00001FFF	// Align to 4KB sector
 
-#define FLASH_AT25DF321_RECORDDATA_START	0x00002000	// Size is remainder of flash
-#define FLASH_AT25DF321_RECORDDATA_END		0x003FFFFF	// Dataflash End Address
+// Fixed layout of parts last written by version 1.30, only read to migrate them
+#define FLASH_V130_USERPREFS_START			0x00000000
+#define FLASH_V130_TRACKLIST_START			0x00000100
+#define FLASH_V130_TRACKLIST_NUM			120
+#define FLASH_V130_RECORDTABLE_START		0x00001000
+#define FLASH_V130_RECORDS_NUM				256
 
 #endif /* DATAFLASH_LAYOUT_H_ */
\ No newline at end of file
@@ -0,0 +1,979 @@
+/******************************************************************************
+ *
+ * Record Session Log
+ *
+ * - Compiler:          GNU GCC for AVR32
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+#include <asf.h>
+#include "hal.h"
+#include "string.h"
+
+extern struct tFlash flash;
+
+//--------------------------
+// Structs
+//--------------------------
+struct tSessionLog session;
+
+
+// Load the log state from the journal and get the next session ready.
+void session_mount( void ){
+	unsigned char page[FLASH_PAGE_SIZE];
+	unsigned short i;
+
+	session.regionSize = flash.layout.recordDataEnd - flash.layout.recordDataStart + 1;
+
+	if( journal_read(JOURNAL_TYPE_SESSION_LOG, 0, (unsigned char *)&session.state, sizeof(session.state)) == DATAFLASH_RESPONSE_FAILURE ){
+		session.state.tail = 0;
+		session.state.head = 0;
+		session.state.writeAddress = flash.layout.recordDataStart;
+		session.state.lap = 0;
+	}
+
+	if( (session.state.writeAddress < flash.layout.recordDataStart) || (session.state.writeAddress > flash.layout.recordDataEnd) ){
+		session.state.writeAddress = flash.layout.recordDataStart;
+	}
+
+	session_load_index();
+	session_recover();
+
+	// The recorder picks the session up where it stopped
+	if(session.resumed){
+		session_preerase_reset();
+		return;
+	}
+
+	// Whatever follows the write pointer now is torn or not ours. Skip to the
+	// next sector instead of programming over it.
+	if( (session.regionSize != 0) && (session.state.writeAddress & (FLASH_4KB - 1)) ){
+		flash_ReadToBuffer(session.state.writeAddress, FLASH_PAGE_SIZE, page);
+
+		for(i = 0; i < FLASH_PAGE_SIZE; i++){
+			if(page[i] != 0xFF){
+				session.state.writeAddress = (session.state.writeAddress | (FLASH_4KB - 1)) + 1;
+				if(session.state.writeAddress > flash.layout.recordDataEnd){
+					session.state.writeAddress = flash.layout.recordDataStart;
+					session.state.lap++;
+				}
+				break;
+			}
+		}
+	}
+
+	session_start_at(session.state.writeAddress);
+	session_preerase_reset();
+}
+
+
+// A session that was never closed leaves its pages past the write pointer.
+// They form an unbroken run of valid pages, so a binary search finds the end
+// in a few reads and the session gets its record table entry after all.
+unsigned char session_recover( void ){
+	struct tRecordsEntry oldest;
+	unsigned char page[FLASH_PAGE_SIZE];
+	unsigned long low = 0;
+	unsigned long high;
+	unsigned long middle;
+
+	if(session.regionSize == 0){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	session_start_at(session.state.writeAddress);
+
+	// Never search into the oldest stored session
+	high = session.regionSize / FLASH_PAGE_SIZE;
+	if( session_read_entry(0, &oldest) == DATAFLASH_RESPONSE_OK ){
+		high = session_distance(session.state.writeAddress, oldest.startAddress) / FLASH_PAGE_SIZE;
+	}
+
+	// Pages before low are valid, pages from high on are not
+	while(low < high){
+		middle = (low + high) / 2;
+
+		if( session_page_valid(middle, page) ){
+			low = middle + 1;
+		}else{
+			high = middle;
+		}
+	}
+
+	if( session_resume(low) ){
+		return DATAFLASH_RESPONSE_OK;
+	}
+
+	if(low == 0){
+		return DATAFLASH_RESPONSE_OK;
+	}
+
+	debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Recovered unclosed session");
+
+	// A summary can only be the last page
+	session_page_valid(low - 1, page);
+	if(page[0] == RECORD_PAGE_SUMMARY){
+		session.current.trackID = ((struct tSessionSummary *)page)->trackID;
+		session.current.flags &= ~RECORD_FLAG_SUMMARY;
+	}
+	
+	// Only unpacked sessions start with a plain data page, packed ones may lead with another stream
+	session_page_valid(0, page);
+	if(page[0] != RECORD_PAGE_DATA){
+		session.current.flags &= ~RECORD_FLAG_PACKED;
+	}
+
+	if( (session.state.writeAddress - flash.layout.recordDataStart + (low * FLASH_PAGE_SIZE)) >= session.regionSize ){
+		session.state.lap++;
+	}
+
+	session.current.recordEmpty = FALSE;
+	session.current.endAddress = session_address_after(session.state.writeAddress, low);
+
+	return session_close();
+}
+
+
+// The open session stays open when it was checkpointed and nothing torn follows its
+// last page. Pages programmed after the checkpoint are counted into it.
+unsigned char session_resume(unsigned long pages){
+	struct tSessionCheckpoint *checkpoint = &session.checkpoint;
+	unsigned char page[FLASH_PAGE_SIZE];
+	unsigned long endAddress;
+	unsigned long index;
+	unsigned short i;
+
+	if( (journal_read(JOURNAL_TYPE_CHECKPOINT, 0, (unsigned char *)checkpoint, sizeof(struct tSessionCheckpoint)) == DATAFLASH_RESPONSE_FAILURE) ||
+		(checkpoint->session != session.state.head) || (checkpoint->startAddress != session.state.writeAddress) ){
+		return FALSE;
+	}
+
+	index = session_distance(checkpoint->startAddress, checkpoint->endAddress) / FLASH_PAGE_SIZE;
+	if(index > pages){
+		return FALSE;
+	}
+
+	// A page that starts a sector is erased before it's written, whatever it holds now
+	endAddress = session_address_after(session.current.startAddress, pages);
+	if(endAddress & (FLASH_4KB - 1)){
+		flash_ReadToBuffer(endAddress, FLASH_PAGE_SIZE, page);
+		for(i = 0; i < FLASH_PAGE_SIZE; i++){
+			if(page[i] != 0xFF){
+				return FALSE;
+			}
+		}
+	}
+
+	for(; index < pages; index++){
+		session_page_valid(index, page);
+
+		switch(page[0]){
+			case(RECORD_PAGE_PACKED):
+				checkpoint->pageCount++;
+				checkpoint->sampleCount = ((struct tRecordPackedPage *)page)->firstSample + ((struct tRecordPackedPage *)page)->sampleCount;
+				break;
+
+			case(RECORD_PAGE_STREAM):
+				if( ((struct tRecordStreamPage *)page)->stream < RECORD_STREAM_COUNT ){
+					checkpoint->streamPages[((struct tRecordStreamPage *)page)->stream] = ((struct tRecordStreamPage *)page)->streamPage + 1;
+				}
+				if( ((struct tRecordStreamPage *)page)->time > checkpoint->streamTime ){
+					checkpoint->streamTime = ((struct tRecordStreamPage *)page)->time;
+				}
+				break;
+
+			case(RECORD_PAGE_SUMMARY):
+				// Stopped already, only the record table entry is missing
+				return FALSE;
+		}
+	}
+
+	debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Resuming unclosed session");
+
+	session.current.trackID = checkpoint->trackID;
+	session.current.flags = checkpoint->recordFlags;
+	session.current.datestamp = checkpoint->datestamp;
+	session.current.recordEmpty = (pages == 0);
+	session.current.endAddress = endAddress;
+	session.resumed = TRUE;
+
+	return TRUE;
+}
+
+
+// Saved straight away, a reset right after still finds it
+unsigned char session_checkpoint(struct tSessionCheckpoint *checkpoint){
+
+	checkpoint->session = session.state.head;
+	checkpoint->trackID = session.current.trackID;
+	checkpoint->recordFlags = session.current.flags;
+	checkpoint->datestamp = session.current.datestamp;
+	checkpoint->startAddress = session.current.startAddress;
+	checkpoint->endAddress = session.current.endAddress;
+
+	if( journal_write(JOURNAL_TYPE_CHECKPOINT, 0, (unsigned char *)checkpoint, sizeof(struct tSessionCheckpoint)) == DATAFLASH_RESPONSE_FAILURE ){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	return journal_flush();
+}
+
+
+// Reads a page of the open session and checks it belongs there
+unsigned char session_page_valid(unsigned long index, unsigned char *page){
+	unsigned int sequence = record_page_sequence(session.state.head, index);
+
+	flash_ReadToBuffer(session_address_after(session.current.startAddress, index), FLASH_PAGE_SIZE, page);
+
+	switch(page[0]){
+		case(RECORD_PAGE_DATA):
+		case(RECORD_PAGE_PACKED):
+		case(RECORD_PAGE_STREAM):
+			if( ((struct tRecordDataPage *)page)->sequence != sequence ){
+				return FALSE;
+			}
+			break;
+
+		case(RECORD_PAGE_SUMMARY):
+			break;
+
+		default:
+			return FALSE;
+	}
+
+	// Summary pages keep their CRC at the same offset
+	return ( ((struct tRecordDataPage *)page)->crc == session_page_crc(page, sequence) );
+}
+
+
+// Fill in the sequence number and CRC of the next page of the open session
+void session_stamp_page(unsigned char *page){
+	unsigned int sequence = record_page_sequence(session.state.head, session_distance(session.current.startAddress, session.current.endAddress) / FLASH_PAGE_SIZE);
+
+	if( (page[0] == RECORD_PAGE_DATA) || (page[0] == RECORD_PAGE_PACKED) || (page[0] == RECORD_PAGE_STREAM) ){
+		((struct tRecordDataPage *)page)->sequence = sequence;
+	}
+
+	((struct tRecordDataPage *)page)->crc = session_page_crc(page, sequence);
+}
+
+
+unsigned short session_page_crc(unsigned char *page, unsigned int sequence){
+	unsigned short crc = 0;
+	unsigned short i;
+
+	crc = update_crc_ccitt(crc, (sequence >> 24) & 0xFF);
+	crc = update_crc_ccitt(crc, (sequence >> 16) & 0xFF);
+	crc = update_crc_ccitt(crc, (sequence >> 8) & 0xFF);
+	crc = update_crc_ccitt(crc, (sequence >> 0) & 0xFF);
+
+	for(i = 0; i < FLASH_PAGE_SIZE; i++){
+		if( (i != RECORD_PAGE_CRC_OFFSET) && (i != (RECORD_PAGE_CRC_OFFSET + 1)) ){
+			crc = update_crc_ccitt(crc, page[i]);
+		}
+	}
+
+	return crc;
+}
+
+
+// Read every stored record table entry once so later queries never touch SPI
+void session_load_index( void ){
+	struct tRecordsEntry entry;
+	unsigned short number;
+	unsigned short slot;
+
+	memset(session.index, 0, sizeof(session.index));
+
+	// Consecutive entries sit next to each other in the journal, so this streams
+	for(number = session.state.tail; number != session.state.head; number++){
+		slot = session_slot(number);
+
+		if( journal_read(JOURNAL_TYPE_RECORD, slot, (unsigned char *)&entry, sizeof(entry)) == DATAFLASH_RESPONSE_OK ){
+			session_index_store(slot, &entry);
+		}else{
+			debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Record table entry missing");
+		}
+	}
+}
+
+
+void session_index_store(unsigned short slot, struct tRecordsEntry *entry){
+	session.index[slot].startAddress = entry->startAddress;
+	session.index[slot].endAddress = entry->endAddress;
+	session.index[slot].datestamp = entry->datestamp;
+	session.index[slot].trackID = entry->trackID;
+	session.index[slot].flags = SESSION_INDEX_LOADED;
+	
+	if( !(entry->flags & RECORD_FLAG_SUMMARY) ){
+		session.index[slot].flags |= SESSION_INDEX_SUMMARY;
+	}
+	
+	if( !(entry->flags & RECORD_FLAG_PACKED) ){
+		session.index[slot].flags |= SESSION_INDEX_PACKED;
+	}
+	
+	if( !(entry->flags & RECORD_FLAG_HEADING) ){
+		session.index[slot].flags |= SESSION_INDEX_HEADING;
+	}
+}
+
+
+unsigned char session_save_state( void ){
+	return journal_write(JOURNAL_TYPE_SESSION_LOG, 0, (unsigned char *)&session.state, sizeof(session.state));
+}
+
+
+// Program the next page of the open session, wrapping at the end of the region
+unsigned char session_add_page(unsigned char *bufferPointer, unsigned short length){
+	unsigned long address = session.current.endAddress;
+
+	if( flash_full_flag() || (session.regionSize == 0) ){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	if( !(address & (FLASH_4KB - 1)) ){
+		if( session_prepare_sector(address) == DATAFLASH_RESPONSE_FAILURE ){
+			flash_set_full_flag();
+			return DATAFLASH_RESPONSE_FAILURE;
+		}
+	}
+
+	if(length == FLASH_PAGE_SIZE){
+		session_stamp_page(bufferPointer);
+	}
+	
+	if(bufferPointer[0] == RECORD_PAGE_PACKED){
+		session.current.flags &= ~RECORD_FLAG_PACKED;
+	}
+
+	if( flash_WriteFromBuffer(address, length, bufferPointer) == DATAFLASH_RESPONSE_FAILURE ){
+		debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Write Failed");
+	}
+
+	session.current.recordEmpty = FALSE;
+
+	address += FLASH_PAGE_SIZE;
+	if(address > flash.layout.recordDataEnd){
+		address = flash.layout.recordDataStart;
+		session.state.lap++;
+		session_save_state();
+	}
+
+	session.current.endAddress = address;
+
+	return DATAFLASH_RESPONSE_OK;
+}
+
+
+// Store the record table entry of the open session and start the next one
+unsigned char session_close( void ){
+	struct tRecordsEntry entry;
+
+	if(session.current.recordEmpty){
+		// Nothing was recorded
+		return DATAFLASH_RESPONSE_OK;
+	}
+
+	// Every slot is taken, the oldest session gives up its slot
+	if(session_count() >= flash.layout.sessionSlots){
+		session_reclaim_oldest();
+	}
+
+	entry = session.current;
+
+	// Really the last byte of the page
+	if(entry.endAddress == flash.layout.recordDataStart){
+		entry.endAddress = flash.layout.recordDataEnd;
+	}else{
+		entry.endAddress--;
+	}
+
+	if( journal_write(JOURNAL_TYPE_RECORD, session_slot(session.state.head), (unsigned char *)&entry, sizeof(entry)) == DATAFLASH_RESPONSE_FAILURE ){
+		debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Record table write failed");
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	session_index_store(session_slot(session.state.head), &entry);
+	session.state.head++;
+	session.state.writeAddress = session.current.endAddress;
+	session_save_state();
+
+	flash_clr_full_flag();
+	session_start_at(session.current.endAddress);
+
+	return DATAFLASH_RESPONSE_OK;
+}
+
+
+// Closes the open session with its summary page, sessions without data get none
+unsigned char session_add_summary(struct tSessionSummary *summary){
+	
+	if(session.current.recordEmpty){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+	
+	summary->pageType = RECORD_PAGE_SUMMARY;
+	
+	if( session_add_page((unsigned char *)summary, sizeof(struct tSessionSummary)) == DATAFLASH_RESPONSE_FAILURE ){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+	
+	session.current.flags &= ~RECORD_FLAG_SUMMARY;
+	
+	return DATAFLASH_RESPONSE_OK;
+}
+
+
+// Summary page of a stored session, SESSION_NO_SUMMARY if it was closed without one
+unsigned long session_summary_address(unsigned short index){
+	struct tSessionIndexEntry *indexEntry;
+	
+	if(index >= session_count()){
+		return SESSION_NO_SUMMARY;
+	}
+	
+	indexEntry = &session.index[session_slot(session.state.tail + index)];
+	
+	if( (indexEntry->flags & (SESSION_INDEX_LOADED | SESSION_INDEX_SUMMARY)) != (SESSION_INDEX_LOADED | SESSION_INDEX_SUMMARY) ){
+		return SESSION_NO_SUMMARY;
+	}
+	
+	// endAddress is the last byte of the session
+	return indexEntry->endAddress & ~(FLASH_PAGE_SIZE - 1);
+}
+
+
+unsigned char session_read_summary(unsigned short index, struct tSessionSummary *summary){
+	unsigned long address = session_summary_address(index);
+	
+	if(address == SESSION_NO_SUMMARY){
+		memset(summary, 0xFF, sizeof(struct tSessionSummary));
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+	
+	// The review screens come back to the same summaries
+	return flash_cache_read(address, sizeof(struct tSessionSummary), (unsigned char *)summary);
+}
+
+
+// Samples from page * RECORD_DATA_PER_PAGE on of a stored session laid out as a
+// tRecordDataPage, so hosts can read packed sessions without the codec. Samples
+// past the end of the session read back as 0xFF.
+unsigned char session_read_samples(unsigned short index, unsigned short page, struct tRecordDataPage *legacy){
+	struct tSessionIndexEntry *indexEntry;
+	struct tRecordPackedPage packed;
+	unsigned int first = (unsigned int)page * RECORD_DATA_PER_PAGE;
+	unsigned int offset;
+	unsigned long pages;
+	unsigned long low = 0;
+	unsigned long high;
+	unsigned long middle;
+	unsigned long probe;
+	unsigned char stored = 0;
+	
+	memset(legacy, 0xFF, sizeof(struct tRecordDataPage));
+	
+	if(index >= session_count()){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+	
+	indexEntry = &session.index[session_slot(session.state.tail + index)];
+	
+	if( !(indexEntry->flags & SESSION_INDEX_LOADED) ){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+	
+	pages = (session_distance(indexEntry->startAddress, indexEntry->endAddress) + 1) / FLASH_PAGE_SIZE;
+	if(indexEntry->flags & SESSION_INDEX_SUMMARY){
+		pages--;
+	}
+	
+	// Unpacked sessions are stored this way already
+	if( !(indexEntry->flags & SESSION_INDEX_PACKED) ){
+		if(page >= pages){
+			return DATAFLASH_RESPONSE_FAILURE;
+		}
+		
+		return flash_ReadToBuffer(session_address_after(indexEntry->startAddress, page), FLASH_PAGE_SIZE, (unsigned char *)legacy);
+	}
+	
+	// Narrow down to a GPS page starting at or before the first sample. Pages of
+	// the other streams sit in between, probe for the nearest GPS page instead.
+	high = pages;
+	while( (high - low) > 1 ){
+		middle = (low + high) / 2;
+		
+		for(probe = middle; probe > low; probe--){
+			if( session_read_packed(indexEntry->startAddress, probe, &packed) ){
+				break;
+			}
+		}
+		
+		if(probe == low){
+			for(probe = middle + 1; probe < high; probe++){
+				if( session_read_packed(indexEntry->startAddress, probe, &packed) ){
+					break;
+				}
+			}
+			
+			if(probe == high){
+				break;
+			}
+		}
+		
+		if(packed.firstSample <= first){
+			low = probe;
+		}else{
+			high = probe;
+		}
+	}
+	
+	// Samples run on across page boundaries
+	for( ; (stored < RECORD_DATA_PER_PAGE) && (low < pages); low++){
+		if( !session_read_packed(indexEntry->startAddress, low, &packed) ){
+			continue;
+		}
+		
+		if( (first + stored) < packed.firstSample ){
+			break;
+		}
+		
+		offset = first + stored - packed.firstSample;
+		if(offset >= packed.sampleCount){
+			continue;
+		}
+		
+		if(stored == 0){
+			legacy->utc = packed.utc;
+			legacy->hdop = packed.hdop;
+			legacy->currentMode = packed.currentMode;
+			legacy->satellites = packed.satellites;
+		}
+		
+		stored += codec_page_expand(&packed, offset, RECORD_DATA_PER_PAGE - stored, &legacy->data[stored]);
+	}
+	
+	if(stored == 0){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+	
+	legacy->pageType = RECORD_PAGE_DATA;
+	legacy->sequence = record_page_sequence(session.state.tail + index, page);
+	legacy->crc = session_page_crc((unsigned char *)legacy, legacy->sequence);
+	
+	return DATAFLASH_RESPONSE_OK;
+}
+
+
+// Reads a page of a stored session, FALSE unless it holds packed GPS samples
+unsigned char session_read_packed(unsigned long startAddress, unsigned long index, struct tRecordPackedPage *packed){
+	
+	flash_ReadToBuffer(session_address_after(startAddress, index), FLASH_PAGE_SIZE, (unsigned char *)packed);
+	
+	return (packed->pageType == RECORD_PAGE_PACKED);
+}
+
+
+// Index 0 is the oldest session still stored, answered from the RAM index
+unsigned char session_read_entry(unsigned short index, struct tRecordsEntry *entry){
+	struct tSessionIndexEntry *indexEntry;
+
+	memset(entry, 0xFF, sizeof(struct tRecordsEntry));
+
+	if(index >= session_count()){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	indexEntry = &session.index[session_slot(session.state.tail + index)];
+
+	if( !(indexEntry->flags & SESSION_INDEX_LOADED) ){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	entry->recordEmpty = FALSE;
+	entry->trackID = indexEntry->trackID;
+	
+	if(indexEntry->flags & SESSION_INDEX_SUMMARY){
+		entry->flags &= ~RECORD_FLAG_SUMMARY;
+	}
+	
+	if(indexEntry->flags & SESSION_INDEX_PACKED){
+		entry->flags &= ~RECORD_FLAG_PACKED;
+	}
+	
+	if(indexEntry->flags & SESSION_INDEX_HEADING){
+		entry->flags &= ~RECORD_FLAG_HEADING;
+	}
+	
+	entry->datestamp = indexEntry->datestamp;
+	entry->startAddress = indexEntry->startAddress;
+	entry->endAddress = indexEntry->endAddress;
+
+	return DATAFLASH_RESPONSE_OK;
+}
+
+
+unsigned char session_reclaim_oldest( void ){
+
+	if(session_count() == 0){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	journal_delete(JOURNAL_TYPE_RECORD, session_slot(session.state.tail));
+	session.state.tail++;
+
+	return session_save_state();
+}
+
+
+// A 1.30 part kept its record table where the journal now starts and its sessions
+// from right after it. Sessions that lie in the new record data region keep their
+// entries, the ones the journal sits on top of are dropped.
+void session_migrate_v130( void ){
+	struct tRecordsEntry entry;
+	unsigned short count = 0;
+	unsigned short i;
+	unsigned long writeAddress;
+
+	// The journal's first write erases the table, so all of it is read first. The
+	// RAM index holds the entries until then, it is rebuilt on mount anyway.
+	for(i = 0; i < FLASH_V130_RECORDS_NUM; i++){
+		flash_ReadToBuffer(FLASH_V130_RECORDTABLE_START + (i * sizeof(entry)), sizeof(entry), (unsigned char *)&entry);
+
+		// Entries were appended from the start, the first empty one ends the table
+		if(entry.recordEmpty){
+			break;
+		}
+
+		if( (entry.startAddress < flash.layout.recordDataStart) || (entry.startAddress > flash.layout.recordDataEnd) || (entry.endAddress < entry.startAddress) ){
+			continue;
+		}
+
+		// 1.30 ran up to the end of the part, the spares are cut off
+		if(entry.endAddress > flash.layout.recordDataEnd){
+			entry.endAddress = flash.layout.recordDataEnd;
+		}
+
+		session.index[count].startAddress = entry.startAddress;
+		session.index[count].endAddress = entry.endAddress;
+		session.index[count].datestamp = entry.datestamp;
+		session.index[count].trackID = entry.trackID;
+		count++;
+	}
+
+	if(i != count){
+		debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "1.30 sessions under the journal dropped");
+	}
+
+	if(count == 0){
+		return;
+	}
+
+	session.state.tail = 0;
+	session.state.head = 0;
+	session.state.lap = 0;
+
+	// Plain data pages, no summary and the raw NAV-VELNED heading
+	entry.recordEmpty = FALSE;
+	entry.flags = 0xFF;
+	entry.reserved1 = 0xFF;
+
+	for(i = 0; i < count; i++){
+		entry.trackID = session.index[i].trackID;
+		entry.datestamp = session.index[i].datestamp;
+		entry.startAddress = session.index[i].startAddress;
+		entry.endAddress = session.index[i].endAddress;
+
+		if( journal_write(JOURNAL_TYPE_RECORD, session_slot(session.state.head), (unsigned char *)&entry, sizeof(entry)) == DATAFLASH_RESPONSE_FAILURE ){
+			debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Record table write failed");
+			break;
+		}
+
+		session.state.head++;
+	}
+
+	if(session.state.head == 0){
+		return;
+	}
+
+	// Recording carries on behind the newest session that made it
+	writeAddress = (session.index[session.state.head - 1].endAddress | (FLASH_PAGE_SIZE - 1)) + 1;
+	if(writeAddress > flash.layout.recordDataEnd){
+		writeAddress = flash.layout.recordDataStart;
+		session.state.lap++;
+	}
+	session.state.writeAddress = writeAddress;
+
+	session_save_state();
+
+	debug_log(DEBUG_PRIORITY_INFO, DEBUG_SENDER_FLASH, "Sessions migrated from 1.30");
+}
+
+
+// Drop one stored session, index 0 is the oldest. The record table entry goes
+// first so a reset never finds an entry pointing at erased pages.
+unsigned char session_delete(unsigned short index){
+	struct tSessionIndexEntry *entry;
+	unsigned short slot;
+	unsigned long first, last;
+
+	if(index >= session_count()){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	slot = session_slot(session.state.tail + index);
+	entry = &session.index[slot];
+
+	if( !(entry->flags & SESSION_INDEX_LOADED) ){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	// Deletes are only staged, they have to be on the part before the pages go
+	if( (journal_delete(JOURNAL_TYPE_RECORD, slot) == DATAFLASH_RESPONSE_FAILURE) || (journal_flush() == DATAFLASH_RESPONSE_FAILURE) ){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	entry->flags = 0;
+
+	// Only erase the sectors the session has to itself, partial sectors at either end hold pages of its neighbours
+	first = (entry->startAddress + FLASH_4KB - 1) & ~(FLASH_4KB - 1);
+	last = (entry->endAddress + 1) & ~(FLASH_4KB - 1);
+
+	if(entry->endAddress >= entry->startAddress){
+		if(last > first){
+			flash_eraseRange(first, last - 1);
+		}
+	}else{
+		// Wrapped around the end of the region
+		if(first < flash.layout.recordDataEnd){
+			flash_eraseRange(first, flash.layout.recordDataEnd);
+		}
+		if(last > flash.layout.recordDataStart){
+			flash_eraseRange(flash.layout.recordDataStart, last - 1);
+		}
+	}
+
+	// Deleted sessions at the old end of the log give their slots back right away
+	while( session_count() && !(session.index[session_slot(session.state.tail)].flags & SESSION_INDEX_LOADED) ){
+		session_reclaim_oldest();
+	}
+
+	return DATAFLASH_RESPONSE_OK;
+}
+
+
+// Called when the write pointer enters a new sector. Normally the idle time
+// pre-erase got there first, otherwise erase it now.
+unsigned char session_prepare_sector(unsigned long address){
+
+	if( session.erasedCount && (address == session.erasedStart) ){
+		session.erasedStart = session_sector_after(address, 1);
+		session.erasedCount--;
+		return DATAFLASH_RESPONSE_OK;
+	}
+
+	if( session_erase_sector(address) == DATAFLASH_RESPONSE_FAILURE ){
+		debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Session filled the flash");
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	session.erasedStart = session_sector_after(address, 1);
+	session.erasedCount = 0;
+
+	return DATAFLASH_RESPONSE_OK;
+}
+
+
+// Sessions overlapping the sector are the oldest ones in the log, drop them and erase the sector
+unsigned char session_erase_sector(unsigned long address){
+	struct tSessionIndexEntry *oldest;
+
+	// The open session went all the way around and would overwrite its own start
+	if( ((session.current.startAddress & ~(FLASH_4KB - 1)) == address) && !session.current.recordEmpty ){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	while( session_count() ){
+		oldest = &session.index[session_slot(session.state.tail)];
+
+		// An entry that could not be read back is dropped as soon as the write pointer needs room
+		if( (oldest->flags & SESSION_INDEX_LOADED) &&
+			((oldest->startAddress & ~(FLASH_4KB - 1)) != address) &&
+			(session_distance(oldest->startAddress, address) > session_distance(oldest->startAddress, oldest->endAddress)) ){
+			break;
+		}
+
+		session_reclaim_oldest();
+	}
+
+	if( journal_flush() == DATAFLASH_RESPONSE_FAILURE ){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	if( flash_eraseBlock(FLASH_CMD_BLOCK_ERASE_4KB, address) == DATAFLASH_RESPONSE_FAILURE ){
+		debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_FLASH, "Erase Failed");
+	}
+
+	return DATAFLASH_RESPONSE_OK;
+}
+
+
+// Drop every session and erase the whole record data region
+unsigned char session_erase_all( void ){
+
+	while( session_count() ){
+		journal_delete(JOURNAL_TYPE_RECORD, session_slot(session.state.tail));
+		session.state.tail++;
+	}
+
+	if( (session_save_state() == DATAFLASH_RESPONSE_FAILURE) || (journal_flush() == DATAFLASH_RESPONSE_FAILURE) ){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	flash_eraseRecordedData();
+
+	// Every sector got one more erase, same as a full pass of the write pointer
+	session.state.lap++;
+	session.state.writeAddress = flash.layout.recordDataStart;
+	session_save_state();
+
+	flash_clr_full_flag();
+	session_start_at(session.state.writeAddress);
+	session_preerase_reset();
+
+	return DATAFLASH_RESPONSE_OK;
+}
+
+
+// Forget what was erased ahead, used whenever the write pointer is moved
+void session_preerase_reset( void ){
+	unsigned long address = session.current.endAddress;
+
+	if( (session.regionSize != 0) && (address & (FLASH_4KB - 1)) ){
+		address = session_sector_after(address & ~(FLASH_4KB - 1), 1);
+	}
+
+	session.erasedStart = address;
+	session.erasedCount = 0;
+}
+
+
+unsigned char session_preerase_pending( void ){
+	unsigned long address;
+
+	if( (session.regionSize == 0) || flash_full_flag() || (session.erasedCount >= SESSION_PREERASE_SECTORS) ){
+		return FALSE;
+	}
+
+	// Stop short of the start of the open session, it may still close before getting there
+	address = session_sector_after(session.erasedStart, session.erasedCount);
+	if( ((session.current.startAddress & ~(FLASH_4KB - 1)) == address) && !session.current.recordEmpty ){
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+// Erase one more sector ahead of the write pointer, run while the flash task is idle
+unsigned char session_preerase( void ){
+
+	if( !session_preerase_pending() ){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	if( session_erase_sector(session_sector_after(session.erasedStart, session.erasedCount)) == DATAFLASH_RESPONSE_FAILURE ){
+		return DATAFLASH_RESPONSE_FAILURE;
+	}
+
+	session.erasedCount++;
+
+	return DATAFLASH_RESPONSE_OK;
+}
+
+
+// Address a number of pages further around the log
+unsigned long session_address_after(unsigned long address, unsigned long pages){
+	return flash.layout.recordDataStart + ((address - flash.layout.recordDataStart + (pages * FLASH_PAGE_SIZE)) % session.regionSize);
+}
+
+
+// Sector boundary a number of sectors further around the log
+unsigned long session_sector_after(unsigned long address, unsigned short sectors){
+	return flash.layout.recordDataStart + ((address - flash.layout.recordDataStart + ((unsigned long)sectors * FLASH_4KB)) % session.regionSize);
+}
+
+
+unsigned char session_used_percent( void ){
+	struct tRecordsEntry oldest;
+	unsigned long start = session.current.startAddress;
+
+	if(session.regionSize == 0){
+		return 0;
+	}
+
+	if( flash_full_flag() ){
+		return 100;
+	}
+
+	if( session_read_entry(0, &oldest) == DATAFLASH_RESPONSE_OK ){
+		start = oldest.startAddress;
+	}
+
+	return (session_distance(start, session.current.endAddress) * 100) / session.regionSize;
+}
+
+
+// Record data page index as seen over USB, wraps with the log
+unsigned long session_page_address(unsigned int index){
+
+	if(session.regionSize == 0){
+		return flash.layout.recordDataStart;
+	}
+
+	return flash.layout.recordDataStart + ((index % (session.regionSize / FLASH_PAGE_SIZE)) * FLASH_PAGE_SIZE);
+}
+
+
+// Bytes from one address to another going forward around the log
+unsigned long session_distance(unsigned long from, unsigned long to){
+
+	if(to >= from){
+		return to - from;
+	}
+
+	return session.regionSize - (from - to);
+}
+
+
+void session_start_at(unsigned long address){
+	session.resumed = FALSE;
+	session.current.recordEmpty = TRUE;
+	session.current.trackID = 0xFF;
+	session.current.flags = (unsigned char)~RECORD_FLAG_HEADING;		// Everything recorded now has GPS_HEADING_SCALE headings
+	session.current.reserved1 = 0xFF;
+	session.current.startAddress = address;
+	session.current.endAddress = address;
+}
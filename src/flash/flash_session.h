@@ -0,0 +1,109 @@
+/******************************************************************************
+ *
+ * Record Session Log Include
+ *
+ * - Compiler:          GNU GCC for AVR32
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+
+#ifndef FLASH_SESSION_H_
+#define FLASH_SESSION_H_
+
+#include "hal.h"
+
+#define session_slot(number)		((number) % flash.layout.sessionSlots)
+#define session_count()				((unsigned short)(session.state.head - session.state.tail))
+
+#define SESSION_INDEX_LOADED		0x01	// Record table entry was read back intact
+#define SESSION_INDEX_SUMMARY		0x02	// Last page of the session is its summary
+#define SESSION_INDEX_PACKED		0x04	// Samples are on tRecordPackedPage pages
+#define SESSION_INDEX_HEADING		0x08	// Headings are in hundredths of a degree
+
+// Index of FLASH_MGR_READ_RECORD_SAMPLES, page counts RECORD_DATA_PER_PAGE samples at a time
+#define session_samples_index(index, page)	(((unsigned int)(index) << 16) | ((page) & 0xFFFF))
+
+#define SESSION_NO_SUMMARY			0xFFFFFFFF
+#define SESSION_NO_CHECKPOINT		0xFFFFFFFF
+
+#define SESSION_PREERASE_SECTORS	2		// Sectors kept erased ahead of the write pointer
+
+// RAM copy of a record table entry, indexed by session slot
+struct __attribute__ ((packed)) tSessionIndexEntry {
+	unsigned int startAddress;
+	unsigned int endAddress;
+	unsigned int datestamp;
+	unsigned char trackID;
+	unsigned char flags;
+};	// tSessionIndexEntry - 14 Bytes
+
+struct tSessionLog {
+	struct tSessionLogState state;		// Persisted in the journal
+	struct tRecordsEntry current;		// Session being recorded, endAddress is the next page to program
+	unsigned int regionSize;
+	
+	unsigned int erasedStart;			// Next sector boundary the write pointer will cross
+	unsigned char erasedCount;			// Sectors from erasedStart on that are already erased
+	
+	struct tSessionCheckpoint checkpoint;	// Recording state of a session resumed on mount
+	unsigned char resumed;				// The open session was recorded before the last reset
+	
+	struct tSessionIndexEntry index[RECORDS_TOTAL_POSSIBLE];
+};
+
+void session_mount( void );
+void session_load_index( void );
+unsigned char session_recover( void );
+unsigned char session_resume(unsigned long pages);
+unsigned char session_checkpoint(struct tSessionCheckpoint *checkpoint);
+unsigned char session_page_valid(unsigned long index, unsigned char *page);
+void session_stamp_page(unsigned char *page);
+unsigned short session_page_crc(unsigned char *page, unsigned int sequence);
+void session_index_store(unsigned short slot, struct tRecordsEntry *entry);
+unsigned char session_save_state( void );
+unsigned char session_add_page(unsigned char *bufferPointer, unsigned short length);
+unsigned char session_close( void );
+unsigned char session_add_summary(struct tSessionSummary *summary);
+unsigned long session_summary_address(unsigned short index);
+unsigned char session_read_summary(unsigned short index, struct tSessionSummary *summary);
+unsigned char session_read_samples(unsigned short index, unsigned short page, struct tRecordDataPage *legacy);
+unsigned char session_read_packed(unsigned long startAddress, unsigned long index, struct tRecordPackedPage *packed);
+unsigned char session_read_entry(unsigned short index, struct tRecordsEntry *entry);
+unsigned char session_reclaim_oldest( void );
+void session_migrate_v130( void );
+unsigned char session_delete(unsigned short index);
+unsigned char session_prepare_sector(unsigned long address);
+unsigned char session_erase_sector(unsigned long address);
+void session_preerase_reset( void );
+unsigned char session_preerase_pending( void );
+unsigned char session_preerase( void );
+unsigned long session_address_after(unsigned long address, unsigned long pages);
+unsigned long session_sector_after(unsigned long address, unsigned short sectors);
+unsigned char session_erase_all( void );
+unsigned char session_used_percent( void );
+unsigned long session_page_address(unsigned int index);
+unsigned long session_distance(unsigned long from, unsigned long to);
+void session_start_at(unsigned long address);
+
+#endif /* FLASH_SESSION_H_ */
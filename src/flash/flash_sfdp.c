@@ -0,0 +1,235 @@
+/******************************************************************************
+ *
+ * Serial Flash Discoverable Parameters
+ *
+ * - Compiler:          GNU GCC for AVR32
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+
+#include "flash_sfdp.h"
+
+
+const struct tFlashFamily sfdpFamilies[] = {
+	{0x1F, 0xB0, 0xD0},		// Atmel / Adesto
+	{0xEF, 0x75, 0x7A},		// Winbond
+	{0xC2, 0xB0, 0x30},		// Macronix
+	{0xC8, 0x75, 0x7A},		// GigaDevice
+	{0x20, 0x75, 0x7A},		// Micron
+	{0x9D, 0x75, 0x7A},		// ISSI
+};
+
+// Erase time units of DWORD10 and chip erase time units of DWORD11, in milliseconds
+const unsigned short sfdpEraseUnit[4] = {1, 16, 128, 1000};
+const unsigned int sfdpChipEraseUnit[4] = {16, 256, 4000, 64000};
+
+
+// DWORD number as counted by JESD216, starting at 1. Tables are little endian whatever the CPU is.
+unsigned long sfdp_dword(unsigned char *table, unsigned char number){
+	unsigned char *dword = &table[(number - 1) * 4];
+
+	return ((unsigned long)dword[3] << 24) | ((unsigned long)dword[2] << 16) | ((unsigned long)dword[1] << 8) | dword[0];
+}
+
+
+// Erase size an erase type of 2^exponent bytes stands for, FLASH_ERASE_SIZES if the driver doesn't use it
+enum tFlashEraseSize sfdp_erase_size(unsigned char exponent){
+
+	switch(exponent){
+		case(12):
+			return FLASH_ERASE_4KB;
+
+		case(15):
+			return FLASH_ERASE_32KB;
+
+		case(16):
+			return FLASH_ERASE_64KB;
+
+		default:
+			return FLASH_ERASE_SIZES;
+	}
+}
+
+
+// Checks the SFDP header and locates the basic flash parameter table from the first
+// parameter header, 0 if the part has no usable SFDP tables
+unsigned char sfdp_find_basic(unsigned char *header, unsigned long *tableAddress, unsigned char *tableDwords){
+
+	if( (sfdp_dword(header, 1) != SFDP_SIGNATURE) || (header[5] != SFDP_MAJOR_REVISION) ){
+		return 0;
+	}
+
+	if( (header[8] != SFDP_BASIC_ID) || (header[10] != SFDP_MAJOR_REVISION) || (header[11] < SFDP_BASIC_MIN_DWORDS) ){
+		return 0;
+	}
+
+	*tableAddress = sfdp_dword(header, 4) & 0x00FFFFFF;
+	*tableDwords = header[11];
+
+	if(*tableDwords > SFDP_BASIC_MAX_DWORDS){
+		*tableDwords = SFDP_BASIC_MAX_DWORDS;
+	}
+
+	return 1;
+}
+
+
+// Fills in what the basic flash parameter table describes. Suspend and power-down
+// opcodes are only touched when the table has the DWORDs for them, so family
+// defaults set beforehand stay. 0 if the part can't be driven with this driver.
+unsigned char sfdp_parse_basic(unsigned char *table, unsigned char dwords, struct tFlashPart *part){
+	unsigned long dword, density;
+	unsigned char sizes[4], commands[4];
+	unsigned char i, shift;
+	enum tFlashEraseSize eraseSize;
+
+	dword = sfdp_dword(table, 1);
+
+	// Parts that only take four byte addresses are out, three-or-four byte parts start in three
+	if( ((dword >> 17) & 0x03) == 0x02 ){
+		return 0;
+	}
+
+	density = sfdp_dword(table, 2);
+	if(density & 0x80000000){
+		density &= 0x7FFFFFFF;
+		if(density < 3){
+			return 0;
+		}
+		part->size = (density >= 27) ? SFDP_MAX_SIZE : (1UL << (density - 3));
+	}else{
+		part->size = (density >= ((SFDP_MAX_SIZE * 8UL) - 1)) ? SFDP_MAX_SIZE : ((density >> 3) + 1);
+	}
+
+	// Erase types of DWORD8 and DWORD9, the 4KB opcode of DWORD1 covers older tables
+	for(i = 0; i < FLASH_ERASE_SIZES; i++){
+		part->eraseCommand[i] = 0;
+	}
+
+	for(i = 0; i < 4; i++){
+		dword = sfdp_dword(table, 8 + (i / 2));
+		sizes[i] = (dword >> ((i & 1) * 16)) & 0xFF;
+		commands[i] = (dword >> (((i & 1) * 16) + 8)) & 0xFF;
+
+		eraseSize = sfdp_erase_size(sizes[i]);
+		if(eraseSize != FLASH_ERASE_SIZES){
+			part->eraseCommand[eraseSize] = commands[i];
+		}
+	}
+
+	dword = sfdp_dword(table, 1);
+	if( !part->eraseCommand[FLASH_ERASE_4KB] && ((dword & 0x03) == 0x01) ){
+		part->eraseCommand[FLASH_ERASE_4KB] = (dword >> 8) & 0xFF;
+	}
+
+	// Sectors are the unit everything is allocated in
+	if( !part->eraseCommand[FLASH_ERASE_4KB] ){
+		return 0;
+	}
+
+	// JESD216A added typical erase and program times
+	if(dwords >= 11){
+		dword = sfdp_dword(table, 10);
+
+		for(i = 0; i < 4; i++){
+			eraseSize = sfdp_erase_size(sizes[i]);
+			if(eraseSize == FLASH_ERASE_SIZES){
+				continue;
+			}
+
+			shift = 4 + (i * 7);
+			part->eraseTime[eraseSize] = (((dword >> shift) & 0x1F) + 1) * sfdpEraseUnit[(dword >> (shift + 5)) & 0x03];
+		}
+
+		dword = sfdp_dword(table, 11);
+
+		if( (1UL << ((dword >> 4) & 0x0F)) < SFDP_MIN_PAGE_SIZE ){
+			return 0;
+		}
+
+		// Page program is given in 8 or 64 microsecond units, round up to a millisecond
+		part->programTime = (((((dword >> 8) & 0x1F) + 1) * ((dword & (1UL << 13)) ? 64 : 8)) + 999) / 1000;
+		part->chipEraseTime = (((dword >> 24) & 0x1F) + 1) * sfdpChipEraseUnit[(dword >> 29) & 0x03];
+	}
+
+	// JESD216B added the suspend and deep power-down opcodes
+	if(dwords >= 13){
+		if( sfdp_dword(table, 12) & 0x80000000 ){
+			part->suspendCommand = 0;
+			part->resumeCommand = 0;
+		}else{
+			dword = sfdp_dword(table, 13);
+			part->suspendCommand = (dword >> 24) & 0xFF;
+			part->resumeCommand = (dword >> 16) & 0xFF;
+		}
+	}
+
+	if(dwords >= 14){
+		dword = sfdp_dword(table, 14);
+
+		if(dword & 0x80000000){
+			part->powerDownCommand = 0;
+			part->wakeUpCommand = 0;
+		}else{
+			part->powerDownCommand = (dword >> 23) & 0xFF;
+			part->wakeUpCommand = (dword >> 15) & 0xFF;
+		}
+	}
+
+	return 1;
+}
+
+
+// Standard opcodes and typical times, the size from the JEDEC capacity code and the
+// suspend opcodes of the family. 0 if the manufacturer isn't known, the part is then
+// only driven with what its SFDP tables say and erases aren't suspended.
+unsigned char sfdp_family_defaults(unsigned char manufacturer, unsigned char capacity, struct tFlashPart *part){
+	unsigned char i;
+
+	part->size = ( (capacity >= SFDP_CAPACITY_MIN) && (capacity <= SFDP_CAPACITY_MAX) ) ? (1UL << capacity) : 0;
+
+	part->eraseCommand[FLASH_ERASE_4KB]		= SFDP_CMD_ERASE_4KB;
+	part->eraseCommand[FLASH_ERASE_32KB]	= SFDP_CMD_ERASE_32KB;
+	part->eraseCommand[FLASH_ERASE_64KB]	= SFDP_CMD_ERASE_64KB;
+	part->powerDownCommand					= SFDP_CMD_DEEP_POWER_DOWN;
+	part->wakeUpCommand						= SFDP_CMD_WAKEUP;
+	part->suspendCommand					= 0;
+	part->resumeCommand						= 0;
+
+	part->programTime						= SFDP_DEFAULT_PROGRAM_TIME;
+	part->eraseTime[FLASH_ERASE_4KB]		= SFDP_DEFAULT_ERASE_4KB_TIME;
+	part->eraseTime[FLASH_ERASE_32KB]		= SFDP_DEFAULT_ERASE_32KB_TIME;
+	part->eraseTime[FLASH_ERASE_64KB]		= SFDP_DEFAULT_ERASE_64KB_TIME;
+	part->chipEraseTime						= SFDP_DEFAULT_CHIP_ERASE_TIME;
+
+	for(i = 0; i < (sizeof(sfdpFamilies) / sizeof(sfdpFamilies[0])); i++){
+		if(sfdpFamilies[i].manufacturer == manufacturer){
+			part->suspendCommand = sfdpFamilies[i].suspendCommand;
+			part->resumeCommand = sfdpFamilies[i].resumeCommand;
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,101 @@
+/******************************************************************************
+ *
+ * Serial Flash Discoverable Parameters Include
+ *
+ * - Compiler:          GNU GCC for AVR32
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+
+
+#ifndef FLASH_SFDP_H_
+#define FLASH_SFDP_H_
+
+// Works on tables already read from the part, so host software can build it as it is
+
+#define SFDP_CMD_READ					0x5A	// Three address bytes and one dummy byte, up to 50MHz
+
+#define SFDP_SIGNATURE					0x50444653	// "SFDP", stored little endian like every SFDP field
+#define SFDP_MAJOR_REVISION				1
+#define SFDP_HEADER_LENGTH				16		// SFDP header and the first parameter header, which JESD216 makes the basic table
+#define SFDP_BASIC_ID					0x00
+#define SFDP_BASIC_MIN_DWORDS			9		// JESD216, erase types but no timings
+#define SFDP_BASIC_MAX_DWORDS			16		// JESD216B, later DWORDs aren't used
+
+#define SFDP_MAX_SIZE					0x01000000	// Three byte addressing reaches 16MB, larger parts are used up to there
+#define SFDP_MIN_PAGE_SIZE				256		// Programs are split at 256 byte boundaries
+
+// Typical busy times for parts that don't publish them, in milliseconds
+#define SFDP_DEFAULT_PROGRAM_TIME		1
+#define SFDP_DEFAULT_ERASE_4KB_TIME		50
+#define SFDP_DEFAULT_ERASE_32KB_TIME	150
+#define SFDP_DEFAULT_ERASE_64KB_TIME	250
+#define SFDP_DEFAULT_CHIP_ERASE_TIME	40000
+
+// JEDEC capacity codes of families that follow the 2^n bytes convention
+#define SFDP_CAPACITY_MIN				0x15	// 2MB
+#define SFDP_CAPACITY_MAX				0x18	// 16MB
+
+// Standard opcodes the families share
+#define SFDP_CMD_ERASE_4KB				0x20
+#define SFDP_CMD_ERASE_32KB				0x52
+#define SFDP_CMD_ERASE_64KB				0xD8
+#define SFDP_CMD_DEEP_POWER_DOWN		0xB9
+#define SFDP_CMD_WAKEUP					0xAB
+
+enum tFlashEraseSize {
+	FLASH_ERASE_4KB,
+	FLASH_ERASE_32KB,
+	FLASH_ERASE_64KB,
+	FLASH_ERASE_SIZES
+};
+
+// What the driver needs to know about the part. Opcodes of 0 mean the part has no such command.
+struct tFlashPart {
+	unsigned long size;								// Bytes
+	unsigned char eraseCommand[FLASH_ERASE_SIZES];
+	unsigned char suspendCommand;					// Erase suspend and resume
+	unsigned char resumeCommand;
+	unsigned char powerDownCommand;					// Deep power-down enter and exit
+	unsigned char wakeUpCommand;
+
+	unsigned short programTime;						// Typical busy times in milliseconds
+	unsigned short eraseTime[FLASH_ERASE_SIZES];
+	unsigned int chipEraseTime;
+};
+
+// Erase suspend opcodes for parts whose SFDP tables predate JESD216B
+struct tFlashFamily {
+	unsigned char manufacturer;						// JEDEC manufacturer ID
+	unsigned char suspendCommand;
+	unsigned char resumeCommand;
+};
+
+unsigned long sfdp_dword(unsigned char *table, unsigned char number);
+enum tFlashEraseSize sfdp_erase_size(unsigned char exponent);
+unsigned char sfdp_find_basic(unsigned char *header, unsigned long *tableAddress, unsigned char *tableDwords);
+unsigned char sfdp_parse_basic(unsigned char *table, unsigned char dwords, struct tFlashPart *part);
+unsigned char sfdp_family_defaults(unsigned char manufacturer, unsigned char capacity, struct tFlashPart *part);
+
+#endif /* FLASH_SFDP_H_ */
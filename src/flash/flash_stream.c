@@ -0,0 +1,227 @@
+/******************************************************************************
+ *
+ * Record Streams
+ *
+ * - Compiler:          GNU GCC for AVR32
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+
+#include <asf.h>
+#include "hal.h"
+#include "string.h"
+
+//--------------------------
+// Structs
+//--------------------------
+struct tStreamLog streamLog;
+
+
+void stream_init( void ){
+	struct tRecordStreamPage *page;
+	unsigned char id, i;
+	
+	vSemaphoreCreateBinary(streamLog.lock);
+	streamLog.recording = FALSE;
+	
+	for(id = 0; id < RECORD_STREAM_COUNT; id++){
+		streamLog.stream[id].freeQueue = xQueueCreate( STREAM_PAGE_BUFFERS, sizeof(struct tRecordStreamPage *) );
+		streamLog.stream[id].filling = NULL;
+		streamLog.stream[id].entriesDropped = 0;
+		
+		for(i = 0; i < STREAM_PAGE_BUFFERS; i++){
+			page = &streamLog.stream[id].page[i];
+			xQueueSend(streamLog.stream[id].freeQueue, &page, pdFALSE);
+		}
+	}
+}
+
+
+// Called by the recorder when a session starts, entry times count from here
+void stream_start( void ){
+	unsigned short pageCount[RECORD_STREAM_COUNT];
+	
+	memset(pageCount, 0, sizeof(pageCount));
+	
+	stream_resume(0, pageCount);
+}
+
+
+// Carries on the streams of a resumed session. Time picks up where the session left
+// off, the gap of the reset itself is not counted.
+void stream_resume(unsigned int time, unsigned short *pageCount){
+	unsigned char id;
+	
+	xSemaphoreTake(streamLog.lock, portMAX_DELAY);
+	
+	streamLog.startTick = xTaskGetTickCount() - (time / portTICK_RATE_MS);
+	
+	for(id = 0; id < RECORD_STREAM_COUNT; id++){
+		streamLog.stream[id].pageCount = pageCount[id];
+		stream_page_start(id);
+	}
+	
+	streamLog.recording = TRUE;
+	
+	xSemaphoreGive(streamLog.lock);
+}
+
+
+// Queues the partly filled pages, they have to be ahead of the session's summary
+void stream_stop( void ){
+	unsigned char id;
+	
+	xSemaphoreTake(streamLog.lock, portMAX_DELAY);
+	
+	streamLog.recording = FALSE;
+	
+	for(id = 0; id < RECORD_STREAM_COUNT; id++){
+		stream_handoff(id, TASK_DELAY_MS(STREAM_FLUSH_WAIT_TIME));
+	}
+	
+	xSemaphoreGive(streamLog.lock);
+}
+
+
+// Stream positions of the session for a checkpoint
+void stream_checkpoint(struct tSessionCheckpoint *checkpoint){
+	unsigned char id;
+	
+	xSemaphoreTake(streamLog.lock, portMAX_DELAY);
+	
+	checkpoint->streamTime = (xTaskGetTickCount() - streamLog.startTick) * portTICK_RATE_MS;
+	
+	for(id = 0; id < RECORD_STREAM_COUNT; id++){
+		checkpoint->streamPages[id] = streamLog.stream[id].pageCount;
+	}
+	
+	xSemaphoreGive(streamLog.lock);
+}
+
+
+unsigned char stream_recording( void ){
+	return streamLog.recording;
+}
+
+
+// Appends an entry to a stream of the session being recorded, FALSE if nothing is recorded
+// or the stream has no page to put it in
+unsigned char stream_write(enum tRecordStreamId id, unsigned char type, void *entry, unsigned char length){
+	struct tStream *stream = &streamLog.stream[id];
+	struct tRecordStreamPage *page;
+	struct tRecordStreamEntry header;
+	unsigned int now;
+	unsigned char written = FALSE;
+	
+	xSemaphoreTake(streamLog.lock, portMAX_DELAY);
+	
+	if(streamLog.recording){
+		now = (xTaskGetTickCount() - streamLog.startTick) * portTICK_RATE_MS;
+		page = stream->filling;
+		
+		// The entry starts the next page when it doesn't fit or is too late to be timed against this one
+		if( (page != NULL) && (page->length != 0) &&
+			( ((page->length + sizeof(header) + length) > RECORD_STREAM_DATA_SIZE) || ((now - page->time) > 0xFFFF) ) ){
+			stream_handoff(id, 0);
+			page = stream->filling;
+		}
+		
+		if( (page == NULL) && (xQueueReceive(stream->freeQueue, &stream->filling, 0) == pdTRUE) ){
+			stream_page_start(id);
+			page = stream->filling;
+		}
+		
+		if( (page != NULL) && ((sizeof(header) + length) <= RECORD_STREAM_DATA_SIZE) ){
+			if(page->length == 0){
+				page->time = now;
+			}
+			
+			header.type = type;
+			header.length = length;
+			header.time = now - page->time;
+			
+			memcpy(&page->data[page->length], &header, sizeof(header));
+			memcpy(&page->data[page->length + sizeof(header)], entry, length);
+			page->length += sizeof(header) + length;
+			
+			written = TRUE;
+		}else{
+			incrementErrorCount(stream->entriesDropped);
+		}
+	}
+	
+	xSemaphoreGive(streamLog.lock);
+	
+	return written;
+}
+
+
+// Hands the filling page of a stream to the flash task, called with the lock held
+unsigned char stream_handoff(enum tRecordStreamId id, unsigned char delay){
+	struct tStream *stream = &streamLog.stream[id];
+	
+	if( (stream->filling == NULL) || (stream->filling->length == 0) ){
+		return FALSE;
+	}
+	
+	if( flash_send_request_async(FLASH_MGR_ADD_RECORD_DATA, (unsigned char *)stream->filling, sizeof(struct tRecordStreamPage), 0, stream_page_written, delay) == pdFALSE ){
+		// The page is lost, start it over
+		incrementErrorCount(stream->entriesDropped);
+		stream_page_start(id);
+		return FALSE;
+	}
+	
+	stream->pageCount++;
+	stream->filling = NULL;
+	
+	if( xQueueReceive(stream->freeQueue, &stream->filling, 0) == pdTRUE ){
+		stream_page_start(id);
+	}
+	
+	return TRUE;
+}
+
+
+void stream_page_start(enum tRecordStreamId id){
+	struct tRecordStreamPage *page = streamLog.stream[id].filling;
+	
+	if(page == NULL){
+		return;
+	}
+	
+	page->pageType = RECORD_PAGE_STREAM;
+	page->stream = id;
+	page->streamPage = streamLog.stream[id].pageCount;
+	page->length = 0;
+	page->time = 0;
+	memset(page->data, 0xFF, sizeof(page->data));
+}
+
+
+// Called from the flash task once a stream page has been programmed
+void stream_page_written(unsigned char *pointer){
+	struct tRecordStreamPage *page = (struct tRecordStreamPage *)pointer;
+	
+	xQueueSend(streamLog.stream[page->stream].freeQueue, &page, pdFALSE);
+}
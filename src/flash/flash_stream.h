@@ -0,0 +1,68 @@
+/******************************************************************************
+ *
+ * Record Streams Include
+ *
+ * - Compiler:          GNU GCC for AVR32
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+
+
+#ifndef FLASH_STREAM_H_
+#define FLASH_STREAM_H_
+
+#include "hal.h"
+
+#define STREAM_PAGE_BUFFERS			2			// Pages of each stream that can be in flight to the flash at once
+#define STREAM_FLUSH_WAIT_TIME		20			// Time (milliseconds) to wait for room in the flash queue when recording stops
+
+// Each stream fills its own pages, a page is handed to the flash task once full
+struct tStream {
+	struct tRecordStreamPage page[STREAM_PAGE_BUFFERS];
+	struct tRecordStreamPage *filling;		// NULL while every page is queued for the flash
+	xQueueHandle freeQueue;
+	
+	unsigned short pageCount;				// Pages handed to the flash task this session
+	unsigned char entriesDropped;
+};
+
+struct tStreamLog {
+	struct tStream stream[RECORD_STREAM_COUNT];
+	xSemaphoreHandle lock;					// Held while any stream is written
+	portTickType startTick;
+	unsigned char recording;
+};
+
+void stream_init( void );
+void stream_start( void );
+void stream_resume(unsigned int time, unsigned short *pageCount);
+void stream_checkpoint(struct tSessionCheckpoint *checkpoint);
+void stream_stop( void );
+unsigned char stream_recording( void );
+unsigned char stream_write(enum tRecordStreamId id, unsigned char type, void *entry, unsigned char length);
+unsigned char stream_handoff(enum tRecordStreamId id, unsigned char delay);
+void stream_page_start(enum tRecordStreamId id);
+void stream_page_written(unsigned char *pointer);
+
+#endif /* FLASH_STREAM_H_ */
@@ -58,6 +58,7 @@ void fuel_task( void *pvParameters ){
 	struct tFuelStatus		fuelStatus;
 	struct tFuelEEStatus	fuelEEStatus;
 	struct tADCvalues		adcValues;
+	struct tRecordHealthEntry	healthEntry;
 	struct tFuelRequest		request;
 	
 	#if (TRAQPAQ_BATTERY_TEST_MODE == TRUE)
@@ -140,6 +141,21 @@ void fuel_task( void *pvParameters ){
 		gpio_clr_gpio_pin(ADC_VREF_EN);
 		
 		
+		// ---------------------------------
+		// Log supply health while recording
+		// ---------------------------------
+		if( stream_recording() ){
+			healthEntry.voltage = fuel_read_voltage();
+			healthEntry.accumulatedCurrent = accumulated_current;
+			healthEntry.main = adcValues.main;
+			healthEntry.vcc = adcValues.vcc;
+			healthEntry.vee = adcValues.vee;
+			healthEntry.chargeState = oldChargeStatus;
+			healthEntry.reserved = 0xFF;
+			stream_write(RECORD_STREAM_HEALTH, RECORD_ENTRY_HEALTH, &healthEntry, sizeof(healthEntry));
+		}
+		
+		
 		// ---------------------------------
 		// Check if battery low
 		// ---------------------------------
@@ -34,10 +34,18 @@
 
 xQueueHandle gpsRxdQueue;
 xQueueHandle gpsManagerQueue;
+xQueueHandle gpsPageFreeQueue;
 xTimerHandle xReceiverDeadTimer, xReceiverCfgTimer;
 
 struct tGPSInfo gpsInfo;
 
+struct tRecordPackedPage gpsPages[GPS_PAGE_BUFFERS];		// Record data pages, filled here and written by the flash task
+struct tGPSSession gpsSession;
+struct tSessionCheckpoint gpsCheckpoint;					// Recording state handed to the flash task
+volatile unsigned char gpsCheckpointBusy = FALSE;			// gpsCheckpoint is queued for the flash task, don't touch it
+unsigned char gpsCheckpointPending = FALSE;					// A checkpoint was due while the last one was still queued
+struct tGPSPreroll gpsPreroll;
+
 __attribute__((__interrupt__)) static void ISR_gps_rxd(void){
 	int rxd;
 	
@@ -76,6 +84,7 @@ void gps_task_init( void ){
 	gpsInfo.error.unrecognizedMsgs = 0;
 	gpsInfo.error.rxDataError = 0;
 	gpsInfo.error.resetCount = 0;
+	gpsInfo.error.pagesDropped = 0;
 	
 	gpsInfo.lastCmd.class = 0;
 	gpsInfo.lastCmd.id = 0;
@@ -87,11 +96,15 @@ void gps_task_init( void ){
 	gpsInfo.current_location.latitude = 0;
 	gpsInfo.current_location.longitude = 0;
 	
+	gpsSession.finishLineSet = FALSE;
+	gpsSession.summary.trackID = 0xFF;
+	
 	// Set up the GPS manager task
 	#if( TRAQPAQ_GPS_EXTERNAL_LOGGING == FALSE )
 	if(systemFlags.button.powerOnMethod == POWER_ON_MODE_BUTTON){
 		gpsRxdQueue		= xQueueCreate( GPS_RXD_QUEUE_SIZE,     sizeof(int)     );
 		gpsManagerQueue = xQueueCreate( GPS_MANAGER_QUEUE_SIZE, sizeof(request) );
+		gpsPageFreeQueue = xQueueCreate( GPS_PAGE_BUFFERS, sizeof(struct tRecordPackedPage *) );
 
 		INTC_register_interrupt( (__int_handler) &ISR_gps_rxd, AVR32_USART3_IRQ, AVR32_INTC_INT0);
 
@@ -107,14 +120,14 @@ void gps_task_init( void ){
 void gps_task( void *pvParameters ){
 	unsigned char i;
 	unsigned int rxdChar;										// Temporary storage for received character queue
-	unsigned char recordIndex = 0;								// Index in formatted data struct
 	unsigned char oldMode = 0;
 	unsigned char calc_xsumA, calc_xsumB;
 	
 	unsigned int lapTime = 0, oldLapTime = 0;
 	unsigned int datestamp = 0;
 	
-	struct tRecordDataPage gpsData;							// Formatted GPS Data
+	struct tRecordPackedPage *gpsData, *nextPage;			// Formatted GPS Data
+	struct tRecordData gpsSample;							// Sample being assembled from the solution messages
 	struct tGPSLine finishLine;								// Formatted coordinate pairs for "finish line"
 	struct tTracklist trackList;
 	struct tGPSRequest request;
@@ -125,6 +138,36 @@ void gps_task( void *pvParameters ){
 	
 	gpsMessage.frameNumber = 0;			// Reset the Rx frame counter
 	
+	// All page buffers start out free, keep one to fill
+	for(i = 0; i < GPS_PAGE_BUFFERS; i++){
+		nextPage = &gpsPages[i];
+		codec_page_start(nextPage, 0);
+		xQueueSend(gpsPageFreeQueue, &nextPage, pdFALSE);
+	}
+	xQueueReceive(gpsPageFreeQueue, &gpsData, pdFALSE);
+	gpsSample.reserved = 0xFF;
+	gps_preroll_reset();
+	
+	// A reset cut the last session short, carry on recording it
+	flash_send_request(FLASH_MGR_READ_CHECKPOINT, &gpsCheckpoint, sizeof(gpsCheckpoint), NULL, TRUE, 20);
+	if(gpsCheckpoint.startAddress != SESSION_NO_CHECKPOINT){
+		if(gpsCheckpoint.trackID != 0xFF){
+			flash_send_request(FLASH_MGR_READ_TRACK, &trackList, sizeof(trackList), gpsCheckpoint.trackID, TRUE, 20);
+			finishLine = gps_find_finish_line(trackList.latitude, trackList.longitude, trackList.heading);
+			gpsSession.finishLineSet = (trackList.headingUnit == TRACKLIST_HEADING_CENTI);
+		}
+		
+		oldLapTime = 0xFFFFFFFF;
+		gps_session_resume(&gpsCheckpoint);
+		codec_page_start(gpsData, gpsSession.sampleCount);
+		gpsInfo.record_flag = TRUE;
+		
+		// Put the recording screen up so the rider can see and stop it
+		lcd_sendWidgetRequest(LCD_REQUEST_RECORDING_RESUMED, NULL, pdFALSE);
+		
+		debug_log(DEBUG_PRIORITY_INFO, DEBUG_SENDER_GPS, "Recording resumed");
+	}
+	
 	// Reset the flags for each solution
 	gpsRxdMessages.NAV_POSLLH = FALSE;
 	gpsRxdMessages.NAV_SOL = FALSE;
@@ -160,36 +203,58 @@ void gps_task( void *pvParameters ){
 		if( xQueueReceive(gpsManagerQueue, &request, pdFALSE) == pdTRUE ){
 			switch(request.command){
 				case(GPS_MGR_REQUEST_START_RECORDING):
+					// A resumed session is still open, the recording screen asks again when it comes up
+					if(gpsInfo.record_flag){
+						break;
+					}
+					
 					flash_send_request(FLASH_MGR_SET_DATESTAMP, NULL, NULL, datestamp, FALSE, pdFALSE);
 					lapTime = 0;
 					oldLapTime = 0xFFFFFFFF;
+					gps_session_start();
+					codec_page_start(gpsData, 0);
+					stream_start();
+					gpsData = gps_preroll_splice(gpsData, &finishLine);
+					gps_session_checkpoint();
 					gpsInfo.record_flag = TRUE;
 					break;
 					
 				case(GPS_MGR_REQUEST_STOP_RECORDING):
-					gpsInfo.record_flag = FALSE;
-					recordIndex = 0;
-					flash_send_request(FLASH_MGR_END_CURRENT_RECORD, NULL, NULL, NULL, FALSE, 20);
+					gpsData = gps_session_stop(gpsData);
 					break;
 					
 				case(GPS_MGR_REQUEST_SET_FINISH_POINT):
 					// Load the track, and then tell the flash that we are using it
 					flash_send_request(FLASH_MGR_READ_TRACK, &trackList, sizeof(trackList), request.data, TRUE, 20);
 					flash_send_request(FLASH_MGR_SET_TRACK, NULL, NULL, request.data, FALSE, 20);
-					finishLine = gps_find_finish_line(trackList.latitude, trackList.longitude, trackList.heading);
+					gpsSession.summary.trackID = request.data;
+					
+					if(trackList.headingUnit == TRACKLIST_HEADING_CENTI){
+						finishLine = gps_find_finish_line(trackList.latitude, trackList.longitude, trackList.heading);
+						gpsSession.finishLineSet = TRUE;
+					}else{
+						// The direction the line is crossed in was lost when the track was saved
+						debug_log(DEBUG_PRIORITY_WARNING, DEBUG_SENDER_GPS, "Track heading in old units, save it again");
+						gpsSession.finishLineSet = FALSE;
+					}
 					break;
 					
 				case(GPS_MGR_REQUEST_CREATE_NEW_TRACK):
-					itoa(gpsData.utc, &(trackList.name), 10, FALSE);
+					itoa(gpsData->utc, &(trackList.name), 10, FALSE);
 					trackList.heading = gpsInfo.current_location.heading;
 					trackList.longitude = gpsInfo.current_location.longitude;
 					trackList.latitude = gpsInfo.current_location.latitude;
 					trackList.isEmpty = FALSE;
-					trackList.reserved = 0xA5;
+					trackList.headingUnit = TRACKLIST_HEADING_CENTI;
 					flash_send_request(FLASH_MGR_ADD_TRACK, &trackList, NULL, NULL, FALSE, pdFALSE);
 					break;
 					
 				case(GPS_MGR_REQUEST_SHUTDOWN):					
+					// Only a reset resumes a session, powering off closes it
+					if(gpsInfo.record_flag){
+						gpsData = gps_session_stop(gpsData);
+					}
+					
 					gpio_clr_gpio_pin(GPS_RESET);	// Put the GPS into reset
 					debug_log(DEBUG_PRIORITY_INFO, DEBUG_SENDER_GPS, "Task shut down");
 					wdt_send_request(WDT_REQUEST_GPS_SHUTDOWN_COMPLETE, NULL);
@@ -371,16 +436,16 @@ void gps_task( void *pvParameters ){
 							case(UBX_NAV_POSLLH):
 								gpsRxdMessages.NAV_POSLLH = TRUE;
 								
-								gpsData.utc = gps_flip_endian4(gpsMessage.messages.NAV_PVT.iTOW);
+								gpsData->utc = gps_flip_endian4(gpsMessage.messages.NAV_PVT.iTOW);
 								
-								gpsData.data[recordIndex].latitude = gps_flip_endian4(gpsMessage.messages.NAV_POSLLH.lat);
-								gpsData.data[recordIndex].longitude = gps_flip_endian4(gpsMessage.messages.NAV_POSLLH.lon);
-								gpsData.data[recordIndex].altitude = (gps_flip_endian4(gpsMessage.messages.NAV_POSLLH.hMSL) / 100) & 0xFFFF;
+								gpsSample.latitude = gps_flip_endian4(gpsMessage.messages.NAV_POSLLH.lat);
+								gpsSample.longitude = gps_flip_endian4(gpsMessage.messages.NAV_POSLLH.lon);
+								gpsSample.altitude = (gps_flip_endian4(gpsMessage.messages.NAV_POSLLH.hMSL) / 100) & 0xFFFF;
 								
 									
 								// Copy over the current position info
-								gpsInfo.current_location.latitude = gpsData.data[recordIndex].latitude;
-								gpsInfo.current_location.longitude = gpsData.data[recordIndex].longitude;
+								gpsInfo.current_location.latitude = gpsSample.latitude;
+								gpsInfo.current_location.longitude = gpsSample.longitude;
 								
 								break;
 							
@@ -392,15 +457,15 @@ void gps_task( void *pvParameters ){
 							case(UBX_NAV_SOL):
 								gpsRxdMessages.NAV_SOL = TRUE;
 								
-								gpsData.utc = gps_flip_endian4(gpsMessage.messages.NAV_SOL.iTOW);
-								gpsData.hdop = gps_flip_endian2(gpsMessage.messages.NAV_SOL.pDOP);
-								gpsData.currentMode = gpsMessage.messages.NAV_SOL.gpsFix;
-								gpsData.satellites = gpsMessage.messages.NAV_SOL.numSV;
+								gpsData->utc = gps_flip_endian4(gpsMessage.messages.NAV_SOL.iTOW);
+								gpsData->hdop = gps_flip_endian2(gpsMessage.messages.NAV_SOL.pDOP);
+								gpsData->currentMode = gpsMessage.messages.NAV_SOL.gpsFix;
+								gpsData->satellites = gpsMessage.messages.NAV_SOL.numSV;
 								datestamp = gps_flip_endian2(gpsMessage.messages.NAV_SOL.week);
 
 								// Copy over the current position info
-								gpsInfo.satellites = gpsData.satellites;
-								gpsInfo.mode = gpsData.currentMode;
+								gpsInfo.satellites = gpsData->satellites;
+								gpsInfo.mode = gpsData->currentMode;
 
 								break;
 								
@@ -428,11 +493,11 @@ void gps_task( void *pvParameters ){
 							case(UBX_NAV_VELNED):
 								gpsRxdMessages.NAV_VELNED = TRUE;
 								
-								gpsData.data[recordIndex].speed = (unsigned short)gps_flip_endian4(gpsMessage.messages.NAV_VELNED.gSpeed);
-								gpsData.data[recordIndex].heading = (unsigned short)gps_flip_endian4(gpsMessage.messages.NAV_VELNED.heading);
+								gpsSample.speed = (unsigned short)gps_flip_endian4(gpsMessage.messages.NAV_VELNED.gSpeed);
+								gpsSample.heading = (unsigned short)(gps_flip_endian4(gpsMessage.messages.NAV_VELNED.heading) / GPS_HEADING_SCALE);
 								
 								// Copy the information over to the current location
-								gpsInfo.current_location.heading = gpsData.data[recordIndex].heading;
+								gpsInfo.current_location.heading = gpsSample.heading;
 								break;
 								
 							// *** Unknown NAV Message ***
@@ -678,12 +743,18 @@ void gps_task( void *pvParameters ){
 			gpsRxdMessages.NAV_VELNED = FALSE;
 			
 			if(gpsInfo.record_flag){
-				recordIndex++;
-				if(recordIndex == RECORD_DATA_PER_PAGE){
-					debug_tgl_pin1();
-					flash_send_request(FLASH_MGR_ADD_RECORD_DATA, &gpsData, sizeof(gpsData), NULL, TRUE, 20);
-					recordIndex = 0;
+				gps_session_sample(&gpsSample, gpsData->utc, &finishLine);
+				
+				codec_page_add(gpsData, &gpsSession.lastSample, &gpsSample);
+				gpsSession.lastSample = gpsSample;
+				
+				// Hand the page off once the worst case sample might not fit anymore
+				if( (gpsData->deltaLength + CODEC_DELTA_MAX) > RECORD_PACKED_DELTA_SIZE ){
+					debug_tgl_pin1();
+					gpsData = gps_page_handoff(gpsData);
 				}
+			}else if(gpsData->currentMode != GPS_MODE_NO_FIX){
+				gps_preroll_add(&gpsSample, gpsData);
 			}
 
 		}
@@ -693,6 +764,363 @@ void gps_task( void *pvParameters ){
 }
 
 
+// Called from the flash task once a record data page has been programmed
+void gps_page_written(unsigned char *pointer){
+	struct tRecordPackedPage *page = (struct tRecordPackedPage *)pointer;
+	
+	xQueueSend(gpsPageFreeQueue, &page, pdFALSE);
+}
+
+
+// Hands a filled page to the flash task and returns the next one to fill. A page
+// that can't be handed off is started over and its samples are lost.
+struct tRecordPackedPage *gps_page_handoff(struct tRecordPackedPage *page){
+	struct tRecordPackedPage *nextPage;
+	
+	// Only wait when every page buffer is still queued for the flash
+	if( xQueueReceive(gpsPageFreeQueue, &nextPage, TASK_DELAY_MS(GPS_PAGE_WAIT_TIME)) == pdTRUE ){
+		if( flash_send_request_async(FLASH_MGR_ADD_RECORD_DATA, (unsigned char *)page, sizeof(struct tRecordPackedPage), 0, gps_page_written, pdFALSE) == pdTRUE ){
+			gpsSession.pageCount++;
+			gpsSession.sampleCount += page->sampleCount;
+			
+			// Carry the page header over, later samples only update parts of it
+			codec_page_start(nextPage, gpsSession.sampleCount);
+			nextPage->utc = page->utc;
+			nextPage->hdop = page->hdop;
+			nextPage->currentMode = page->currentMode;
+			nextPage->satellites = page->satellites;
+			
+			if( ((gpsSession.pageCount % GPS_CHECKPOINT_PAGES) == 0) || gpsCheckpointPending ){
+				gps_session_checkpoint();
+			}
+			
+			return nextPage;
+		}
+		
+		xQueueSend(gpsPageFreeQueue, &nextPage, pdFALSE);
+	}
+	
+	incrementErrorCount(gpsInfo.error.pagesDropped);
+	codec_page_start(page, gpsSession.sampleCount);
+	
+	return page;
+}
+
+void gps_session_start( void ){
+	struct tSessionSummary *summary = &gpsSession.summary;
+	
+	summary->pageType = RECORD_PAGE_SUMMARY;
+	summary->lapCount = 0;
+	summary->bestLap = SESSION_SUMMARY_NO_LAP;
+	summary->maxSpeed = 0;
+	summary->distance = 0;
+	summary->startUtc = 0;
+	summary->duration = 0;
+	summary->bestLapTime = 0xFFFFFFFF;
+	memset(summary->lap, 0xFF, sizeof(summary->lap));
+	
+	gpsSession.distance = 0;
+	gpsSession.pageCount = 0;
+	gpsSession.sampleCount = 0;
+	gpsSession.lapStarted = FALSE;
+	gpsSession.haveSample = FALSE;
+	gpsSession.resumed = FALSE;
+}
+
+
+// Closes the session with its summary, returns the page to fill next
+struct tRecordPackedPage *gps_session_stop(struct tRecordPackedPage *page){
+	
+	gpsInfo.record_flag = FALSE;
+	gpsCheckpointPending = FALSE;
+	
+	// The partly filled page goes out ahead of the summary
+	if(page->sampleCount){
+		page = gps_page_handoff(page);
+	}
+	stream_stop();
+	
+	// Queued behind the last record pages, wait so the next session can't overwrite it
+	gps_session_finish();
+	flash_send_request(FLASH_MGR_ADD_SESSION_SUMMARY, &gpsSession.summary, sizeof(struct tSessionSummary), NULL, TRUE, 20);
+	flash_send_request(FLASH_MGR_END_CURRENT_RECORD, NULL, NULL, NULL, FALSE, 20);
+	
+	return page;
+}
+
+
+// Restores the statistics of a session cut short by a reset. The first sample
+// after the gap is not measured against the last one before it.
+void gps_session_resume(struct tSessionCheckpoint *checkpoint){
+	struct tSessionSummary *summary = &gpsSession.summary;
+	unsigned short streamPages[RECORD_STREAM_COUNT];
+	unsigned char i;
+	
+	gps_session_start();
+	
+	summary->trackID = checkpoint->trackID;
+	summary->lapCount = checkpoint->lapCount;
+	summary->bestLap = checkpoint->bestLap;
+	summary->maxSpeed = checkpoint->maxSpeed;
+	summary->startUtc = checkpoint->startUtc;
+	summary->bestLapTime = checkpoint->bestLapTime;
+	
+	for(i = 0; i < SESSION_SUMMARY_MAX_LAPS; i++){
+		summary->lap[i].time = checkpoint->lap[i].time;
+		summary->lap[i].startPage = checkpoint->lap[i].startPage;
+	}
+	
+	gpsSession.distance = checkpoint->distance;
+	gpsSession.pageCount = checkpoint->pageCount;
+	gpsSession.sampleCount = checkpoint->sampleCount;
+	gpsSession.lastUtc = checkpoint->lastUtc;
+	gpsSession.lapStarted = checkpoint->lapStarted;
+	gpsSession.lapStartUtc = checkpoint->lapStartUtc;
+	gpsSession.lapStartPage = checkpoint->lapStartPage;
+	gpsSession.resumed = TRUE;
+	
+	memcpy(streamPages, checkpoint->streamPages, sizeof(streamPages));
+	stream_resume(checkpoint->streamTime, streamPages);
+}
+
+
+// Queues the recording state for the journal without waiting on the flash task. While
+// the last checkpoint is still queued this one is put off to the next page handoff.
+void gps_session_checkpoint( void ){
+	struct tSessionSummary *summary = &gpsSession.summary;
+	unsigned char i;
+	
+	if(gpsCheckpointBusy){
+		gpsCheckpointPending = TRUE;
+		return;
+	}
+	
+	gpsCheckpoint.sampleCount = gpsSession.sampleCount;
+	gpsCheckpoint.pageCount = gpsSession.pageCount;
+	gpsCheckpoint.maxSpeed = summary->maxSpeed;
+	gpsCheckpoint.distance = gpsSession.distance;
+	gpsCheckpoint.startUtc = summary->startUtc;
+	gpsCheckpoint.lastUtc = gpsSession.lastUtc;
+	
+	gpsCheckpoint.lapStarted = gpsSession.lapStarted;
+	gpsCheckpoint.lapCount = summary->lapCount;
+	gpsCheckpoint.bestLap = summary->bestLap;
+	gpsCheckpoint.reserved = 0xFF;
+	gpsCheckpoint.lapStartUtc = gpsSession.lapStartUtc;
+	gpsCheckpoint.bestLapTime = summary->bestLapTime;
+	gpsCheckpoint.lapStartPage = gpsSession.lapStartPage;
+	
+	for(i = 0; i < SESSION_SUMMARY_MAX_LAPS; i++){
+		gpsCheckpoint.lap[i].time = summary->lap[i].time;
+		gpsCheckpoint.lap[i].startPage = summary->lap[i].startPage;
+	}
+	
+	stream_checkpoint(&gpsCheckpoint);
+	
+	gpsCheckpointBusy = TRUE;
+	gpsCheckpointPending = FALSE;
+	
+	if( flash_send_request_async(FLASH_MGR_SAVE_CHECKPOINT, (unsigned char *)&gpsCheckpoint, sizeof(gpsCheckpoint), 0, gps_checkpoint_written, pdFALSE) != pdTRUE ){
+		gpsCheckpointBusy = FALSE;
+		gpsCheckpointPending = TRUE;
+	}
+}
+
+
+// Called from the flash task once the checkpoint is in the journal
+void gps_checkpoint_written(unsigned char *pointer){
+	gpsCheckpointBusy = FALSE;
+}
+
+
+// Runs once per complete solution while recording, before the sample's page is handed off
+void gps_session_sample(struct tRecordData *sample, unsigned int utc, struct tGPSLine *finishLine){
+	struct tSessionSummary *summary = &gpsSession.summary;
+	struct tRecordLapEntry lapEntry;
+	unsigned int lapTime = 0;
+	
+	sample->lapDetected = FALSE;
+	
+	if(sample->speed > summary->maxSpeed){
+		summary->maxSpeed = sample->speed;
+	}
+	
+	if(gpsSession.haveSample){
+		// cm/s over milliseconds
+		gpsSession.distance += ((unsigned int)sample->speed * gps_time_between(gpsSession.lastUtc, utc)) / 1000;
+		
+		if( gpsSession.finishLineSet &&
+			gps_intersection(gpsSession.lastLongitude, gpsSession.lastLatitude, sample->longitude, sample->latitude,
+							 finishLine->startLongitude, finishLine->startLatitude, finishLine->endLongitude, finishLine->endLatitude,
+							 sample->heading, finishLine->heading) ){
+			sample->lapDetected = TRUE;
+			
+			// The first crossing only starts the clock
+			if(gpsSession.lapStarted){
+				lapTime = gps_time_between(gpsSession.lapStartUtc, utc);
+				
+				if(summary->lapCount < SESSION_SUMMARY_MAX_LAPS){
+					summary->lap[summary->lapCount].time = lapTime;
+					summary->lap[summary->lapCount].startPage = gpsSession.lapStartPage;
+				}
+				
+				if(lapTime < summary->bestLapTime){
+					summary->bestLap = summary->lapCount;
+					summary->bestLapTime = lapTime;
+				}
+				
+				if(summary->lapCount < (SESSION_SUMMARY_NO_LAP - 1)){
+					summary->lapCount++;
+				}
+			}
+			
+			lapEntry.utc = utc;
+			lapEntry.lapTime = lapTime;
+			lapEntry.lap = summary->lapCount;
+			memset(lapEntry.reserved, 0xFF, sizeof(lapEntry.reserved));
+			stream_write(RECORD_STREAM_EVENT, RECORD_ENTRY_LAP, &lapEntry, sizeof(lapEntry));
+			
+			gpsSession.lapStarted = TRUE;
+			gpsSession.lapStartUtc = utc;
+			gpsSession.lapStartPage = gpsSession.pageCount;
+		}
+	}else if(!gpsSession.resumed){
+		summary->startUtc = utc;
+	}
+	
+	gpsSession.lastLatitude = sample->latitude;
+	gpsSession.lastLongitude = sample->longitude;
+	gpsSession.lastUtc = utc;
+	gpsSession.haveSample = TRUE;
+	
+	// Laps are too valuable to wait for the next checkpoint
+	if(sample->lapDetected){
+		gps_session_checkpoint();
+	}
+}
+
+
+void gps_session_finish( void ){
+	struct tSessionSummary *summary = &gpsSession.summary;
+	
+	summary->distance = gpsSession.distance / 100;
+	
+	if(gpsSession.haveSample){
+		summary->duration = gps_time_between(summary->startUtc, gpsSession.lastUtc);
+	}
+}
+
+
+void gps_preroll_reset( void ){
+	gpsPreroll.head = 0;
+	gpsPreroll.count = 0;
+	gpsPreroll.skip = 0;
+	codec_page_start(&gpsPreroll.page[0], 0);
+}
+
+
+// Called once per solution with a fix while not recording. Costs one delta encode for
+// every GPS_PREROLL_DECIMATION'th solution, the oldest page is overwritten once the ring is full.
+void gps_preroll_add(struct tRecordData *sample, struct tRecordPackedPage *header){
+	struct tRecordPackedPage *page = &gpsPreroll.page[gpsPreroll.head];
+	
+	if( (page->sampleCount || gpsPreroll.count) && (gps_time_between(gpsPreroll.lastUtc, header->utc) > GPS_PREROLL_GAP_TIME) ){
+		gps_preroll_reset();
+		page = &gpsPreroll.page[gpsPreroll.head];
+	}
+	
+	gpsPreroll.lastUtc = header->utc;
+	
+	if(gpsPreroll.skip){
+		gpsPreroll.skip--;
+		return;
+	}
+	gpsPreroll.skip = GPS_PREROLL_DECIMATION - 1;
+	
+	codec_page_add(page, &gpsPreroll.lastSample, sample);
+	gpsPreroll.lastSample = *sample;
+	
+	page->utc = header->utc;
+	page->hdop = header->hdop;
+	page->currentMode = header->currentMode;
+	page->satellites = header->satellites;
+	
+	if( (page->deltaLength + CODEC_DELTA_MAX) > RECORD_PACKED_DELTA_SIZE ){
+		gpsPreroll.head = (gpsPreroll.head + 1) % GPS_PREROLL_PAGES;
+		if(gpsPreroll.count < (GPS_PREROLL_PAGES - 1)){
+			gpsPreroll.count++;
+		}
+		
+		codec_page_start(&gpsPreroll.page[gpsPreroll.head], 0);
+	}
+}
+
+
+// Records the pre-roll as the start of the session that is starting, oldest sample
+// first, and empties the ring. Returns the page to fill next.
+struct tRecordPackedPage *gps_preroll_splice(struct tRecordPackedPage *page, struct tGPSLine *finishLine){
+	struct tRecordPackedPage *preroll;
+	struct tRecordData samples[GPS_PREROLL_SPLICE_CHUNK];
+	unsigned int utc, before;
+	unsigned int liveUtc = page->utc;
+	unsigned short liveHdop = page->hdop;
+	unsigned char liveMode = page->currentMode;
+	unsigned char liveSatellites = page->satellites;
+	unsigned char first, count, i, p;
+	
+	for(p = gpsPreroll.count + 1; p > 0; p--){
+		preroll = &gpsPreroll.page[(gpsPreroll.head + GPS_PREROLL_PAGES + 1 - p) % GPS_PREROLL_PAGES];
+		
+		for(first = 0; first < preroll->sampleCount; first += count){
+			count = codec_page_expand(preroll, first, GPS_PREROLL_SPLICE_CHUNK, samples);
+			if(count == 0){
+				break;
+			}
+			
+			for(i = 0; i < count; i++){
+				// Kept solutions are GPS_PREROLL_DECIMATION * GPS_UBX_MSG_RATE apart, the page holds the time of its last one
+				before = (preroll->sampleCount - 1 - (first + i)) * (GPS_UBX_MSG_RATE * GPS_PREROLL_DECIMATION);
+				utc = (preroll->utc >= before) ? (preroll->utc - before) : (preroll->utc + GPS_WEEK_MS - before);
+				
+				page->utc = utc;
+				page->hdop = preroll->hdop;
+				page->currentMode = preroll->currentMode;
+				page->satellites = preroll->satellites;
+				
+				gps_session_sample(&samples[i], utc, finishLine);
+				codec_page_add(page, &gpsSession.lastSample, &samples[i]);
+				gpsSession.lastSample = samples[i];
+				
+				if( (page->deltaLength + CODEC_DELTA_MAX) > RECORD_PACKED_DELTA_SIZE ){
+					page = gps_page_handoff(page);
+				}
+			}
+		}
+	}
+	
+	// The solution being received belongs after the pre-roll
+	page->utc = liveUtc;
+	page->hdop = liveHdop;
+	page->currentMode = liveMode;
+	page->satellites = liveSatellites;
+	
+	gps_preroll_reset();
+	
+	return page;
+}
+
+
+// Milliseconds between two GPS times of week
+unsigned int gps_time_between(unsigned int from, unsigned int to){
+	
+	if(to >= from){
+		return to - from;
+	}
+	
+	return (to + GPS_WEEK_MS) - from;
+}
+
+
 void gps_reset( void ){
 	gpio_clr_gpio_pin(GPS_RESET);
 	vTaskDelay( (portTickType)TASK_DELAY_MS(GPS_RESET_TIME) );
@@ -709,10 +1137,11 @@ unsigned char gps_intersection(signed int x1, signed int y1, signed int x2, sign
 	signed short angleDiff;
 	
 	// Calculate the denominator
-    denominator = (x2 - x1)*(y4 - y3) - (y2 - y1)*(x4 - x3);
+    // Products of coordinate differences overflow an int away from the line
+    denominator = (float)(x2 - x1)*(y4 - y3) - (float)(y2 - y1)*(x4 - x3);
     
-    ua = ((float)((x4 - x3) * (y1 - y3) - (y4 - y3) * (x1 - x3))) / denominator;
-    ub = ((float)((x2 - x1) * (y1 - y3) - (y2 - y1) * (x1 - x3))) / denominator;
+    ua = ((float)(x4 - x3) * (y1 - y3) - (float)(y4 - y3) * (x1 - x3)) / denominator;
+    ub = ((float)(x2 - x1) * (y1 - y3) - (float)(y2 - y1) * (x1 - x3)) / denominator;
 
     // Calulate the point of intersection
     //long = x1+ua*(x2 - x1);
@@ -42,6 +42,16 @@
 #define GPS_TX_TIME					2						// Time in milliseconds in between Tx
 #define GPS_RXD_QUEUE_SIZE			100						// Number of items to buffer in Receive Queue
 #define GPS_MANAGER_QUEUE_SIZE		5						// Number of items to buffer in Request 
+#define GPS_PAGE_BUFFERS			3						// Record data pages that can be in flight to the flash at once
+#define GPS_PAGE_WAIT_TIME			20						// Time (milliseconds) to wait for a free page buffer
+#define GPS_CHECKPOINT_PAGES		16						// Record data pages between checkpoints of the recording state, laps are checkpointed as they happen
+#define GPS_PREROLL_MINUTES			5						// Time (minutes) of samples kept while not recording
+#define GPS_PREROLL_DECIMATION		5						// Every how many solutions one is kept while not recording
+#define GPS_PREROLL_PAGE_SAMPLES	24						// Decimated samples expected on a packed page, their deltas are larger than at the full rate
+#define GPS_PREROLL_SAMPLES			((GPS_PREROLL_MINUTES * 60000UL) / (GPS_UBX_MSG_RATE * GPS_PREROLL_DECIMATION))
+#define GPS_PREROLL_PAGES			(((GPS_PREROLL_SAMPLES + GPS_PREROLL_PAGE_SAMPLES - 1) / GPS_PREROLL_PAGE_SAMPLES) + 1)	// One more for the page being filled
+#define GPS_PREROLL_SPLICE_CHUNK	8						// Samples decoded at a time when the pre-roll starts a session
+#define GPS_PREROLL_GAP_TIME		1000					// Time (milliseconds) between solutions that starts the pre-roll over
 
 #define GPS_WAIT_RXD_TIME			20						// Time (milliseconds) to wait for a received character
 #define GPS_MSG_MAX_LENGTH			108
@@ -54,6 +64,8 @@
 #define EARTH_RADIUS_FEET			20891000	// Approximate radius of earth in feet;
 #define THRESHOLD_DISTANCE			((float)THRESHOLD_DISTANCE_FEET / (float)EARTH_RADIUS_FEET) // Do not modify, instead modify 'THRESHOLD_DISTANCE_FEET'
 #define THRESHOLD_ANGLE				2250			// Threshold (+/-) in degrees for finish line gate, two assumed decimal places
+#define GPS_HEADING_SCALE			1000			// NAV-VELNED heading is 1e-5 degrees, stored with two assumed decimal places
+#define GPS_WEEK_MS					604800000		// Time of week wraps here
 
 #define RADIANS_CONVERSION			0.0174532925	// Value of (Pi / 180)
 
@@ -480,6 +492,7 @@ struct tGPSError {
 	unsigned char unrecognizedMsgs;
 	unsigned char rxDataError;
 	unsigned char resetCount;
+	unsigned char pagesDropped;
 };
 
 struct tGPSLastCmd {
@@ -525,6 +538,42 @@ struct tGPSInfo {
 };
 
 
+// Every GPS_PREROLL_DECIMATION'th solution of the last GPS_PREROLL_MINUTES with a fix,
+// kept packed the same way they are recorded. A gap in the solutions starts the ring
+// over, samples are evenly spaced.
+struct tGPSPreroll {
+	struct tRecordPackedPage page[GPS_PREROLL_PAGES];
+	unsigned char head;				// Page being filled
+	unsigned char count;			// Full pages ahead of it
+	unsigned char skip;				// Solutions still to be left out before the next one is kept
+	unsigned int lastUtc;			// Time of the last solution, kept or not
+	struct tRecordData lastSample;
+};
+
+
+// Statistics of the session being recorded, closed off with its summary page
+struct tGPSSession {
+	struct tSessionSummary summary;
+	
+	signed int lastLatitude;
+	signed int lastLongitude;
+	unsigned int lastUtc;
+	unsigned short heading;			// Course over ground of the last sample, two assumed decimal places
+	
+	unsigned int distance;			// Centimeters
+	unsigned int lapStartUtc;
+	unsigned short lapStartPage;
+	unsigned short pageCount;		// Pages handed to the flash task so far
+	unsigned int sampleCount;		// Samples on those pages
+	struct tRecordData lastSample;	// Deltas of the next sample are taken against this one
+	
+	unsigned char finishLineSet;
+	unsigned char lapStarted;
+	unsigned char haveSample;
+	unsigned char resumed;			// Picked up from a checkpoint after a reset, startUtc is already known
+};
+
+
 struct tGPSChecksum {
 	unsigned char xsumA;
 	unsigned char xsumB;
@@ -559,6 +608,20 @@ struct tGPSChecksum {
 void gps_task_init( void );
 void gps_task( void *pvParameters );
 void gps_reset( void );
+void gps_page_written(unsigned char *pointer);
+struct tRecordPackedPage *gps_page_handoff(struct tRecordPackedPage *page);
+
+void gps_session_start( void );
+struct tRecordPackedPage *gps_session_stop(struct tRecordPackedPage *page);
+void gps_session_resume(struct tSessionCheckpoint *checkpoint);
+void gps_session_checkpoint( void );
+void gps_checkpoint_written(unsigned char *pointer);
+void gps_preroll_reset( void );
+void gps_preroll_add(struct tRecordData *sample, struct tRecordPackedPage *header);
+struct tRecordPackedPage *gps_preroll_splice(struct tRecordPackedPage *page, struct tGPSLine *finishLine);
+void gps_session_sample(struct tRecordData *sample, unsigned int utc, struct tGPSLine *finishLine);
+void gps_session_finish( void );
+unsigned int gps_time_between(unsigned int from, unsigned int to);
 
 void gps_buffer_tokenize( void );
 unsigned short gps_received_checksum( void );
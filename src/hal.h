@@ -39,10 +39,15 @@
 #include "semphr.h"
 
 // Dataflash
-#include "flash/flash.h"
+#include "flash/flash_manager_request.h"
 #include "flash/flash_layout.h"
+#include "flash/flash_codec.h"
+#include "flash/flash_sfdp.h"
+#include "flash/flash.h"
 #include "flash/flash_otp_layout.h"
-#include "flash/flash_manager_request.h"
+#include "flash/flash_journal.h"
+#include "flash/flash_session.h"
+#include "flash/flash_stream.h"
 
 // Fuel Gauge
 #include "fuel/fuel.h"
@@ -57,6 +57,9 @@ xTimerHandle xScreenRedrawTimer;
 // Create task for FreeRTOS
 void lcd_task_init( void ){
 	if(systemFlags.button.powerOnMethod == POWER_ON_MODE_BUTTON){
+		// Created here so the GPS task can post to it before the GUI task first runs
+		lcdWidgetsManagerQueue = xQueueCreate(LCD_WIDGET_QUEUE_SIZE, sizeof(struct tLCDRequest));
+		
 		xPeripherialTimer = xTimerCreate( "PeripheralTimer",	// Timer Name
 										(portTickType) (LCD_PERIPHERIAL_FADE_TIME * configTICK_RATE_HZ),	// Timer period (in ticks)
 										pdFALSE,				// Auto-reload
@@ -87,6 +90,7 @@ void lcd_gui_task_normal( void *pvParameters ){
 	
 	struct tTracklist trackList;
 	struct tRecordsEntry recordTable;
+	struct tSessionSummary sessionSummary;
 	
 	unsigned char tempString[20];
 	unsigned char responseU8;
@@ -98,7 +102,6 @@ void lcd_gui_task_normal( void *pvParameters ){
 	unsigned char button;
 	unsigned short lcd_fsm = LCDFSM_MAINMENU;		// Useful for testing new screens!
 	
-	lcdWidgetsManagerQueue = xQueueCreate(LCD_WIDGET_QUEUE_SIZE, sizeof(request));
 	lcdButtonsManagerQueue	= xQueueCreate(LCD_BUTTON_QUEUE_SIZE, sizeof(unsigned char));
 	
 	// Make sure the battery isn't low before continuing
@@ -190,6 +193,11 @@ void lcd_gui_task_normal( void *pvParameters ){
 				case(LCD_REQUEST_UPDATE_OLDLAPTIME):
 					lcd_updateLapTimer( request.data, &oldLapHourLabel, &oldLapMinuteLabel, &oldLapSecondLabel, &oldLapMilliLabel, TRUE );
 					break;
+					
+				case(LCD_REQUEST_RECORDING_RESUMED):
+					lcd_force_redraw();
+					lcd_change_screens( LCDFSM_START_RECORD );
+					break;
 			}
 		}
 		
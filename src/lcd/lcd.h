@@ -396,6 +396,7 @@ struct tLCDTopBar {
 #define LCD_REQUEST_UPDATE_OLDLAPTIME	6
 
 #define LCD_REQUEST_SHUTDOWN			7
+#define LCD_REQUEST_RECORDING_RESUMED	8	// GPS picked an open session back up after a reset
 
 struct tLCDRequest {
 	unsigned char action;
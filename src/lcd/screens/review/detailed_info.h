@@ -37,6 +37,18 @@ if(lcd_redraw_required()){
 	lcd_writeText_16x32("Track", FONT_LARGE_POINTER, LCD_MIN_X, LCD_MAX_Y-LCD_TOPBAR_THICKNESS - 32, COLOR_BLACK);
 	lcd_writeText_16x32(trackList.name, FONT_LARGE_POINTER, LCD_MIN_X + 112, LCD_MAX_Y-LCD_TOPBAR_THICKNESS - 32, COLOR_BLACK);
 	
+	// One page read, laps come from the summary written when the session was closed
+	flash_send_request(FLASH_MGR_READ_SESSION_SUMMARY, &sessionSummary, NULL, screenArgs, TRUE, 20);
+	if(sessionSummary.pageType == RECORD_PAGE_SUMMARY){
+		lcd_writeText_16x32("Laps", FONT_LARGE_POINTER, LCD_MIN_X, LCD_MAX_Y-LCD_TOPBAR_THICKNESS - 64, COLOR_BLACK);
+		lcd_writeText_16x32(itoa(sessionSummary.lapCount, &tempString, 10, FALSE), FONT_LARGE_POINTER, LCD_MIN_X + 112, LCD_MAX_Y-LCD_TOPBAR_THICKNESS - 64, COLOR_BLACK);
+		
+		if(sessionSummary.bestLap != SESSION_SUMMARY_NO_LAP){
+			lcd_writeText_16x32("Best", FONT_LARGE_POINTER, LCD_MIN_X, LCD_MAX_Y-LCD_TOPBAR_THICKNESS - 96, COLOR_BLACK);
+			lcd_writeText_16x32(itoa(sessionSummary.bestLapTime / 1000, &tempString, 10, FALSE), FONT_LARGE_POINTER, LCD_MIN_X + 112, LCD_MAX_Y-LCD_TOPBAR_THICKNESS - 96, COLOR_BLACK);
+		}
+	}
+	
 	//itoa(recordData.data[0].utc, &tempString, 10)
 	
 	lcd_redraw_complete();
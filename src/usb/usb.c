@@ -123,11 +123,26 @@ void usb_task( void *pvParameters ){
 				flash_send_request(FLASH_MGR_READ_RECORDATA, &usbTx.message.CMD_READ_RECORD_DATA, usbTx.msgLength, usbRx.message.CMD_READ_RECORD_DATA.index, TRUE, pdFALSE);
 				break;
 				
+			case(USB_CMD_READ_RECORDSAMPLES):
+				usbTx.msgLength = sizeof(usbTx.message.CMD_READ_RECORD_SAMPLES);
+				flash_send_request(FLASH_MGR_READ_RECORD_SAMPLES, &usbTx.message.CMD_READ_RECORD_SAMPLES, usbTx.msgLength, session_samples_index(usbRx.message.CMD_READ_RECORD_SAMPLES.index, usbRx.message.CMD_READ_RECORD_SAMPLES.page), TRUE, pdFALSE);
+				break;
+				
 			case(USB_DBG_READ_ADC):			// 51d
 				usbTx.msgLength = sizeof(usbTx.message.DBG_READ_ADC_VALUES);
 				fuel_send_request(FUEL_MGR_REQUEST_ADC_VALUES, NULL, &usbTx.message.DBG_READ_ADC_VALUES, TRUE, NULL);
 				break;
 				
+			case(USB_DBG_DF_TELEMETRY):
+				usbTx.msgLength = sizeof(usbTx.message.DBG_FLASH_TELEMETRY);
+				flash_send_request(FLASH_MGR_READ_TELEMETRY, &usbTx.message.DBG_FLASH_TELEMETRY, usbTx.msgLength, NULL, TRUE, pdFALSE);
+				break;
+				
+			case(USB_DBG_DF_CACHE_STATS):
+				usbTx.msgLength = sizeof(usbTx.message.DBG_FLASH_CACHE_STATS);
+				flash_send_request(FLASH_MGR_READ_CACHE_STATS, &usbTx.message.DBG_FLASH_CACHE_STATS, usbTx.msgLength, NULL, TRUE, pdFALSE);
+				break;
+				
 			case(USB_DBG_DF_SECTOR_ERASE):
 				usbTx.msgLength = sizeof(usbTx.message.DBG_FLASH_SECTOR_ERASE);
 				flash_send_request(FLASH_MGR_SECTOR_ERASE, NULL, NULL, usbRx.message.DBG_FLASH_SECTOR_ERASE.index, FALSE, pdFALSE);
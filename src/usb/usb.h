@@ -73,12 +73,15 @@
 #define USB_CMD_WRITE_RECORDDATA		0x1B
 #define USB_CMD_READ_OTP				0x1C
 #define USB_CMD_WRITE_OTP				0x1D
+#define USB_CMD_READ_RECORDSAMPLES		0x1E	// Record data of any session laid out as unpacked pages
 
 // Debug Commands
 #define USB_DBG_SEND_DF_CMD				0x30	// Send a command to the dataflash
 #define USB_DBG_READ_PM_PGOOD1			0x31	// Read the PM_PGOOD1 for the power supply
 #define USB_DBG_READ_PM_PGOOD3			0x32	// Read the PM_PGOOD3 for the power supply
 #define USB_DBG_READ_ADC				0x33	// Read the ADC values
+#define USB_DBG_DF_TELEMETRY			0x34	// Read the dataflash erase counters and operation statistics
+#define USB_DBG_DF_CACHE_STATS			0x35	// Read the dataflash page cache hit and miss counters
 #define USB_DBG_SEND_GPS_CMD			0x36	// Send a command to the GPS
 #define USB_DBG_READ_CHG_STAT			0x37	// Read the status for the charging
 #define USB_DBG_SEND_FUEL_CMD			0x38	// Send a command to the fuel gauge
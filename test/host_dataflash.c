@@ -0,0 +1,353 @@
+/******************************************************************************
+ *
+ * Host Dataflash Glue
+ *
+ * - Compiler:          GNU GCC, host build
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+
+
+#include <stdio.h>
+#include <string.h>
+#include <asf.h>
+#include "hal.h"
+#include "sim_dataflash.h"
+#include "host_dataflash.h"
+
+#define HOST_PDCA_CHANNELS			2
+
+struct tHostPdca {
+	volatile unsigned char *address;
+	unsigned int size;
+	unsigned char enabled;
+	unsigned char complete;
+};
+
+// The board sets the identification clock up before the flash task starts
+volatile avr32_spi_t AVR32_SPI0 = { { APPL_PBA_SPEED / FLASH_SPI_BAUDRATE } };
+
+portBASE_TYPE hostSchedulerState = taskSCHEDULER_NOT_STARTED;
+unsigned char hostPrintLog = FALSE;
+unsigned int hostWarnings = 0;
+char hostLastLog[HOST_LOG_SIZE];
+
+unsigned short hostReceived;						// Last byte shifted in, what SPI RDR would hold
+unsigned char hostOpcode;							// First byte written since chip select
+unsigned int hostWritten;							// Bytes written since chip select
+struct tHostPdca hostPdca[HOST_PDCA_CHANNELS];
+unsigned char hostQueue;							// Something for queue handles to point at
+
+
+void host_reset( void ){
+	AVR32_SPI0.CSR0.scbr = APPL_PBA_SPEED / FLASH_SPI_BAUDRATE;
+	hostSchedulerState = taskSCHEDULER_NOT_STARTED;
+	hostWarnings = 0;
+	hostLastLog[0] = 0;
+	memset(hostPdca, 0, sizeof(hostPdca));
+}
+
+
+//--------------------------
+// SPI
+//--------------------------
+int spi_selectChip(volatile avr32_spi_t *spi, unsigned char chip){
+	(void)chip;
+
+	sim_set_clock(APPL_PBA_SPEED / spi->CSR0.scbr);
+	sim_select();
+
+	hostWritten = 0;
+
+	return 0;
+}
+
+int spi_unselectChip(volatile avr32_spi_t *spi, unsigned char chip){
+	(void)spi;
+	(void)chip;
+
+	sim_deselect();
+
+	return 0;
+}
+
+int spi_write(volatile avr32_spi_t *spi, unsigned short data){
+	(void)spi;
+
+	if(hostWritten++ == 0){
+		hostOpcode = data & 0xFF;
+	}
+
+	hostReceived = sim_transfer(data & 0xFF);
+
+	return 0;
+}
+
+// The status register bitfields in flash.h are declared from the most significant bit
+// down, the way the AVR32 allocates them. GCC on a little endian host starts from the
+// least significant bit, so status bytes are handed over mirrored to land on the same fields.
+unsigned char host_status_order(unsigned char status){
+#if defined(__ORDER_LITTLE_ENDIAN__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+	unsigned char mirrored = 0;
+	unsigned char i;
+
+	for(i = 0; i < 8; i++){
+		if(status & (1 << i)){
+			mirrored |= 0x80 >> i;
+		}
+	}
+
+	return mirrored;
+#else
+	return status;
+#endif
+}
+
+int spi_read(volatile avr32_spi_t *spi, unsigned short *data){
+	(void)spi;
+
+	*data = (hostOpcode == DATAFLASH_CMD_READ_STATUS) ? host_status_order(hostReceived) : hostReceived;
+
+	return 0;
+}
+
+int spi_writeEndCheck(volatile avr32_spi_t *spi){
+	(void)spi;
+
+	return 1;
+}
+
+
+//--------------------------
+// PDCA
+//--------------------------
+void pdca_load_channel(unsigned int channel, volatile void *address, unsigned int size){
+	hostPdca[channel].address = address;
+	hostPdca[channel].size = size;
+	hostPdca[channel].enabled = FALSE;
+	hostPdca[channel].complete = FALSE;
+}
+
+// The transmit channel drives the clock. With the receive channel armed it's a read
+// and only clocks out filler, the driver points it at the start of the CPU flash.
+void pdca_enable(unsigned int channel){
+	struct tHostPdca *tx = &hostPdca[FLASH_SPI_TX_PDCA_CHANNEL];
+	struct tHostPdca *rx = &hostPdca[FLASH_SPI_RX_PDCA_CHANNEL];
+	unsigned int i;
+
+	hostPdca[channel].enabled = TRUE;
+
+	if(channel != FLASH_SPI_TX_PDCA_CHANNEL){
+		return;
+	}
+
+	if( rx->enabled && !rx->complete ){
+		for(i = 0; i < tx->size; i++){
+			hostReceived = sim_transfer(DATAFLASH_CMD_DUMMY);
+			if(i < rx->size){
+				rx->address[i] = hostReceived;
+			}
+		}
+		rx->complete = TRUE;
+	}else{
+		for(i = 0; i < tx->size; i++){
+			hostReceived = sim_transfer(tx->address[i]);
+		}
+	}
+
+	tx->complete = TRUE;
+}
+
+void pdca_disable(unsigned int channel){
+	hostPdca[channel].enabled = FALSE;
+}
+
+unsigned int pdca_get_transfer_status(unsigned int channel){
+	return hostPdca[channel].complete ? PDCA_TRANSFER_COMPLETE : 0;
+}
+
+void pdca_enable_interrupt_transfer_complete(unsigned int channel){
+	(void)channel;
+}
+
+void pdca_disable_interrupt_transfer_complete(unsigned int channel){
+	(void)channel;
+}
+
+
+//--------------------------
+// GPIO, interrupts and delays
+//--------------------------
+void gpio_set_gpio_pin(unsigned int pin){
+	(void)pin;
+}
+
+void gpio_clr_gpio_pin(unsigned int pin){
+	(void)pin;
+}
+
+void INTC_register_interrupt(__int_handler handler, unsigned int irq, unsigned int level){
+	(void)handler;
+	(void)irq;
+	(void)level;
+}
+
+void cpu_delay_us(unsigned long delay, unsigned long cpuSpeed){
+	(void)cpuSpeed;
+
+	sim_advance(delay * 1000ULL);
+}
+
+
+//--------------------------
+// FreeRTOS
+//--------------------------
+portTickType xTaskGetTickCount( void ){
+	return simFlash.time / (1000000ULL * portTICK_RATE_MS);
+}
+
+void vTaskDelay(portTickType ticks){
+	sim_advance(ticks * (1000000ULL * portTICK_RATE_MS));
+}
+
+portBASE_TYPE xTaskGetSchedulerState( void ){
+	return hostSchedulerState;
+}
+
+void vTaskSuspend(xTaskHandle task){
+	(void)task;
+}
+
+void vTaskResume(xTaskHandle task){
+	(void)task;
+}
+
+xTaskHandle xTaskGetCurrentTaskHandle( void ){
+	return NULL;
+}
+
+portBASE_TYPE xTaskCreate(void (*code)(void *), const signed char *name, unsigned short stackDepth, void *parameters, unsigned portBASE_TYPE priority, xTaskHandle *created){
+	(void)code;
+	(void)name;
+	(void)stackDepth;
+	(void)parameters;
+	(void)priority;
+	(void)created;
+
+	return pdPASS;
+}
+
+// No other tasks, so queues are never anything but empty and nobody takes from them
+xQueueHandle xQueueCreate(unsigned portBASE_TYPE length, unsigned portBASE_TYPE itemSize){
+	(void)length;
+	(void)itemSize;
+
+	return &hostQueue;
+}
+
+portBASE_TYPE xQueueSend(xQueueHandle queue, const void *item, portTickType wait){
+	(void)queue;
+	(void)item;
+	(void)wait;
+
+	return errQUEUE_FULL;
+}
+
+portBASE_TYPE xQueueSendToFront(xQueueHandle queue, const void *item, portTickType wait){
+	return xQueueSend(queue, item, wait);
+}
+
+portBASE_TYPE xQueueSendToBack(xQueueHandle queue, const void *item, portTickType wait){
+	return xQueueSend(queue, item, wait);
+}
+
+portBASE_TYPE xQueueSendFromISR(xQueueHandle queue, const void *item, portBASE_TYPE *woken){
+	(void)woken;
+
+	return xQueueSend(queue, item, 0);
+}
+
+portBASE_TYPE xQueueReceive(xQueueHandle queue, void *item, portTickType wait){
+	(void)queue;
+	(void)item;
+
+	vTaskDelay(wait);
+
+	return errQUEUE_EMPTY;
+}
+
+portBASE_TYPE xQueuePeek(xQueueHandle queue, void *item, portTickType wait){
+	return xQueueReceive(queue, item, wait);
+}
+
+unsigned portBASE_TYPE uxQueueMessagesWaiting(xQueueHandle queue){
+	(void)queue;
+
+	return 0;
+}
+
+portBASE_TYPE xSemaphoreTake(xSemaphoreHandle semaphore, portTickType wait){
+	(void)semaphore;
+	(void)wait;
+
+	return pdTRUE;
+}
+
+portBASE_TYPE xSemaphoreGive(xSemaphoreHandle semaphore){
+	(void)semaphore;
+
+	return pdTRUE;
+}
+
+portBASE_TYPE xSemaphoreGiveFromISR(xSemaphoreHandle semaphore, portBASE_TYPE *woken){
+	(void)woken;
+
+	return xSemaphoreGive(semaphore);
+}
+
+
+//--------------------------
+// Other tasks
+//--------------------------
+void debug_log(enum tDebugPriority priority, enum tDebugSender sender, char *string){
+	(void)sender;
+
+	if(priority == DEBUG_PRIORITY_WARNING){
+		hostWarnings++;
+	}
+
+	strncpy(hostLastLog, string, HOST_LOG_SIZE - 1);
+	hostLastLog[HOST_LOG_SIZE - 1] = 0;
+
+	if(hostPrintLog){
+		printf("  [%llu us] %s\n", simFlash.time / 1000, string);
+	}
+}
+
+unsigned char wdt_send_request(enum tWatchdogCommand command, unsigned char data){
+	(void)command;
+	(void)data;
+
+	return pdTRUE;
+}
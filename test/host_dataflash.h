@@ -0,0 +1,49 @@
+/******************************************************************************
+ *
+ * Host Dataflash Glue Include
+ *
+ * - Compiler:          GNU GCC, host build
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+
+
+
+#ifndef HOST_DATAFLASH_H_
+#define HOST_DATAFLASH_H_
+
+// The ASF and FreeRTOS calls of the flash modules, on top of the simulated dataflash.
+// One task, no interrupts: PDCA transfers finish as they start and every delay just
+// moves the simulated clock on.
+
+#define HOST_LOG_SIZE				32
+
+extern portBASE_TYPE hostSchedulerState;
+extern unsigned char hostPrintLog;					// Echo debug_log() to stdout
+extern unsigned int hostWarnings;					// debug_log() warnings since the last host_reset()
+extern char hostLastLog[HOST_LOG_SIZE];
+
+void host_reset( void );
+
+#endif /* HOST_DATAFLASH_H_ */
@@ -0,0 +1,802 @@
+/******************************************************************************
+ *
+ * Simulated Dataflash
+ *
+ * - Compiler:          GNU GCC, host build
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim_dataflash.h"
+
+// Opcodes the model knows, the AT25DF161/321 set. SFDP parts share all of it but the
+// security register and sector protection, their suspend opcodes come from the part.
+#define SIM_CMD_READ_ARRAY			0x03
+#define SIM_CMD_READ_ARRAY_FAST		0x0B
+#define SIM_CMD_PAGE_PROGRAM		0x02
+#define SIM_CMD_ERASE_4KB			0x20
+#define SIM_CMD_ERASE_32KB			0x52
+#define SIM_CMD_ERASE_64KB			0xD8
+#define SIM_CMD_CHIP_ERASE			0x60
+#define SIM_CMD_CHIP_ERASE_ALT		0xC7
+#define SIM_CMD_WRITE_ENABLE		0x06
+#define SIM_CMD_WRITE_DISABLE		0x04
+#define SIM_CMD_PROTECT_SECTOR		0x36
+#define SIM_CMD_UNPROTECT_SECTOR	0x39
+#define SIM_CMD_READ_PROTECTION		0x3C
+#define SIM_CMD_PROGRAM_OTP			0x9B
+#define SIM_CMD_READ_OTP			0x77
+#define SIM_CMD_READ_STATUS			0x05
+#define SIM_CMD_WRITE_STATUS1		0x01
+#define SIM_CMD_WRITE_STATUS2		0x31
+#define SIM_CMD_READ_ID				0x9F
+#define SIM_CMD_READ_SFDP			0x5A
+#define SIM_CMD_DEEP_POWER_DOWN		0xB9
+#define SIM_CMD_WAKEUP				0xAB
+#define SIM_CMD_RESET				0xF0
+
+struct tSimFlash simFlash;
+
+// Typical times from the datasheets
+const struct tSimPart simAt25df161 = {
+	"AT25DF161", {0x1F, 0x46, 0x02}, 0x00200000,
+	85000000, 50000000,
+	0xB0, 0xD0, 1, 1,
+	1000, {50000, 250000, 400000}, 16000000, 20, 30, 1,
+	NULL, 0
+};
+
+const struct tSimPart simAt25df321 = {
+	"AT25DF321", {0x1F, 0x47, 0x01}, 0x00400000,
+	70000000, 33000000,
+	0xB0, 0xD0, 1, 1,
+	1000, {50000, 250000, 400000}, 36000000, 20, 30, 1,
+	NULL, 0
+};
+
+const char *simOperationNames[SIM_OP_COUNT] = {"read", "program", "erase 4KB", "erase 32KB", "erase 64KB", "chip erase", "status", "other"};
+const char *simFaultNames[SIM_FAULT_COUNT] = {"bad command", "busy", "not write enabled", "protected", "unerased program",
+											  "page wrap", "clock too fast", "powered down", "wake-up time", "suspended"};
+
+
+void sim_init(const struct tSimPart *part){
+	sim_free();
+
+	memset(&simFlash, 0, sizeof(simFlash));
+	simFlash.part = part;
+	simFlash.array = malloc(part->size);
+	simFlash.protect = calloc(part->size / SIM_PROTECT_SIZE, 1);
+	simFlash.eraseCount = calloc(part->size / SIM_SECTOR_SIZE, sizeof(unsigned int));
+
+	// Shipped erased
+	memset(simFlash.array, 0xFF, part->size);
+	memset(simFlash.otp, 0xFF, sizeof(simFlash.otp));
+
+	simFlash.clock = 12000000;
+	simFlash.failingSector = SIM_NO_SECTOR;
+
+	sim_power_cycle();
+}
+
+void sim_free( void ){
+	free(simFlash.array);
+	free(simFlash.protect);
+	free(simFlash.eraseCount);
+
+	simFlash.array = NULL;
+	simFlash.protect = NULL;
+	simFlash.eraseCount = NULL;
+}
+
+// Everything but the array, the security register and the counters starts over
+void sim_power_cycle( void ){
+	simFlash.powered = 1;
+	simFlash.poweredDown = 0;
+	simFlash.writeEnabled = 0;
+	simFlash.eraseError = 0;
+	simFlash.protectionLocked = 0;
+	simFlash.suspended = 0;
+	simFlash.selected = 0;
+	simFlash.busyUntil = simFlash.time;
+	simFlash.wakeUpAt = 0;
+	simFlash.powerLossCountdown = 0;
+	simFlash.powerLost = 0;
+
+	memset(simFlash.protect, simFlash.part->protectAtPowerUp, simFlash.part->size / SIM_PROTECT_SIZE);
+}
+
+void sim_reset_stats( void ){
+	memset(simFlash.stats, 0, sizeof(simFlash.stats));
+	memset(simFlash.faults, 0, sizeof(simFlash.faults));
+	memset(simFlash.eraseCount, 0, (simFlash.part->size / SIM_SECTOR_SIZE) * sizeof(unsigned int));
+	simFlash.ignoredCommands = 0;
+}
+
+void sim_clear_trace( void ){
+	simFlash.traceLength = 0;
+}
+
+
+void sim_set_clock(unsigned int clock){
+	simFlash.clock = clock;
+}
+
+void sim_advance(unsigned long long nanoseconds){
+	simFlash.time += nanoseconds;
+}
+
+unsigned char sim_busy( void ){
+	return simFlash.powered && (simFlash.time < simFlash.busyUntil);
+}
+
+
+// Program or erase number powerLossCountdown from now stops percent of the way through and the part loses power
+void sim_power_loss(unsigned int operations, unsigned char percent){
+	simFlash.powerLossCountdown = operations;
+	simFlash.powerLossPercent = percent;
+	simFlash.powerLossErasesOnly = 0;
+}
+
+// The same, counting only the erases
+void sim_power_loss_erase(unsigned int erases, unsigned char percent){
+	sim_power_loss(erases, percent);
+	simFlash.powerLossErasesOnly = 1;
+}
+
+// Programs and erases of the sector holding address report EPE and leave the array as it was
+void sim_fail_sector(unsigned long address){
+	simFlash.failingSector = (address == SIM_NO_SECTOR) ? SIM_NO_SECTOR : (address & ~(SIM_SECTOR_SIZE - 1));
+}
+
+
+unsigned int sim_faults( void ){
+	unsigned int total = 0;
+	unsigned char i;
+
+	for(i = 0; i < SIM_FAULT_COUNT; i++){
+		total += simFlash.faults[i];
+	}
+
+	return total;
+}
+
+void sim_report(const char *title){
+	unsigned long sectors = simFlash.part->size / SIM_SECTOR_SIZE;
+	unsigned int most = 0, erases = 0;
+	unsigned long i;
+
+	printf("%s, %s after %.3f ms\n", title, simFlash.part->name, simFlash.time / 1000000.0);
+	printf("  %-12s %8s %12s %12s\n", "operation", "count", "SPI bytes", "busy ms");
+
+	for(i = 0; i < SIM_OP_COUNT; i++){
+		if(simFlash.stats[i].count || simFlash.stats[i].spiBytes){
+			printf("  %-12s %8u %12llu %12.3f\n", simOperationNames[i], simFlash.stats[i].count,
+				   simFlash.stats[i].spiBytes, simFlash.stats[i].busyTime / 1000000.0);
+		}
+	}
+
+	for(i = 0; i < sectors; i++){
+		erases += simFlash.eraseCount[i];
+		if(simFlash.eraseCount[i] > most){
+			most = simFlash.eraseCount[i];
+		}
+	}
+
+	printf("  sector erases %u, at most %u on one sector\n", erases, most);
+
+	for(i = 0; i < SIM_FAULT_COUNT; i++){
+		if(simFlash.faults[i]){
+			printf("  fault: %s x%u\n", simFaultNames[i], simFlash.faults[i]);
+		}
+	}
+}
+
+
+unsigned long sim_address( void ){
+	return (((unsigned long)simFlash.command[1] << 16) | ((unsigned long)simFlash.command[2] << 8) | simFlash.command[3]) % simFlash.part->size;
+}
+
+void sim_fault(enum tSimFault fault){
+	simFlash.faults[fault]++;
+}
+
+void sim_start(enum tSimOperation operation, unsigned long long microseconds){
+	simFlash.busyOperation = operation;
+	simFlash.busyUntil = simFlash.time + (microseconds * 1000);
+	simFlash.stats[operation].busyTime += microseconds * 1000;
+}
+
+// Counts down the armed power loss, TRUE if this operation is the one it hits
+unsigned char sim_power_fails(unsigned char erase){
+	if( simFlash.powerLossErasesOnly && !erase ){
+		return 0;
+	}
+
+	return simFlash.powerLossCountdown && (--simFlash.powerLossCountdown == 0);
+}
+
+void sim_cut_power( void ){
+	simFlash.powered = 0;
+	simFlash.powerLost = 1;
+	simFlash.busyUntil = simFlash.time;
+}
+
+// Common checks of programs and erases, the latch clears whether it goes ahead or not
+unsigned char sim_write_allowed(unsigned long address){
+
+	if(!simFlash.writeEnabled){
+		sim_fault(SIM_FAULT_NOT_ENABLED);
+		return 0;
+	}
+
+	simFlash.writeEnabled = 0;
+
+	if(simFlash.suspended){
+		sim_fault(SIM_FAULT_SUSPENDED);
+		return 0;
+	}
+
+	if(simFlash.protect[address / SIM_PROTECT_SIZE]){
+		sim_fault(SIM_FAULT_PROTECTED);
+		return 0;
+	}
+
+	return 1;
+}
+
+// Bytes can only go from 1 to 0, the data sent last wins where it wrapped over the page
+void sim_program(unsigned char *array, unsigned char *data, unsigned int start, unsigned int sent, unsigned int size, unsigned char failing){
+	unsigned int bytes = (sent > size) ? size : sent;
+	unsigned int limit = bytes;
+	unsigned char unerased = 0;
+	unsigned int offset, i;
+
+	if( sim_power_fails(0) ){
+		limit = (bytes * simFlash.powerLossPercent) / 100;
+	}
+
+	for(i = 0; (i < limit) && !failing; i++){
+		offset = (start + (sent - bytes) + i) % size;
+
+		if( (array[offset] & data[offset]) != data[offset] ){
+			unerased = 1;
+		}
+
+		array[offset] &= data[offset];
+	}
+
+	if(unerased){
+		sim_fault(SIM_FAULT_UNERASED);
+	}
+
+	simFlash.eraseError = failing;
+	simFlash.stats[SIM_OP_PROGRAM].count++;
+	sim_start(SIM_OP_PROGRAM, simFlash.part->programTime);
+
+	if(limit < bytes){
+		sim_cut_power();
+	}
+}
+
+void sim_erase(enum tSimOperation operation, unsigned long size, unsigned long long time){
+	unsigned long start = sim_address() & ~(size - 1);
+	unsigned long sectors = size / SIM_SECTOR_SIZE;
+	unsigned long done = sectors;
+	unsigned char failing = 0;
+	unsigned long i;
+
+	if( !sim_write_allowed(start) ){
+		return;
+	}
+
+	if( sim_power_fails(1) ){
+		done = (sectors * simFlash.powerLossPercent) / 100;
+	}
+
+	for(i = 0; i < sectors; i++){
+		if( (start + (i * SIM_SECTOR_SIZE)) == simFlash.failingSector ){
+			failing = 1;
+			continue;
+		}
+
+		if(i < done){
+			memset(&simFlash.array[start + (i * SIM_SECTOR_SIZE)], 0xFF, SIM_SECTOR_SIZE);
+			simFlash.eraseCount[(start / SIM_SECTOR_SIZE) + i]++;
+		}else if(i == done){
+			// The sector it stopped in is only partly erased
+			memset(&simFlash.array[start + (i * SIM_SECTOR_SIZE)], 0xFF, SIM_SECTOR_SIZE / 2);
+		}
+	}
+
+	simFlash.eraseError = failing;
+	simFlash.eraseStart = start;
+	simFlash.eraseEnd = start + size - 1;
+	simFlash.stats[operation].count++;
+	sim_start(operation, time);
+
+	if(done < sectors){
+		sim_cut_power();
+	}
+}
+
+void sim_chip_erase( void ){
+	unsigned long i;
+
+	if( !sim_write_allowed(0) ){
+		return;
+	}
+
+	// Ignored if any sector is protected
+	for(i = 0; i < (simFlash.part->size / SIM_PROTECT_SIZE); i++){
+		if(simFlash.protect[i]){
+			sim_fault(SIM_FAULT_PROTECTED);
+			return;
+		}
+	}
+
+	if( sim_power_fails(1) ){
+		memset(simFlash.array, 0xFF, (simFlash.part->size * simFlash.powerLossPercent) / 100);
+		sim_cut_power();
+		return;
+	}
+
+	memset(simFlash.array, 0xFF, simFlash.part->size);
+	for(i = 0; i < (simFlash.part->size / SIM_SECTOR_SIZE); i++){
+		simFlash.eraseCount[i]++;
+	}
+
+	simFlash.eraseError = 0;
+	simFlash.eraseStart = 0;
+	simFlash.eraseEnd = simFlash.part->size - 1;
+	simFlash.stats[SIM_OP_CHIP_ERASE].count++;
+	sim_start(SIM_OP_CHIP_ERASE, simFlash.part->chipEraseTime);
+}
+
+void sim_write_status( void ){
+
+	if(!simFlash.writeEnabled){
+		sim_fault(SIM_FAULT_NOT_ENABLED);
+		return;
+	}
+
+	simFlash.writeEnabled = 0;
+
+	if(simFlash.protectionLocked){
+		sim_fault(SIM_FAULT_PROTECTED);
+		return;
+	}
+
+	// Global protect and unprotect, other values of the SWP bits leave the sectors as they are
+	if( ((simFlash.command[1] >> 2) & 0x0F) == 0x0F ){
+		memset(simFlash.protect, 1, simFlash.part->size / SIM_PROTECT_SIZE);
+	}else if( ((simFlash.command[1] >> 2) & 0x0F) == 0x00 ){
+		memset(simFlash.protect, 0, simFlash.part->size / SIM_PROTECT_SIZE);
+	}
+
+	simFlash.protectionLocked = (simFlash.command[1] & SIM_STATUS_SPRL) ? 1 : 0;
+}
+
+unsigned char sim_status(unsigned char byte){
+	unsigned char status = 0;
+	unsigned long i, protectedSectors = 0;
+
+	if( sim_busy() ){
+		status |= SIM_STATUS_BUSY;
+	}
+
+	if(byte == 1){
+		return status | (simFlash.suspended ? SIM_STATUS2_ES : 0);
+	}
+
+	for(i = 0; i < (simFlash.part->size / SIM_PROTECT_SIZE); i++){
+		protectedSectors += simFlash.protect[i];
+	}
+
+	if(protectedSectors == (simFlash.part->size / SIM_PROTECT_SIZE)){
+		status |= SIM_STATUS_SWP_ALL;
+	}else if(protectedSectors){
+		status |= SIM_STATUS_SWP_SOME;
+	}
+
+	return status | SIM_STATUS_WPP | (simFlash.writeEnabled ? SIM_STATUS_WEL : 0) |
+		   (simFlash.eraseError ? SIM_STATUS_EPE : 0) | (simFlash.protectionLocked ? SIM_STATUS_SPRL : 0);
+}
+
+// Block erases can be suspended, chip erases and programs can't
+unsigned char sim_erase_running( void ){
+	return sim_busy() && !simFlash.suspended &&
+		   ((simFlash.busyOperation == SIM_OP_ERASE_4KB) || (simFlash.busyOperation == SIM_OP_ERASE_32KB) || (simFlash.busyOperation == SIM_OP_ERASE_64KB));
+}
+
+// Data byte of an array read, the suspended erase block reads back undefined
+unsigned char sim_read_array(unsigned long address){
+	address %= simFlash.part->size;
+
+	if( simFlash.suspended && (address >= simFlash.eraseStart) && (address <= simFlash.eraseEnd) ){
+		if(!simFlash.faulted){
+			sim_fault(SIM_FAULT_SUSPENDED);
+		}
+		simFlash.faulted = 1;
+		return 0x00;
+	}
+
+	return simFlash.array[address];
+}
+
+
+// Decides at the opcode whether the part listens to this command at all
+void sim_opcode(unsigned char opcode){
+	unsigned int limit = (opcode == SIM_CMD_READ_ARRAY) ? simFlash.part->readArrayMaxClock : simFlash.part->maxClock;
+	unsigned char eraseRunning = sim_erase_running();
+
+	if(simFlash.clock > limit){
+		sim_fault(SIM_FAULT_CLOCK);
+	}
+
+	if(simFlash.poweredDown){
+		if(opcode != SIM_CMD_WAKEUP){
+			sim_fault(SIM_FAULT_POWERED_DOWN);
+			simFlash.ignored = 1;
+		}
+	}else if(simFlash.time < simFlash.wakeUpAt){
+		sim_fault(SIM_FAULT_WAKEUP_TIME);
+		simFlash.ignored = 1;
+	}else if( sim_busy() && (opcode != SIM_CMD_READ_STATUS) &&
+			  !(eraseRunning && simFlash.part->suspendCommand && (opcode == simFlash.part->suspendCommand)) ){
+		sim_fault(SIM_FAULT_BUSY);
+		simFlash.ignored = 1;
+	}
+}
+
+void sim_select( void ){
+	simFlash.selected = 1;
+	simFlash.selectedAt = simFlash.time;
+	simFlash.ignored = 0;
+	simFlash.faulted = 0;
+	simFlash.length = 0;
+}
+
+// Exchanges one byte, what the part drives on MISO while mosi is clocked in
+unsigned char sim_transfer(unsigned char mosi){
+	unsigned int index = simFlash.length;
+	unsigned long address;
+
+	simFlash.time += SIM_BYTE_TIME(simFlash.clock);
+
+	if(!simFlash.selected){
+		return SIM_MISO_IDLE;
+	}
+
+	if(!simFlash.powered){
+		return SIM_MISO_OFF;
+	}
+
+	simFlash.length++;
+
+	if(index < SIM_COMMAND_MAX){
+		simFlash.command[index] = mosi;
+	}
+
+	if(index == 0){
+		sim_opcode(mosi);
+		return SIM_MISO_IDLE;
+	}
+
+	if(simFlash.ignored){
+		return SIM_MISO_IDLE;
+	}
+
+	switch(simFlash.command[0]){
+		case(SIM_CMD_READ_ARRAY):
+			return (index >= 4) ? sim_read_array(sim_address() + (index - 4)) : SIM_MISO_IDLE;
+
+		case(SIM_CMD_READ_ARRAY_FAST):
+			return (index >= 5) ? sim_read_array(sim_address() + (index - 5)) : SIM_MISO_IDLE;
+
+		case(SIM_CMD_READ_STATUS):
+			return sim_status((index - 1) & 1);
+
+		case(SIM_CMD_READ_ID):
+			return (index <= 3) ? simFlash.part->id[index - 1] : 0x00;
+
+		case(SIM_CMD_READ_OTP):
+			return (simFlash.part->securityRegister && (index >= 6)) ? simFlash.otp[(simFlash.command[3] + (index - 6)) % SIM_OTP_SIZE] : SIM_MISO_IDLE;
+
+		case(SIM_CMD_READ_SFDP):
+			if(index < 5){
+				return SIM_MISO_IDLE;
+			}
+
+			address = sim_address() + (index - 5);
+			return (address < simFlash.part->sfdpLength) ? simFlash.part->sfdp[address] : SIM_MISO_IDLE;
+
+		case(SIM_CMD_READ_PROTECTION):
+			return (index >= 4) ? (simFlash.protect[sim_address() / SIM_PROTECT_SIZE] ? 0xFF : 0x00) : SIM_MISO_IDLE;
+
+		case(SIM_CMD_PAGE_PROGRAM):
+			if(index >= 4){
+				simFlash.programBuffer[(simFlash.command[3] + (index - 4)) % SIM_PAGE_SIZE] = mosi;
+			}
+			return SIM_MISO_IDLE;
+
+		case(SIM_CMD_PROGRAM_OTP):
+			if(index >= 4){
+				simFlash.programBuffer[(simFlash.command[3] + (index - 4)) % SIM_OTP_SIZE] = mosi;
+			}
+			return SIM_MISO_IDLE;
+
+		default:
+			return SIM_MISO_IDLE;
+	}
+}
+
+// Programs, erases and the other write commands start when chip select goes up
+void sim_deselect( void ){
+	unsigned char opcode = simFlash.command[0];
+	unsigned int length = simFlash.length;
+	unsigned long pageStart;
+	enum tSimOperation operation;
+
+	if(!simFlash.selected){
+		return;
+	}
+
+	simFlash.selected = 0;
+
+	if(length){
+		if(simFlash.traceLength < SIM_TRACE_SIZE){
+			simFlash.trace[simFlash.traceLength].opcode = opcode;
+			simFlash.trace[simFlash.traceLength].length = length;
+			simFlash.trace[simFlash.traceLength].clock = simFlash.clock;
+			simFlash.trace[simFlash.traceLength].start = simFlash.selectedAt;
+			simFlash.trace[simFlash.traceLength].end = simFlash.time;
+		}
+		simFlash.traceLength++;
+	}
+
+	if(!simFlash.powered){
+		simFlash.ignoredCommands++;
+		return;
+	}
+
+	if(length == 0){
+		return;
+	}
+
+	switch(opcode){
+		case(SIM_CMD_READ_ARRAY):
+		case(SIM_CMD_READ_ARRAY_FAST):
+		case(SIM_CMD_READ_OTP):
+		case(SIM_CMD_READ_SFDP):
+			operation = SIM_OP_READ;
+			break;
+
+		case(SIM_CMD_PAGE_PROGRAM):
+		case(SIM_CMD_PROGRAM_OTP):
+			operation = SIM_OP_PROGRAM;
+			break;
+
+		case(SIM_CMD_ERASE_4KB):
+			operation = SIM_OP_ERASE_4KB;
+			break;
+
+		case(SIM_CMD_ERASE_32KB):
+			operation = SIM_OP_ERASE_32KB;
+			break;
+
+		case(SIM_CMD_ERASE_64KB):
+			operation = SIM_OP_ERASE_64KB;
+			break;
+
+		case(SIM_CMD_CHIP_ERASE):
+		case(SIM_CMD_CHIP_ERASE_ALT):
+			operation = SIM_OP_CHIP_ERASE;
+			break;
+
+		case(SIM_CMD_READ_STATUS):
+			operation = SIM_OP_STATUS;
+			break;
+
+		default:
+			operation = SIM_OP_OTHER;
+			break;
+	}
+
+	simFlash.stats[operation].spiBytes += length;
+
+	if(simFlash.ignored){
+		simFlash.ignoredCommands++;
+		return;
+	}
+
+	simFlash.lastCommand = opcode;
+
+	// Suspend opcodes differ between families
+	if( simFlash.part->suspendCommand && (opcode == simFlash.part->suspendCommand) ){
+		if( sim_erase_running() ){
+			simFlash.suspended = 1;
+			simFlash.suspendedRemaining = simFlash.busyUntil - simFlash.time;
+			simFlash.busyUntil = simFlash.time + (simFlash.part->suspendTime * 1000ULL);
+		}
+		simFlash.stats[SIM_OP_OTHER].count++;
+		return;
+	}
+
+	if( simFlash.part->resumeCommand && (opcode == simFlash.part->resumeCommand) ){
+		if(simFlash.suspended){
+			simFlash.suspended = 0;
+			simFlash.busyUntil = simFlash.time + simFlash.suspendedRemaining;
+		}
+		simFlash.stats[SIM_OP_OTHER].count++;
+		return;
+	}
+
+	switch(opcode){
+		case(SIM_CMD_READ_ARRAY):
+		case(SIM_CMD_READ_ARRAY_FAST):
+		case(SIM_CMD_READ_OTP):
+		case(SIM_CMD_READ_SFDP):
+		case(SIM_CMD_READ_STATUS):
+		case(SIM_CMD_READ_ID):
+		case(SIM_CMD_READ_PROTECTION):
+			// Reads end whenever chip select goes up
+			simFlash.stats[operation].count++;
+			break;
+
+		case(SIM_CMD_WRITE_ENABLE):
+			simFlash.writeEnabled = 1;
+			simFlash.stats[operation].count++;
+			break;
+
+		case(SIM_CMD_WRITE_DISABLE):
+			simFlash.writeEnabled = 0;
+			simFlash.stats[operation].count++;
+			break;
+
+		case(SIM_CMD_PAGE_PROGRAM):
+			if(length < 5){
+				sim_fault(SIM_FAULT_COMMAND);
+				break;
+			}
+
+			pageStart = sim_address() & ~(SIM_PAGE_SIZE - 1);
+			if( !sim_write_allowed(pageStart) ){
+				break;
+			}
+
+			if( (simFlash.command[3] + (length - 4)) > SIM_PAGE_SIZE ){
+				sim_fault(SIM_FAULT_PAGE_WRAP);
+			}
+
+			sim_program(&simFlash.array[pageStart], simFlash.programBuffer, simFlash.command[3], length - 4, SIM_PAGE_SIZE,
+						(pageStart & ~(SIM_SECTOR_SIZE - 1)) == simFlash.failingSector);
+			break;
+
+		case(SIM_CMD_PROGRAM_OTP):
+			if( (length < 5) || !simFlash.part->securityRegister ){
+				sim_fault(SIM_FAULT_COMMAND);
+				break;
+			}
+
+			if(!simFlash.writeEnabled){
+				sim_fault(SIM_FAULT_NOT_ENABLED);
+				break;
+			}
+
+			simFlash.writeEnabled = 0;
+			sim_program(simFlash.otp, simFlash.programBuffer, simFlash.command[3] % SIM_OTP_SIZE, length - 4, SIM_OTP_SIZE, 0);
+			break;
+
+		case(SIM_CMD_ERASE_4KB):
+		case(SIM_CMD_ERASE_32KB):
+		case(SIM_CMD_ERASE_64KB):
+			if(length != 4){
+				sim_fault(SIM_FAULT_COMMAND);
+				break;
+			}
+
+			if(opcode == SIM_CMD_ERASE_4KB){
+				sim_erase(operation, SIM_SECTOR_SIZE, simFlash.part->eraseTime[0]);
+			}else if(opcode == SIM_CMD_ERASE_32KB){
+				sim_erase(operation, 32768, simFlash.part->eraseTime[1]);
+			}else{
+				sim_erase(operation, 65536, simFlash.part->eraseTime[2]);
+			}
+			break;
+
+		case(SIM_CMD_CHIP_ERASE):
+		case(SIM_CMD_CHIP_ERASE_ALT):
+			if(length != 1){
+				sim_fault(SIM_FAULT_COMMAND);
+				break;
+			}
+
+			sim_chip_erase();
+			break;
+
+		case(SIM_CMD_WRITE_STATUS1):
+			if(length != 2){
+				sim_fault(SIM_FAULT_COMMAND);
+				break;
+			}
+
+			sim_write_status();
+			simFlash.stats[operation].count++;
+			break;
+
+		case(SIM_CMD_WRITE_STATUS2):
+			if(!simFlash.writeEnabled){
+				sim_fault(SIM_FAULT_NOT_ENABLED);
+				break;
+			}
+
+			simFlash.writeEnabled = 0;
+			simFlash.stats[operation].count++;
+			break;
+
+		case(SIM_CMD_PROTECT_SECTOR):
+		case(SIM_CMD_UNPROTECT_SECTOR):
+			if( (length != 4) || !simFlash.part->securityRegister ){
+				sim_fault(SIM_FAULT_COMMAND);
+				break;
+			}
+
+			if(!simFlash.writeEnabled){
+				sim_fault(SIM_FAULT_NOT_ENABLED);
+				break;
+			}
+
+			simFlash.writeEnabled = 0;
+
+			if(simFlash.protectionLocked){
+				sim_fault(SIM_FAULT_PROTECTED);
+				break;
+			}
+
+			simFlash.protect[sim_address() / SIM_PROTECT_SIZE] = (opcode == SIM_CMD_PROTECT_SECTOR);
+			simFlash.stats[operation].count++;
+			break;
+
+		case(SIM_CMD_DEEP_POWER_DOWN):
+			simFlash.poweredDown = 1;
+			simFlash.stats[operation].count++;
+			break;
+
+		case(SIM_CMD_WAKEUP):
+			if(simFlash.poweredDown){
+				simFlash.poweredDown = 0;
+				simFlash.wakeUpAt = simFlash.time + (simFlash.part->wakeUpTime * 1000ULL);
+			}
+			simFlash.stats[operation].count++;
+			break;
+
+		default:
+			sim_fault(SIM_FAULT_COMMAND);
+			break;
+	}
+}
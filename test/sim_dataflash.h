@@ -0,0 +1,210 @@
+/******************************************************************************
+ *
+ * Simulated Dataflash Include
+ *
+ * - Compiler:          GNU GCC, host build
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+
+
+
+#ifndef SIM_DATAFLASH_H_
+#define SIM_DATAFLASH_H_
+
+// Byte level model of an AT25DF161/321, or of an SFDP part with the same basic
+// command set, driven one SPI byte at a time. Time only moves with the bytes
+// clocked and with sim_advance(), the host RTOS calls are what advance it.
+
+#define SIM_PAGE_SIZE				256
+#define SIM_SECTOR_SIZE				4096		// Smallest erase, wear is counted per sector
+#define SIM_PROTECT_SIZE			65536		// AT25DF sector protection granularity
+#define SIM_OTP_SIZE				128
+#define SIM_COMMAND_MAX				8			// Opcode, address and dummy bytes kept of each command
+#define SIM_TRACE_SIZE				64			// Commands kept in the trace
+
+#define SIM_BYTE_TIME(clock)		(8000000000ULL / (clock))	// Nanoseconds to clock one byte
+
+#define SIM_MISO_IDLE				0xFF		// Nothing driving the line
+#define SIM_MISO_OFF				0x00		// Part without power
+
+// Status byte 1, then byte 2
+#define SIM_STATUS_BUSY				0x01
+#define SIM_STATUS_WEL				0x02
+#define SIM_STATUS_SWP_SOME			0x04
+#define SIM_STATUS_SWP_ALL			0x0C
+#define SIM_STATUS_WPP				0x10
+#define SIM_STATUS_EPE				0x20
+#define SIM_STATUS_SPRL				0x80
+#define SIM_STATUS2_ES				0x02
+
+enum tSimOperation {
+	SIM_OP_READ,					// Array, SFDP and security register reads
+	SIM_OP_PROGRAM,					// Page and security register programs
+	SIM_OP_ERASE_4KB,
+	SIM_OP_ERASE_32KB,
+	SIM_OP_ERASE_64KB,
+	SIM_OP_CHIP_ERASE,
+	SIM_OP_STATUS,					// Status register reads
+	SIM_OP_OTHER,					// Everything else, write enable, IDs, power modes
+	SIM_OP_COUNT
+};
+
+// Things the driver must never make a real part do. Each is counted and, apart
+// from the page wrap and unerased program which the part carries out as it
+// would, the command is ignored like the part ignores it.
+enum tSimFault {
+	SIM_FAULT_COMMAND,				// Unknown opcode or chip select raised mid-command
+	SIM_FAULT_BUSY,					// Command other than a status read or suspend while busy
+	SIM_FAULT_NOT_ENABLED,			// Program or erase without the write enable latch
+	SIM_FAULT_PROTECTED,			// Program or erase of a protected sector
+	SIM_FAULT_UNERASED,				// Program asked for a 1 over a 0, only the 0 survives
+	SIM_FAULT_PAGE_WRAP,			// Program data ran past the end of its page and wrapped around
+	SIM_FAULT_CLOCK,				// SCK above what the opcode allows
+	SIM_FAULT_POWERED_DOWN,			// Command other than wake-up in deep power-down
+	SIM_FAULT_WAKEUP_TIME,			// Command before the wake-up time passed
+	SIM_FAULT_SUSPENDED,			// Read of the suspended erase block, or program/erase while suspended
+	SIM_FAULT_COUNT
+};
+
+struct tSimPart {
+	const char *name;
+	unsigned char id[3];						// Manufacturer, device ID bytes 1 and 2
+	unsigned long size;
+
+	unsigned int maxClock;						// Hz, every opcode but the plain array read
+	unsigned int readArrayMaxClock;				// Hz, opcode 0x03
+
+	unsigned char suspendCommand;				// 0 if the part can't suspend erases
+	unsigned char resumeCommand;
+	unsigned char securityRegister;				// AT25DF OTP security register
+	unsigned char protectAtPowerUp;				// AT25DF come up with every sector protected
+
+	unsigned int programTime;					// Microseconds per page program
+	unsigned int eraseTime[3];					// Microseconds, 4KB, 32KB and 64KB
+	unsigned int chipEraseTime;
+	unsigned int suspendTime;
+	unsigned int wakeUpTime;					// From the wake-up command to the first one it accepts
+	unsigned int powerDownTime;					// From the power-down command until it's in deep power-down
+
+	const unsigned char *sfdp;					// Serial Flash Discoverable Parameters, NULL if none
+	unsigned short sfdpLength;
+};
+
+struct tSimStats {
+	unsigned int count;
+	unsigned long long spiBytes;
+	unsigned long long busyTime;				// Nanoseconds busy
+};
+
+// One chip select as the trace keeps it
+struct tSimCommand {
+	unsigned char opcode;
+	unsigned int length;						// Bytes clocked, opcode included
+	unsigned int clock;
+	unsigned long long start;					// Nanoseconds, chip select down and up
+	unsigned long long end;
+};
+
+struct tSimFlash {
+	const struct tSimPart *part;
+	unsigned char *array;
+	unsigned char otp[SIM_OTP_SIZE];
+	unsigned char *protect;						// One per 64KB, TRUE if protected
+	unsigned int *eraseCount;					// One per 4KB sector
+
+	unsigned long long time;					// Nanoseconds since the simulation started
+	unsigned long long busyUntil;
+	enum tSimOperation busyOperation;			// What it's busy with until then
+	unsigned long long wakeUpAt;
+	unsigned int clock;							// Current SCK in Hz
+
+	unsigned char powered;
+	unsigned char poweredDown;
+	unsigned char writeEnabled;
+	unsigned char eraseError;					// EPE of status byte 1
+	unsigned char protectionLocked;				// SPRL of status byte 1
+
+	// Suspended erase, what's left of it and the block it works on
+	unsigned char suspended;
+	unsigned long long suspendedRemaining;
+	unsigned long suspendedStart;
+	unsigned long suspendedEnd;
+	unsigned long eraseStart;
+	unsigned long eraseEnd;
+
+	// Command being clocked in
+	unsigned char selected;
+	unsigned char ignored;						// Rest of this chip select is ignored
+	unsigned long long selectedAt;
+	unsigned char command[SIM_COMMAND_MAX];		// Opcode, address and dummy bytes
+	unsigned int length;						// Bytes clocked since chip select
+	unsigned char programBuffer[SIM_PAGE_SIZE];	// Page program data at its offset in the page
+	unsigned char faulted;						// Fault of this command already counted
+
+	// Power loss injection, the Nth program or erase from when it was armed only gets partway
+	unsigned int powerLossCountdown;			// 0 when not armed
+	unsigned char powerLossPercent;
+	unsigned char powerLossErasesOnly;			// Only erases count down
+	unsigned char powerLost;					// Set when it happened, cleared by sim_power_cycle()
+
+	unsigned long failingSector;				// Programs and erases there set EPE, SIM_NO_SECTOR if none
+
+	struct tSimStats stats[SIM_OP_COUNT];
+	unsigned int faults[SIM_FAULT_COUNT];
+	unsigned int ignoredCommands;				// Commands the part didn't act on, faults and power off
+	unsigned long lastCommand;					// Opcode of the last command acted on
+
+	struct tSimCommand trace[SIM_TRACE_SIZE];
+	unsigned int traceLength;					// Commands since the trace was cleared, the first SIM_TRACE_SIZE are kept
+};
+
+#define SIM_NO_SECTOR				0xFFFFFFFF
+
+extern struct tSimFlash simFlash;
+extern const struct tSimPart simAt25df161;
+extern const struct tSimPart simAt25df321;
+
+void sim_init(const struct tSimPart *part);
+void sim_free( void );
+void sim_power_cycle( void );
+void sim_reset_stats( void );
+void sim_clear_trace( void );
+
+void sim_set_clock(unsigned int clock);
+void sim_advance(unsigned long long nanoseconds);
+unsigned char sim_busy( void );
+
+void sim_select( void );
+void sim_deselect( void );
+unsigned char sim_transfer(unsigned char mosi);
+
+void sim_power_loss(unsigned int operations, unsigned char percent);
+void sim_power_loss_erase(unsigned int erases, unsigned char percent);
+void sim_fail_sector(unsigned long address);
+
+unsigned int sim_faults( void );
+void sim_report(const char *title);
+
+#endif /* SIM_DATAFLASH_H_ */
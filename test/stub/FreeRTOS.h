@@ -0,0 +1,85 @@
+/******************************************************************************
+ *
+ * FreeRTOS Stand-in For Host Builds
+ *
+ * - Compiler:          GNU GCC, host build
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+
+
+#ifndef HOST_FREERTOS_H_
+#define HOST_FREERTOS_H_
+
+// Only what the flash modules use. Ticks are milliseconds of simulated time, see host_dataflash.c
+
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef unsigned int portTickType;
+typedef void * xQueueHandle;
+typedef void * xSemaphoreHandle;
+typedef void * xTaskHandle;
+typedef void * xTimerHandle;
+
+#define portBASE_TYPE					long
+#define portCHAR						char
+#define portSHORT						short
+#define portMAX_DELAY					0xFFFFFFFF
+#define portTICK_RATE_MS				1
+#define configTICK_RATE_HZ				1000
+
+#define pdFALSE							0
+#define pdTRUE							1
+#define pdPASS							1
+#define pdFAIL							0
+#define errQUEUE_EMPTY					0
+#define errQUEUE_FULL					0
+
+#define taskSCHEDULER_NOT_STARTED		1
+#define taskSCHEDULER_RUNNING			2
+
+#define tskIDLE_PRIORITY				0
+#define TASK_DELAY_MS(x)				(x)
+
+#define portENTER_CRITICAL()
+#define portEXIT_CRITICAL()
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+
+#define TRUE							1
+#define FALSE							0
+
+#define TASK_PRIORITY_LOW				1
+#define TASK_PRIORITY_MEDIUM			2
+#define TASK_PRIORITY_HIGH				3
+
+#define configTSK_DATAFLASH_TASK_NAME			((const signed char *)"Flash")
+#define configTSK_DATAFLASH_TASK_STACK_SIZE		1536
+#define configTSK_DATAFLASH_TASK_PRIORITY		TASK_PRIORITY_MEDIUM
+#define configTSK_DATAFLASH_TASK_HANDLE			NULL
+
+#define TRAQPAQ_DEBUG_ENABLED			FALSE
+
+#endif /* HOST_FREERTOS_H_ */
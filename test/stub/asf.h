@@ -0,0 +1,89 @@
+/******************************************************************************
+ *
+ * ASF Stand-in For Host Builds
+ *
+ * - Compiler:          GNU GCC, host build
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+
+
+#ifndef HOST_ASF_H_
+#define HOST_ASF_H_
+
+// The SPI, PDCA and GPIO calls of the flash driver go to the simulated dataflash, see host_dataflash.c
+
+#include "FreeRTOS.h"
+
+#define __interrupt__					__unused__		// ISRs are never entered on the host
+
+// Clocks of the traq|paq board, PLL0 at 48MHz and PBA at half of it
+#define APPL_CPU_SPEED					48000000UL
+#define APPL_PBA_SPEED					24000000UL
+
+typedef struct {
+	struct {
+		unsigned int scbr;
+	} CSR0;
+} avr32_spi_t;
+
+extern volatile avr32_spi_t AVR32_SPI0;
+
+#define FLASH_SPI						(&AVR32_SPI0)
+#define FLASH_SPI_NPCS					0
+#define FLASH_SPI_BAUDRATE				12000000
+#define FLASH_SPI_TX_PDCA_CHANNEL		0
+#define FLASH_SPI_RX_PDCA_CHANNEL		1
+#define FLASH_SPI_TX_PDCA_IRQ			96
+#define FLASH_SPI_RX_PDCA_IRQ			97
+
+#define DATAFLASH_WP					1
+#define DATAFLASH_HOLD					2
+
+#define AVR32_INTC_INT0					0
+#define PDCA_TRANSFER_COMPLETE			2
+
+typedef void (*__int_handler)(void);
+
+int spi_selectChip(volatile avr32_spi_t *spi, unsigned char chip);
+int spi_unselectChip(volatile avr32_spi_t *spi, unsigned char chip);
+int spi_write(volatile avr32_spi_t *spi, unsigned short data);
+int spi_read(volatile avr32_spi_t *spi, unsigned short *data);
+int spi_writeEndCheck(volatile avr32_spi_t *spi);
+
+void pdca_load_channel(unsigned int channel, volatile void *address, unsigned int size);
+void pdca_enable(unsigned int channel);
+void pdca_disable(unsigned int channel);
+unsigned int pdca_get_transfer_status(unsigned int channel);
+void pdca_enable_interrupt_transfer_complete(unsigned int channel);
+void pdca_disable_interrupt_transfer_complete(unsigned int channel);
+
+void gpio_set_gpio_pin(unsigned int pin);
+void gpio_clr_gpio_pin(unsigned int pin);
+
+void INTC_register_interrupt(__int_handler handler, unsigned int irq, unsigned int level);
+
+void cpu_delay_us(unsigned long delay, unsigned long cpuSpeed);
+
+#endif /* HOST_ASF_H_ */
@@ -0,0 +1,46 @@
+/******************************************************************************
+ *
+ * FreeRTOS Queues Stand-in For Host Builds
+ *
+ * - Compiler:          GNU GCC, host build
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+
+
+#ifndef HOST_QUEUE_H_
+#define HOST_QUEUE_H_
+
+#include "FreeRTOS.h"
+
+xQueueHandle xQueueCreate(unsigned portBASE_TYPE length, unsigned portBASE_TYPE itemSize);
+portBASE_TYPE xQueueSend(xQueueHandle queue, const void *item, portTickType wait);
+portBASE_TYPE xQueueSendToFront(xQueueHandle queue, const void *item, portTickType wait);
+portBASE_TYPE xQueueSendToBack(xQueueHandle queue, const void *item, portTickType wait);
+portBASE_TYPE xQueueReceive(xQueueHandle queue, void *item, portTickType wait);
+portBASE_TYPE xQueuePeek(xQueueHandle queue, void *item, portTickType wait);
+portBASE_TYPE xQueueSendFromISR(xQueueHandle queue, const void *item, portBASE_TYPE *woken);
+unsigned portBASE_TYPE uxQueueMessagesWaiting(xQueueHandle queue);
+
+#endif /* HOST_QUEUE_H_ */
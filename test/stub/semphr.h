@@ -0,0 +1,43 @@
+/******************************************************************************
+ *
+ * FreeRTOS Semaphores Stand-in For Host Builds
+ *
+ * - Compiler:          GNU GCC, host build
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+
+
+#ifndef HOST_SEMPHR_H_
+#define HOST_SEMPHR_H_
+
+#include "queue.h"
+
+#define vSemaphoreCreateBinary(semaphore)	(semaphore) = xQueueCreate(1, 0)
+
+portBASE_TYPE xSemaphoreTake(xSemaphoreHandle semaphore, portTickType wait);
+portBASE_TYPE xSemaphoreGive(xSemaphoreHandle semaphore);
+portBASE_TYPE xSemaphoreGiveFromISR(xSemaphoreHandle semaphore, portBASE_TYPE *woken);
+
+#endif /* HOST_SEMPHR_H_ */
@@ -0,0 +1,45 @@
+/******************************************************************************
+ *
+ * FreeRTOS Tasks Stand-in For Host Builds
+ *
+ * - Compiler:          GNU GCC, host build
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+
+
+#ifndef HOST_TASK_H_
+#define HOST_TASK_H_
+
+#include "FreeRTOS.h"
+
+portTickType xTaskGetTickCount( void );
+void vTaskDelay(portTickType ticks);
+void vTaskSuspend(xTaskHandle task);
+void vTaskResume(xTaskHandle task);
+xTaskHandle xTaskGetCurrentTaskHandle( void );
+portBASE_TYPE xTaskGetSchedulerState( void );
+portBASE_TYPE xTaskCreate(void (*code)(void *), const signed char *name, unsigned short stackDepth, void *parameters, unsigned portBASE_TYPE priority, xTaskHandle *created);
+
+#endif /* HOST_TASK_H_ */
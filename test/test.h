@@ -0,0 +1,55 @@
+/******************************************************************************
+ *
+ * Host Test Include
+ *
+ * - Compiler:          GNU GCC, host build
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+
+
+#ifndef TEST_H_
+#define TEST_H_
+
+#include <stdio.h>
+
+// Every test program is one translation unit plus the firmware sources it covers
+static unsigned int testChecks;
+static unsigned int testFailures;
+
+#define TEST_CHECK(condition)	do{																\
+									testChecks++;												\
+									if( !(condition) ){											\
+										printf("%s:%d: %s\n", __FILE__, __LINE__, #condition);	\
+										testFailures++;											\
+									}															\
+								}while(0)
+
+// Exit status of main, 0 when every check passed
+static int test_report(const char *name){
+	printf("%s: %u checks, %u failed\n", name, testChecks, testFailures);
+	return (testFailures == 0) ? 0 : 1;
+}
+
+#endif /* TEST_H_ */
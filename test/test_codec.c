@@ -0,0 +1,296 @@
+/******************************************************************************
+ *
+ * Record Data Codec Host Test
+ *
+ * - Compiler:          GNU GCC, host build
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+
+#include <string.h>
+#include <limits.h>
+#include "flash_codec.h"
+#include "test.h"
+
+#define TEST_TRACK_SAMPLES		2000
+#define TEST_TRACK_PAGES		400
+
+unsigned int testSeed = 12345;
+
+struct tRecordData testTrack[TEST_TRACK_SAMPLES];
+struct tRecordPackedPage testPages[TEST_TRACK_PAGES];
+struct tRecordData testExpanded[0xFF];
+
+
+unsigned int test_random( void ){
+	testSeed = (testSeed * 1103515245) + 12345;
+	return testSeed >> 8;
+}
+
+unsigned char test_same_sample(struct tRecordData *a, struct tRecordData *b){
+	return memcmp(a, b, sizeof(struct tRecordData)) == 0;
+}
+
+
+void test_zigzag( void ){
+	const signed int values[] = {0, 1, -1, 2, -2, 63, -64, 64, -65, SHRT_MAX, SHRT_MIN, INT_MAX, INT_MIN, INT_MAX - 1, INT_MIN + 1};
+	unsigned char i;
+
+	TEST_CHECK( codec_zigzag(0) == 0 );
+	TEST_CHECK( codec_zigzag(-1) == 1 );
+	TEST_CHECK( codec_zigzag(1) == 2 );
+	TEST_CHECK( codec_zigzag(INT_MAX) == 0xFFFFFFFE );
+	TEST_CHECK( codec_zigzag(INT_MIN) == 0xFFFFFFFF );
+
+	for(i = 0; i < (sizeof(values) / sizeof(values[0])); i++){
+		TEST_CHECK( codec_unzigzag(codec_zigzag(values[i])) == values[i] );
+	}
+}
+
+
+void test_varint( void ){
+	// Largest value of each length and the smallest of the next
+	const unsigned int values[] = {0, 0x7F, 0x80, 0x3FFF, 0x4000, 0x1FFFFF, 0x200000, 0x0FFFFFFF, 0x10000000, 0xFFFFFFFF};
+	const unsigned char lengths[] = {1, 1, 2, 2, 3, 3, 4, 4, 5, 5};
+	unsigned char buffer[CODEC_VARINT_MAX + 1];
+	unsigned int value;
+	unsigned char length;
+	unsigned char i;
+
+	for(i = 0; i < (sizeof(values) / sizeof(values[0])); i++){
+		memset(buffer, 0xA5, sizeof(buffer));
+		length = codec_put_varint(buffer, values[i]);
+
+		TEST_CHECK( length == lengths[i] );
+		TEST_CHECK( buffer[length] == 0xA5 );
+		TEST_CHECK( codec_get_varint(buffer, length, &value) == length );
+		TEST_CHECK( value == values[i] );
+
+		// One byte short of the space it needs
+		TEST_CHECK( codec_get_varint(buffer, length - 1, &value) == 0 );
+	}
+
+	// Continuation bits past the longest valid varint
+	memset(buffer, 0xFF, sizeof(buffer));
+	TEST_CHECK( codec_get_varint(buffer, sizeof(buffer), &value) == 0 );
+}
+
+
+void test_delta( void ){
+	struct tRecordData previous, sample, decoded;
+	unsigned char buffer[CODEC_DELTA_MAX + 1];
+	unsigned char length;
+
+	// Identical samples take one byte per field
+	memset(&previous, 0, sizeof(previous));
+	previous.reserved = 0x5A;
+	sample = previous;
+	TEST_CHECK( codec_delta_encode(&previous, &sample, buffer) == 5 );
+
+	// Every field as far from the previous one as it gets
+	previous.latitude = 0;
+	previous.longitude = INT_MIN;
+	previous.altitude = 0;
+	previous.speed = 0;
+	previous.heading = 0;
+	previous.lapDetected = 0;
+
+	sample.latitude = INT_MIN;
+	sample.longitude = 0;
+	sample.altitude = 0x8000;
+	sample.speed = 0x8000;
+	sample.heading = 0x8000;
+	sample.lapDetected = 1;
+	sample.reserved = previous.reserved;
+
+	memset(buffer, 0xA5, sizeof(buffer));
+	length = codec_delta_encode(&previous, &sample, buffer);
+
+	TEST_CHECK( length == CODEC_DELTA_MAX );
+	TEST_CHECK( buffer[CODEC_DELTA_MAX] == 0xA5 );
+	TEST_CHECK( codec_delta_decode(&previous, buffer, length, &decoded) == length );
+	TEST_CHECK( test_same_sample(&decoded, &sample) );
+
+	// A delta cut short at the end of a page is not decoded
+	TEST_CHECK( codec_delta_decode(&previous, buffer, length - 1, &decoded) == 0 );
+
+	// Differences wrap like the fields do
+	previous.latitude = INT_MAX;
+	sample.latitude = INT_MIN;
+	TEST_CHECK( codec_delta_encode(&previous, &sample, buffer) < CODEC_DELTA_MAX );
+	TEST_CHECK( codec_delta_decode(&previous, buffer, CODEC_DELTA_MAX, &decoded) > 0 );
+	TEST_CHECK( test_same_sample(&decoded, &sample) );
+
+	// Decoding in place, the way pages are expanded
+	length = codec_delta_encode(&previous, &sample, buffer);
+	decoded = previous;
+	TEST_CHECK( codec_delta_decode(&decoded, buffer, length, &decoded) == length );
+	TEST_CHECK( test_same_sample(&decoded, &sample) );
+}
+
+
+// Worst case samples until the page refuses one, it has to come back exactly
+void test_full_page( void ){
+	struct tRecordPackedPage page, before;
+	struct tRecordData samples[RECORD_PACKED_DELTA_SIZE];
+	unsigned char count = 0;
+	unsigned char i;
+
+	codec_page_start(&page, 1000);
+
+	TEST_CHECK( page.pageType == RECORD_PAGE_PACKED );
+	TEST_CHECK( page.firstSample == 1000 );
+
+	do{
+		memset(&samples[count], 0, sizeof(struct tRecordData));
+		samples[count].latitude = (count & 1) ? INT_MIN : 0;
+		samples[count].longitude = (count & 1) ? 0 : INT_MIN;
+		samples[count].altitude = (count & 1) ? 0x8000 : 0;
+		samples[count].speed = (count & 1) ? 0x8000 : 0;
+		samples[count].heading = (count & 1) ? 0x8000 : 0;
+		samples[count].lapDetected = count & 1;
+		before = page;
+	}while( codec_page_add(&page, &samples[(count > 0) ? (count - 1) : 0], &samples[count]) && (++count < RECORD_PACKED_DELTA_SIZE) );
+
+	// Keyframe plus as many worst case deltas as fit
+	TEST_CHECK( count == (1 + (RECORD_PACKED_DELTA_SIZE / CODEC_DELTA_MAX)) );
+	TEST_CHECK( page.sampleCount == count );
+	TEST_CHECK( page.deltaLength == ((count - 1) * CODEC_DELTA_MAX) );
+	TEST_CHECK( page.deltaLength <= RECORD_PACKED_DELTA_SIZE );
+
+	// The refused sample left the page as it was
+	TEST_CHECK( memcmp(&page, &before, sizeof(page)) == 0 );
+
+	// Unused delta bytes stay erased
+	for(i = page.deltaLength; i < RECORD_PACKED_DELTA_SIZE; i++){
+		TEST_CHECK( page.delta[i] == 0xFF );
+	}
+
+	TEST_CHECK( codec_page_expand(&page, 0, RECORD_PACKED_DELTA_SIZE, testExpanded) == count );
+	for(i = 0; i < count; i++){
+		TEST_CHECK( test_same_sample(&testExpanded[i], &samples[i]) );
+	}
+
+	// Unchanged samples take five bytes each
+	codec_page_start(&page, 0);
+	memset(&samples[0], 0, sizeof(struct tRecordData));
+	while( codec_page_add(&page, &samples[0], &samples[0]) );
+
+	TEST_CHECK( page.sampleCount == (1 + (RECORD_PACKED_DELTA_SIZE / 5)) );
+	TEST_CHECK( codec_page_expand(&page, 0, 0xFF, testExpanded) == page.sampleCount );
+}
+
+
+// A session split over pages the way the GPS task hands them off, once a worst case
+// sample might not fit. Every page decodes on its own and they join up again.
+void test_page_split( void ){
+	struct tRecordPackedPage *page = &testPages[0];
+	struct tRecordData previous;
+	unsigned short pages = 1;
+	unsigned int sample;
+	unsigned int expanded;
+	unsigned short i;
+	unsigned char count;
+
+	memset(&testTrack[0], 0, sizeof(struct tRecordData));
+	testTrack[0].latitude = 423601234;
+	testTrack[0].longitude = -710589876;
+
+	// Mostly small steps with the odd jump, like a fix coming back after losing it
+	for(sample = 1; sample < TEST_TRACK_SAMPLES; sample++){
+		testTrack[sample] = testTrack[sample - 1];
+
+		if( (test_random() % 50) == 0 ){
+			testTrack[sample].latitude += (signed int)test_random();
+			testTrack[sample].longitude -= (signed int)test_random();
+		}else{
+			testTrack[sample].latitude += (signed int)(test_random() % 2001) - 1000;
+			testTrack[sample].longitude += (signed int)(test_random() % 2001) - 1000;
+		}
+
+		testTrack[sample].altitude += (test_random() % 21) - 10;
+		testTrack[sample].speed = test_random() & 0xFFFF;
+		testTrack[sample].heading += test_random() % 360;
+		testTrack[sample].lapDetected = ((sample % 300) == 0);
+	}
+
+	codec_page_start(page, 0);
+
+	for(sample = 0; sample < TEST_TRACK_SAMPLES; sample++){
+		TEST_CHECK( codec_page_add(page, &previous, &testTrack[sample]) );
+		previous = testTrack[sample];
+
+		if( ((page->deltaLength + CODEC_DELTA_MAX) > RECORD_PACKED_DELTA_SIZE) && ((sample + 1) < TEST_TRACK_SAMPLES) && (pages < TEST_TRACK_PAGES) ){
+			codec_page_start(&testPages[pages], page->firstSample + page->sampleCount);
+			page = &testPages[pages++];
+		}
+	}
+
+	TEST_CHECK( pages > 1 );
+	TEST_CHECK( pages < TEST_TRACK_PAGES );
+
+	expanded = 0;
+	for(i = 0; i < pages; i++){
+		TEST_CHECK( testPages[i].firstSample == expanded );
+		TEST_CHECK( testPages[i].deltaLength <= RECORD_PACKED_DELTA_SIZE );
+		TEST_CHECK( test_same_sample(&testPages[i].keyframe, &testTrack[expanded]) );
+
+		count = codec_page_expand(&testPages[i], 0, 0xFF, testExpanded);
+		TEST_CHECK( count == testPages[i].sampleCount );
+
+		for(sample = 0; sample < count; sample++){
+			TEST_CHECK( test_same_sample(&testExpanded[sample], &testTrack[expanded + sample]) );
+		}
+
+		expanded += count;
+	}
+
+	TEST_CHECK( expanded == TEST_TRACK_SAMPLES );
+
+	// Part of a page, starting past its keyframe and running over its end
+	page = &testPages[1];
+	count = codec_page_expand(page, 3, 0xFF, testExpanded);
+
+	TEST_CHECK( count == (page->sampleCount - 3) );
+	TEST_CHECK( test_same_sample(&testExpanded[0], &testTrack[page->firstSample + 3]) );
+	TEST_CHECK( codec_page_expand(page, 3, 2, testExpanded) == 2 );
+	TEST_CHECK( test_same_sample(&testExpanded[1], &testTrack[page->firstSample + 4]) );
+	TEST_CHECK( codec_page_expand(page, page->sampleCount, 1, testExpanded) == 0 );
+
+	// A page whose delta length is corrupt stops at what decodes
+	page->deltaLength = 0xFFFF;
+	TEST_CHECK( codec_page_expand(page, 0, 0xFF, testExpanded) <= page->sampleCount );
+}
+
+
+int main( void ){
+
+	test_zigzag();
+	test_varint();
+	test_delta();
+	test_full_page();
+	test_page_split();
+
+	return test_report("test_codec");
+}
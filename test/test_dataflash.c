@@ -0,0 +1,630 @@
+/******************************************************************************
+ *
+ * Dataflash Emulator and Driver Host Test
+ *
+ * - Compiler:          GNU GCC, host build
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+
+
+#include <string.h>
+#include <asf.h>
+#include "hal.h"
+#include "sim_dataflash.h"
+#include "host_dataflash.h"
+#include "test.h"
+
+extern struct tFlash flash;
+extern struct tSessionLog session;
+
+#define TEST_TRACK_KEYS			8
+#define TEST_JOURNAL_WRITES		3000		// Enough to wrap the journal and compact every sector more than once
+#define TEST_POWER_LOSSES		200			// Points the journal run is cut at
+
+struct tTestEntry {
+	unsigned int generation;
+	unsigned short key;
+	unsigned char fill[26];
+};
+
+unsigned char testPage[SIM_PAGE_SIZE];
+unsigned char testRead[SIM_PAGE_SIZE];
+unsigned int testDurable[TEST_TRACK_KEYS];		// Newest generation of each key flushed with the part still powered
+unsigned int testWritten[TEST_TRACK_KEYS];		// Newest generation handed to the journal
+
+
+// One whole chip select, response gets what came back on MISO
+void test_command(const unsigned char *command, unsigned int length, unsigned char *response){
+	unsigned int i;
+
+	sim_select();
+	for(i = 0; i < length; i++){
+		if(response){
+			response[i] = sim_transfer(command[i]);
+		}else{
+			sim_transfer(command[i]);
+		}
+	}
+	sim_deselect();
+}
+
+unsigned char test_status( void ){
+	const unsigned char command[] = {DATAFLASH_CMD_READ_STATUS, DATAFLASH_CMD_DUMMY};
+	unsigned char response[2];
+
+	test_command(command, sizeof(command), response);
+	return response[1];
+}
+
+void test_write_enable( void ){
+	const unsigned char command[] = {DATAFLASH_CMD_WRITE_ENABLE};
+
+	test_command(command, sizeof(command), NULL);
+}
+
+void test_unprotect( void ){
+	const unsigned char command[] = {DATAFLASH_CMD_WRITE_STATUS1, 0x00};
+
+	test_write_enable();
+	test_command(command, sizeof(command), NULL);
+}
+
+void test_page_program(unsigned long address, const unsigned char *data, unsigned int length){
+	unsigned char command[4 + SIM_PAGE_SIZE + 16];
+
+	command[0] = DATAFLASH_CMD_PAGE_PROGRAM;
+	command[1] = (address >> 16) & 0xFF;
+	command[2] = (address >>  8) & 0xFF;
+	command[3] = address & 0xFF;
+	memcpy(&command[4], data, length);
+
+	test_command(command, 4 + length, NULL);
+}
+
+void test_erase_4kb(unsigned long address){
+	const unsigned char command[] = {FLASH_CMD_BLOCK_ERASE_4KB, (address >> 16) & 0xFF, (address >> 8) & 0xFF, address & 0xFF};
+
+	test_command(command, sizeof(command), NULL);
+}
+
+void test_read(unsigned long address, unsigned char *data, unsigned int length){
+	unsigned char command[5 + SIM_PAGE_SIZE];
+	unsigned char response[5 + SIM_PAGE_SIZE];
+
+	memset(command, DATAFLASH_CMD_DUMMY, sizeof(command));
+	command[0] = DATAFLASH_CMD_READ_ARRAY_FAST;
+	command[1] = (address >> 16) & 0xFF;
+	command[2] = (address >>  8) & 0xFF;
+	command[3] = address & 0xFF;
+
+	test_command(command, 5 + length, response);
+	memcpy(data, &response[5], length);
+}
+
+void test_wait_ready( void ){
+	while( test_status() & SIM_STATUS_BUSY ){
+		sim_advance(10000);
+	}
+}
+
+
+//--------------------------
+// The emulator on its own
+//--------------------------
+void test_sim_identify( void ){
+	const unsigned char command[] = {DATAFLASH_CMD_READ_DEVICE_ID, DATAFLASH_CMD_DUMMY, DATAFLASH_CMD_DUMMY, DATAFLASH_CMD_DUMMY};
+	unsigned char response[4];
+
+	sim_init(&simAt25df321);
+
+	test_command(command, sizeof(command), response);
+	TEST_CHECK( (response[1] == 0x1F) && (response[2] == 0x47) && (response[3] == 0x01) );
+
+	// Every sector protected and nothing enabled out of power-up
+	TEST_CHECK( (test_status() & (SIM_STATUS_WEL | SIM_STATUS_SWP_ALL)) == SIM_STATUS_SWP_ALL );
+	TEST_CHECK( sim_faults() == 0 );
+	TEST_CHECK( simFlash.stats[SIM_OP_OTHER].spiBytes == 4 );
+	TEST_CHECK( simFlash.stats[SIM_OP_STATUS].count == 1 );
+}
+
+void test_sim_write_rules( void ){
+	unsigned int i;
+
+	sim_init(&simAt25df321);
+	for(i = 0; i < SIM_PAGE_SIZE; i++){
+		testPage[i] = i;
+	}
+
+	// Protected at power-up
+	test_write_enable();
+	test_page_program(0x1000, testPage, SIM_PAGE_SIZE);
+	TEST_CHECK( simFlash.faults[SIM_FAULT_PROTECTED] == 1 );
+	TEST_CHECK( !(test_status() & SIM_STATUS_WEL) );
+
+	test_unprotect();
+	TEST_CHECK( (test_status() & SIM_STATUS_SWP_ALL) == 0 );
+
+	// No write enable latch
+	test_page_program(0x1000, testPage, SIM_PAGE_SIZE);
+	TEST_CHECK( simFlash.faults[SIM_FAULT_NOT_ENABLED] == 1 );
+	TEST_CHECK( simFlash.array[0x1001] == 0xFF );
+
+	test_write_enable();
+	TEST_CHECK( test_status() & SIM_STATUS_WEL );
+	test_page_program(0x1000, testPage, SIM_PAGE_SIZE);
+	TEST_CHECK( test_status() & SIM_STATUS_BUSY );
+
+	// Only status reads while it programs
+	test_read(0x1000, testRead, 16);
+	TEST_CHECK( simFlash.faults[SIM_FAULT_BUSY] == 1 );
+
+	sim_advance(simAt25df321.programTime * 1000ULL);
+	TEST_CHECK( !(test_status() & SIM_STATUS_BUSY) );
+
+	test_read(0x1000, testRead, SIM_PAGE_SIZE);
+	TEST_CHECK( memcmp(testRead, testPage, SIM_PAGE_SIZE) == 0 );
+
+	// Programming can only clear bits
+	memset(testPage, 0xFF, SIM_PAGE_SIZE);
+	testPage[0] = 0x0F;
+	test_write_enable();
+	test_page_program(0x1000, testPage, 1);
+	test_wait_ready();
+	TEST_CHECK( simFlash.faults[SIM_FAULT_UNERASED] == 1 );
+	TEST_CHECK( simFlash.array[0x1000] == 0x00 );
+
+	TEST_CHECK( simFlash.stats[SIM_OP_PROGRAM].count == 2 );
+	TEST_CHECK( simFlash.stats[SIM_OP_PROGRAM].busyTime == 2 * simAt25df321.programTime * 1000ULL );
+}
+
+void test_sim_page_wrap( void ){
+	unsigned int i;
+
+	sim_init(&simAt25df161);
+	test_unprotect();
+
+	for(i = 0; i < 16; i++){
+		testPage[i] = 0xA0 + i;
+	}
+
+	// Ten bytes from offset 250, the last four land at the start of the page
+	test_write_enable();
+	test_page_program(0x2000 + 250, testPage, 10);
+	test_wait_ready();
+
+	TEST_CHECK( simFlash.faults[SIM_FAULT_PAGE_WRAP] == 1 );
+	TEST_CHECK( simFlash.array[0x2000 + 255] == 0xA5 );
+	TEST_CHECK( simFlash.array[0x2000] == 0xA6 );
+	TEST_CHECK( simFlash.array[0x2003] == 0xA9 );
+	TEST_CHECK( simFlash.array[0x2004] == 0xFF );
+	TEST_CHECK( simFlash.array[0x2100] == 0xFF );
+}
+
+void test_sim_erase_suspend( void ){
+	const unsigned char suspend[] = {DATAFLASH_CMD_PGM_ERASE_SUSPEND};
+	const unsigned char resume[] = {DATAFLASH_CMD_PGM_ERASE_RESUME};
+	const unsigned char status2[] = {DATAFLASH_CMD_READ_STATUS, DATAFLASH_CMD_DUMMY, DATAFLASH_CMD_DUMMY};
+	unsigned char response[3];
+
+	sim_init(&simAt25df321);
+	test_unprotect();
+
+	memset(testPage, 0, SIM_PAGE_SIZE);
+	test_write_enable();
+	test_page_program(0x3000, testPage, SIM_PAGE_SIZE);
+	test_wait_ready();
+	test_write_enable();
+	test_page_program(0x5000, testPage, SIM_PAGE_SIZE);
+	test_wait_ready();
+
+	test_write_enable();
+	test_erase_4kb(0x3000);
+	sim_advance(10000000);
+	TEST_CHECK( test_status() & SIM_STATUS_BUSY );
+
+	test_command(suspend, sizeof(suspend), NULL);
+	sim_advance(simAt25df321.suspendTime * 1000ULL);
+	test_command(status2, sizeof(status2), response);
+	TEST_CHECK( !(response[1] & SIM_STATUS_BUSY) );
+	TEST_CHECK( response[2] & SIM_STATUS2_ES );
+
+	// Outside the block reads fine, inside it doesn't
+	test_read(0x5000, testRead, 16);
+	TEST_CHECK( (testRead[0] == 0x00) && (simFlash.faults[SIM_FAULT_SUSPENDED] == 0) );
+	test_read(0x3000, testRead, 16);
+	TEST_CHECK( simFlash.faults[SIM_FAULT_SUSPENDED] == 1 );
+
+	// 10ms were spent before the suspend, the other 40ms are left after the resume
+	test_command(resume, sizeof(resume), NULL);
+	sim_advance(39000000);
+	TEST_CHECK( test_status() & SIM_STATUS_BUSY );
+	sim_advance(1000000);
+	TEST_CHECK( !(test_status() & SIM_STATUS_BUSY) );
+
+	TEST_CHECK( simFlash.array[0x3000] == 0xFF );
+	TEST_CHECK( simFlash.eraseCount[3] == 1 );
+	TEST_CHECK( simFlash.stats[SIM_OP_ERASE_4KB].count == 1 );
+}
+
+void test_sim_power_modes( void ){
+	const unsigned char powerDown[] = {DATAFLASH_CMD_DEEP_POWER_DOWN};
+	const unsigned char wakeUp[] = {DATAFLASH_CMD_WAKEUP};
+	const unsigned char slowRead[] = {DATAFLASH_CMD_READ_ARRAY, 0, 0, 0, DATAFLASH_CMD_DUMMY};
+
+	sim_init(&simAt25df321);
+
+	test_command(powerDown, sizeof(powerDown), NULL);
+	sim_advance(simAt25df321.powerDownTime * 1000ULL);
+	test_status();
+	TEST_CHECK( simFlash.faults[SIM_FAULT_POWERED_DOWN] == 1 );
+
+	// Too soon after the wake-up
+	test_command(wakeUp, sizeof(wakeUp), NULL);
+	test_status();
+	TEST_CHECK( simFlash.faults[SIM_FAULT_WAKEUP_TIME] == 1 );
+
+	sim_advance(simAt25df321.wakeUpTime * 1000ULL);
+	test_status();
+	TEST_CHECK( simFlash.faults[SIM_FAULT_WAKEUP_TIME] == 1 );
+
+	// The plain array read tops out lower than the rest
+	sim_set_clock(50000000);
+	test_status();
+	TEST_CHECK( simFlash.faults[SIM_FAULT_CLOCK] == 0 );
+	test_command(slowRead, sizeof(slowRead), NULL);
+	TEST_CHECK( simFlash.faults[SIM_FAULT_CLOCK] == 1 );
+}
+
+void test_sim_power_loss( void ){
+	unsigned int i, programmed = 0;
+
+	sim_init(&simAt25df321);
+	test_unprotect();
+
+	memset(testPage, 0, SIM_PAGE_SIZE);
+	sim_power_loss(2, 50);
+
+	test_write_enable();
+	test_page_program(0x4000, testPage, SIM_PAGE_SIZE);
+	test_wait_ready();
+	TEST_CHECK( !simFlash.powerLost );
+
+	test_write_enable();
+	test_page_program(0x4100, testPage, SIM_PAGE_SIZE);
+	TEST_CHECK( simFlash.powerLost );
+
+	for(i = 0; i < SIM_PAGE_SIZE; i++){
+		programmed += (simFlash.array[0x4100 + i] == 0x00);
+	}
+	TEST_CHECK( programmed == SIM_PAGE_SIZE / 2 );
+
+	// Dark until power comes back, then protected again
+	test_read(0x4000, testRead, 4);
+	TEST_CHECK( testRead[0] == SIM_MISO_OFF );
+	TEST_CHECK( simFlash.ignoredCommands == 1 );
+
+	sim_power_cycle();
+	test_read(0x4000, testRead, 4);
+	TEST_CHECK( testRead[0] == 0x00 );
+	TEST_CHECK( (test_status() & SIM_STATUS_SWP_ALL) == SIM_STATUS_SWP_ALL );
+
+	// An erase cut right away leaves the sector it stopped in half done
+	test_unprotect();
+	test_write_enable();
+	test_page_program(0x4800, testPage, SIM_PAGE_SIZE);
+	test_wait_ready();
+	sim_power_loss(1, 0);
+	test_write_enable();
+	test_erase_4kb(0x4000);
+	TEST_CHECK( simFlash.powerLost );
+	TEST_CHECK( simFlash.eraseCount[4] == 0 );
+	sim_power_cycle();
+	TEST_CHECK( simFlash.array[0x4100] == 0xFF );
+	TEST_CHECK( simFlash.array[0x4800] == 0x00 );
+}
+
+
+//--------------------------
+// The driver on the emulator
+//--------------------------
+// flash_task() up to its request loop, which never returns
+void test_task_start( void ){
+	flash_GlobalUnprotect();
+	flash_WriteEnable();
+
+	if(flash.layout.formatPending){
+		flash_migrate_v130();
+		flash_write_partitions();
+	}
+
+	session_mount();
+	flash_read_stop();
+
+	hostSchedulerState = taskSCHEDULER_RUNNING;
+}
+
+// Like a reset of the MCU, the part keeps whatever state it was in
+void test_boot( void ){
+	memset(&flash, 0, sizeof(flash));
+	host_reset();
+	flash_task_init();
+	test_task_start();
+}
+
+void test_driver_boot( void ){
+	sim_init(&simAt25df321);
+	test_boot();
+
+	TEST_CHECK( flash.device == ATMEL_AT25DF321 );
+	TEST_CHECK( flash.layout.formatPending == FALSE );
+	TEST_CHECK( sim_faults() == 0 );
+
+	// The partition table is there on the next boot
+	test_boot();
+	TEST_CHECK( flash.layout.formatPending == FALSE );
+	TEST_CHECK( hostWarnings == 2 );		// Blank OTP and no user preferences yet
+	TEST_CHECK( sim_faults() == 0 );
+
+	// A watchdog reset while the part sleeps in deep power-down
+	flash_powerDown();
+	TEST_CHECK( simFlash.poweredDown );
+	test_boot();
+	TEST_CHECK( flash.device == ATMEL_AT25DF321 );
+	TEST_CHECK( !simFlash.poweredDown );
+	TEST_CHECK( sim_faults() == 0 );
+}
+
+void test_driver_round_trip( void ){
+	unsigned long address;
+	unsigned int i;
+
+	sim_init(&simAt25df161);
+	test_boot();
+	sim_reset_stats();
+
+	address = flash.layout.recordDataStart;
+	for(i = 0; i < SIM_PAGE_SIZE; i++){
+		testPage[i] = i ^ 0x5A;
+	}
+
+	TEST_CHECK( flash_program(address, SIM_PAGE_SIZE, testPage) == DATAFLASH_RESPONSE_OK );
+	TEST_CHECK( flash_program(address + SIM_PAGE_SIZE, SIM_PAGE_SIZE / 2, testPage) == DATAFLASH_RESPONSE_OK );
+	TEST_CHECK( flash_read_array(address, SIM_PAGE_SIZE, testRead) == DATAFLASH_RESPONSE_OK );
+	flash_read_stop();
+	TEST_CHECK( memcmp(testRead, testPage, SIM_PAGE_SIZE) == 0 );
+	TEST_CHECK( memcmp(&simFlash.array[address + SIM_PAGE_SIZE], testPage, SIM_PAGE_SIZE / 2) == 0 );
+	TEST_CHECK( simFlash.array[address + SIM_PAGE_SIZE + (SIM_PAGE_SIZE / 2)] == 0xFF );
+
+	TEST_CHECK( flash_erase(FLASH_CMD_BLOCK_ERASE_4KB, address) == DATAFLASH_RESPONSE_OK );
+	TEST_CHECK( simFlash.array[address] == 0xFF );
+	TEST_CHECK( simFlash.eraseCount[address / SIM_SECTOR_SIZE] == 1 );
+
+	TEST_CHECK( flash_erase(DATAFLASH_CMD_BLOCK_ERASE_64KB, address) == DATAFLASH_RESPONSE_OK );
+	TEST_CHECK( simFlash.stats[SIM_OP_ERASE_64KB].count == 1 );
+
+	// The driver waits out each program and erase instead of running into them
+	TEST_CHECK( simFlash.stats[SIM_OP_PROGRAM].count == 2 );
+	TEST_CHECK( simFlash.stats[SIM_OP_PROGRAM].spiBytes == (2 * 4) + SIM_PAGE_SIZE + (SIM_PAGE_SIZE / 2) );
+	TEST_CHECK( sim_faults() == 0 );
+
+	sim_report("Program, read and erase");
+}
+
+// A session checkpointed after pages pages and cut off there. The sector after the first
+// one holds an older lap's data, as it does once the log has gone around.
+void test_session_resume(unsigned long pages){
+	struct tSessionCheckpoint checkpoint;
+	unsigned long start, i;
+
+	sim_init(&simAt25df321);
+	test_boot();
+
+	start = session.current.startAddress;
+	memset(&simFlash.array[start + SIM_SECTOR_SIZE], 0x00, SIM_SECTOR_SIZE);
+
+	for(i = 0; i < pages; i++){
+		memset(testPage, 0xFF, sizeof(testPage));
+		testPage[0] = RECORD_PAGE_PACKED;
+		TEST_CHECK( session_add_page(testPage, FLASH_PAGE_SIZE) == DATAFLASH_RESPONSE_OK );
+	}
+	TEST_CHECK( session_checkpoint(&checkpoint) == DATAFLASH_RESPONSE_OK );
+
+	sim_power_cycle();
+	test_boot();
+
+	TEST_CHECK( session.resumed );
+	TEST_CHECK( session.current.startAddress == start );
+	TEST_CHECK( session.current.endAddress == start + (pages * FLASH_PAGE_SIZE) );
+	TEST_CHECK( !(session.current.flags & RECORD_FLAG_HEADING) );
+
+	// The next page goes on where it stopped, into an erased sector
+	testPage[0] = RECORD_PAGE_PACKED;
+	TEST_CHECK( session_add_page(testPage, FLASH_PAGE_SIZE) == DATAFLASH_RESPONSE_OK );
+	TEST_CHECK( simFlash.array[start + (pages * FLASH_PAGE_SIZE)] == RECORD_PAGE_PACKED );
+	TEST_CHECK( sim_faults() == 0 );
+}
+
+// A part last written by 1.30: its record table is where the journal goes and the
+// first session lies under the journal, the two after it are in the record data region.
+void test_migrate_v130( void ){
+	struct tRecordsEntry entry;
+	unsigned long start[3] = {0x00002000, FLASH_AT25DF321_RECORDDATA_START + SIM_SECTOR_SIZE, FLASH_AT25DF321_RECORDDATA_START + (3 * SIM_SECTOR_SIZE)};
+	unsigned char i;
+
+	sim_init(&simAt25df321);
+
+	for(i = 0; i < 3; i++){
+		memset(&entry, 0x00, sizeof(entry));
+		entry.trackID = i;
+		entry.datestamp = 1000 + i;
+		entry.startAddress = start[i];
+		entry.endAddress = start[i] + (2 * FLASH_PAGE_SIZE) - 1;
+		memcpy(&simFlash.array[FLASH_V130_RECORDTABLE_START + (i * sizeof(entry))], &entry, sizeof(entry));
+		memset(&simFlash.array[start[i]], i, 2 * FLASH_PAGE_SIZE);
+	}
+
+	test_boot();
+
+	TEST_CHECK( session_count() == 2 );
+	for(i = 0; i < 2; i++){
+		TEST_CHECK( session_read_entry(i, &entry) == DATAFLASH_RESPONSE_OK );
+		TEST_CHECK( entry.trackID == i + 1 );
+		TEST_CHECK( entry.datestamp == (unsigned int)(1000 + i + 1) );
+		TEST_CHECK( entry.startAddress == start[i + 1] );
+		TEST_CHECK( entry.endAddress == start[i + 1] + (2 * FLASH_PAGE_SIZE) - 1 );
+		TEST_CHECK( entry.flags & RECORD_FLAG_HEADING );
+		TEST_CHECK( entry.flags & RECORD_FLAG_PACKED );
+	}
+
+	// The pages are still there and recording goes on behind them
+	TEST_CHECK( simFlash.array[start[2] + FLASH_PAGE_SIZE] == 2 );
+	TEST_CHECK( session.current.startAddress == start[2] + (2 * FLASH_PAGE_SIZE) );
+
+	// Nothing is migrated twice
+	test_boot();
+	TEST_CHECK( session_count() == 2 );
+	TEST_CHECK( sim_faults() == 0 );
+}
+
+// Key 0 is written once and key 1 rarely, so compactions have live entries to carry over
+unsigned char test_journal_key(unsigned int generation){
+	if(generation <= TEST_TRACK_KEYS){
+		return generation - 1;
+	}else if( (generation % 250) == 0 ){
+		return 1;
+	}
+
+	return 2 + (generation % (TEST_TRACK_KEYS - 2));
+}
+
+// Writes generations of the track keys until the part loses power or the run ends
+void test_journal_run( void ){
+	struct tTestEntry entry;
+	unsigned int i;
+
+	memset(&entry, 0x3C, sizeof(entry));
+
+	for(i = 1; (i <= TEST_JOURNAL_WRITES) && !simFlash.powerLost; i++){
+		entry.generation = i;
+		entry.key = test_journal_key(i);
+		testWritten[entry.key] = i;
+
+		if( (journal_write(JOURNAL_TYPE_TRACK, entry.key, (unsigned char *)&entry, sizeof(entry)) == DATAFLASH_RESPONSE_OK) &&
+			(journal_flush() == DATAFLASH_RESPONSE_OK) && !simFlash.powerLost ){
+			testDurable[entry.key] = i;
+		}
+	}
+}
+
+// Boots, runs the journal until the armed power loss and checks what the next boot finds
+void test_journal_cut(unsigned int operations, unsigned char percent, unsigned char erasesOnly){
+	struct tTestEntry entry;
+	unsigned int before;
+	unsigned char key;
+
+	sim_init(&simAt25df321);
+	test_boot();
+
+	memset(testDurable, 0, sizeof(testDurable));
+	memset(testWritten, 0, sizeof(testWritten));
+
+	if(erasesOnly){
+		sim_power_loss_erase(operations, percent);
+	}else{
+		sim_power_loss(operations, percent);
+	}
+
+	test_journal_run();
+	TEST_CHECK( simFlash.powerLost );
+
+	sim_power_cycle();
+	before = sim_faults();
+	test_boot();
+	TEST_CHECK( sim_faults() == before );
+
+	// Every key reads back what was flushed last, or something written after it
+	for(key = 0; key < TEST_TRACK_KEYS; key++){
+		if( journal_read(JOURNAL_TYPE_TRACK, key, (unsigned char *)&entry, sizeof(entry)) == DATAFLASH_RESPONSE_OK ){
+			TEST_CHECK( (entry.generation >= testDurable[key]) && (entry.generation <= testWritten[key]) );
+			TEST_CHECK( (entry.key == key) && (test_journal_key(entry.generation) == key) );
+		}else{
+			TEST_CHECK( testDurable[key] == 0 );
+		}
+	}
+
+	// And the journal carries on from there
+	entry.generation = TEST_JOURNAL_WRITES + 1;
+	TEST_CHECK( journal_write(JOURNAL_TYPE_TRACK, 1, (unsigned char *)&entry, sizeof(entry)) == DATAFLASH_RESPONSE_OK );
+	TEST_CHECK( journal_flush() == DATAFLASH_RESPONSE_OK );
+	test_boot();
+	entry.generation = 0;
+	TEST_CHECK( journal_read(JOURNAL_TYPE_TRACK, 1, (unsigned char *)&entry, sizeof(entry)) == DATAFLASH_RESPONSE_OK );
+	TEST_CHECK( entry.generation == TEST_JOURNAL_WRITES + 1 );
+}
+
+void test_journal_power_loss( void ){
+	unsigned int operations, erases, cut;
+
+	// Count the programs and erases of an uninterrupted run
+	sim_init(&simAt25df321);
+	test_boot();
+	sim_reset_stats();
+	test_journal_run();
+	erases = simFlash.stats[SIM_OP_ERASE_4KB].count;
+	operations = simFlash.stats[SIM_OP_PROGRAM].count + erases;
+	TEST_CHECK( erases > (flash.layout.journalEnd - flash.layout.journalStart + 1) / SIM_SECTOR_SIZE );
+	TEST_CHECK( sim_faults() == 0 );
+	sim_report("Journal, uninterrupted");
+
+	// Programs torn anywhere along the run, then every erase
+	for(cut = 0; cut < TEST_POWER_LOSSES; cut++){
+		test_journal_cut(1 + ((operations * cut) / TEST_POWER_LOSSES), (cut * 37) % 100, FALSE);
+	}
+
+	for(cut = 1; cut <= erases; cut++){
+		test_journal_cut(cut, 50, TRUE);
+	}
+}
+
+
+int main( void ){
+	test_sim_identify();
+	test_sim_write_rules();
+	test_sim_page_wrap();
+	test_sim_erase_suspend();
+	test_sim_power_modes();
+	test_sim_power_loss();
+
+	test_driver_boot();
+	test_driver_round_trip();
+	test_session_resume(5);
+	test_session_resume(SIM_SECTOR_SIZE / FLASH_PAGE_SIZE);
+	test_migrate_v130();
+	test_journal_power_loss();
+
+	sim_free();
+
+	return test_report("test_dataflash");
+}
@@ -0,0 +1,267 @@
+/******************************************************************************
+ *
+ * Dataflash SPI Setup Host Test
+ *
+ * - Compiler:          GNU GCC, host build
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+
+
+#include <string.h>
+#include <asf.h>
+#include "hal.h"
+#include "sim_dataflash.h"
+#include "host_dataflash.h"
+#include "test.h"
+
+extern struct tFlash flash;
+
+#define TEST_SFDP_TABLE			0x80
+#define TEST_READ_LENGTH		16
+
+// SFDP header and basic table of a Winbond W25Q128FV, as in test_sfdp.c
+const unsigned char testW25q128Header[SFDP_HEADER_LENGTH] = {
+	0x53, 0x46, 0x44, 0x50, 0x05, 0x01, 0x00, 0xFF,
+	0x00, 0x05, 0x01, 0x10, 0x80, 0x00, 0x00, 0xFF
+};
+
+const unsigned char testW25q128Table[SFDP_BASIC_MAX_DWORDS * 4] = {
+	0xE5, 0x20, 0xF9, 0xFF, 0xFF, 0xFF, 0xFF, 0x07,
+	0x44, 0xEB, 0x08, 0x6B, 0x08, 0x3B, 0x42, 0xBB,
+	0xFE, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00,
+	0xFF, 0xFF, 0x40, 0xEB, 0x0C, 0x20, 0x0F, 0x52,
+	0x10, 0xD8, 0x00, 0x00, 0x36, 0x02, 0xA6, 0x00,
+	0x82, 0xEA, 0x14, 0xC9, 0xE9, 0x63, 0x76, 0x33,
+	0x7A, 0x75, 0x7A, 0x75, 0xF7, 0xA2, 0xD5, 0x5C,
+	0x19, 0xF7, 0x4D, 0xFF, 0xE9, 0x30, 0xF8, 0x80
+};
+
+unsigned char testSfdp[TEST_SFDP_TABLE + sizeof(testW25q128Table)];
+
+const struct tSimPart testW25q128 = {
+	"W25Q128FV", {0xEF, 0x40, 0x18}, 0x01000000,
+	104000000, 50000000,
+	0x75, 0x7A, 0, 0,
+	700, {45000, 120000, 150000}, 40000000, 20, 3, 3,
+	testSfdp, sizeof(testSfdp)
+};
+
+// Nothing on the ID list, no SFDP and a manufacturer without family defaults
+const struct tSimPart testUnknown = {
+	"unknown", {0x12, 0x34, 0x15}, 0x00200000,
+	20000000, 20000000,
+	0, 0, 0, 0,
+	1000, {50000, 250000, 400000}, 16000000, 20, 30, 1,
+	NULL, 0
+};
+
+unsigned char testRead[TEST_READ_LENGTH];
+
+
+// First command in the trace with this opcode, NULL if there's none
+struct tSimCommand *test_find(unsigned char opcode){
+	unsigned int i;
+
+	for(i = 0; (i < simFlash.traceLength) && (i < SIM_TRACE_SIZE); i++){
+		if(simFlash.trace[i].opcode == opcode){
+			return &simFlash.trace[i];
+		}
+	}
+
+	return NULL;
+}
+
+// Fresh part and a fresh MCU, the board left SCK on the identification clock
+void test_power_up(const struct tSimPart *part){
+	sim_init(part);
+	memset(&flash, 0, sizeof(flash));
+	host_reset();
+}
+
+// The wake-up and the ID read open every identification, both on the identification clock
+void test_identify_sequence( void ){
+	struct tSimCommand *wakeUp = &simFlash.trace[0];
+	struct tSimCommand *readId = &simFlash.trace[1];
+
+	TEST_CHECK( simFlash.traceLength >= 2 );
+	TEST_CHECK( (wakeUp->opcode == DATAFLASH_CMD_WAKEUP) && (wakeUp->length == 1) );
+	TEST_CHECK( (readId->opcode == DATAFLASH_CMD_READ_DEVICE_ID) && (readId->length == 4) );
+	TEST_CHECK( (readId->start - wakeUp->end) >= (DATAFLASH_WAKEUP_TIME * 1000ULL) );
+	TEST_CHECK( (wakeUp->clock == FLASH_SPI_BAUDRATE) && (readId->clock == FLASH_SPI_BAUDRATE) );
+}
+
+// Fast read with its dummy byte at the full clock
+void test_fast_read( void ){
+	struct tSimCommand *read;
+
+	sim_clear_trace();
+	TEST_CHECK( flash_read_array(0, TEST_READ_LENGTH, testRead) == DATAFLASH_RESPONSE_OK );
+	flash_read_stop();
+
+	read = test_find(DATAFLASH_CMD_READ_ARRAY_FAST);
+	TEST_CHECK( read != NULL );
+	if(read != NULL){
+		TEST_CHECK( read->length == 1 + 3 + 1 + TEST_READ_LENGTH );
+		TEST_CHECK( read->clock == flash.spiClock );
+	}
+	TEST_CHECK( test_find(DATAFLASH_CMD_READ_ARRAY) == NULL );
+}
+
+
+void test_setup_spi( void ){
+	const unsigned int limits[] = {85000000, 66000000, 50000000, 24000000, 23999999, 12000000, 11900000, 8000000, 7900000, 100000, 50000};
+	const unsigned int divisors[] = {1, 1, 1, 1, 2, 2, 3, 3, 4, 240, 255};
+	unsigned char i;
+
+	test_power_up(&simAt25df161);
+
+	for(i = 0; i < (sizeof(limits) / sizeof(limits[0])); i++){
+		flash_setupSpi(limits[i]);
+		TEST_CHECK( AVR32_SPI0.CSR0.scbr == divisors[i] );
+		TEST_CHECK( flash.spiClock == APPL_PBA_SPEED / divisors[i] );
+
+		// Never above the limit, unless the divisor ran out
+		TEST_CHECK( (flash.spiClock <= limits[i]) || (divisors[i] == DATAFLASH_SPI_MAX_DIVISOR) );
+	}
+
+	// No command goes out to change the clock
+	TEST_CHECK( simFlash.traceLength == 0 );
+}
+
+void test_at25df( void ){
+	const struct tSimPart *parts[] = {&simAt25df161, &simAt25df321};
+	const enum tFlashDevice devices[] = {ATMEL_AT25DF161, ATMEL_AT25DF321};
+	unsigned char i;
+
+	for(i = 0; i < 2; i++){
+		test_power_up(parts[i]);
+
+		TEST_CHECK( flash_initDevice() == devices[i] );
+		test_identify_sequence();
+
+		// Nothing else before the part is known, and both run at the full 24MHz
+		TEST_CHECK( simFlash.traceLength == 2 );
+		TEST_CHECK( AVR32_SPI0.CSR0.scbr == 1 );
+		TEST_CHECK( flash.spiClock == APPL_PBA_SPEED );
+		TEST_CHECK( (flash.readCommand == DATAFLASH_CMD_READ_ARRAY_FAST) && (flash.readDummyBytes == 1) );
+		TEST_CHECK( flash.part.size == parts[i]->size );
+
+		test_fast_read();
+		TEST_CHECK( sim_faults() == 0 );
+	}
+}
+
+// The MCU reset with the part still in deep power-down
+void test_at25df_powered_down( void ){
+	const unsigned char powerDown = DATAFLASH_CMD_DEEP_POWER_DOWN;
+
+	test_power_up(&simAt25df321);
+
+	sim_select();
+	sim_transfer(powerDown);
+	sim_deselect();
+	sim_advance(simAt25df321.powerDownTime * 1000ULL);
+	sim_clear_trace();
+
+	TEST_CHECK( flash_initDevice() == ATMEL_AT25DF321 );
+	test_identify_sequence();
+	TEST_CHECK( !simFlash.poweredDown );
+	TEST_CHECK( sim_faults() == 0 );
+}
+
+void test_generic( void ){
+	struct tSimCommand *header = &simFlash.trace[2];
+	struct tSimCommand *table = &simFlash.trace[3];
+
+	test_power_up(&testW25q128);
+
+	TEST_CHECK( flash_initDevice() == GENERIC_DEVICE );
+	test_identify_sequence();
+
+	// SFDP header then the basic table it points at, still on the identification clock
+	TEST_CHECK( simFlash.traceLength == 4 );
+	TEST_CHECK( (header->opcode == SFDP_CMD_READ) && (header->length == 1 + 3 + 1 + SFDP_HEADER_LENGTH) );
+	TEST_CHECK( (table->opcode == SFDP_CMD_READ) && (table->length == 1 + 3 + 1 + sizeof(testW25q128Table)) );
+	TEST_CHECK( (header->clock == FLASH_SPI_BAUDRATE) && (table->clock == FLASH_SPI_BAUDRATE) );
+
+	// 50MHz is the generic limit, PBA/1 is under it
+	TEST_CHECK( AVR32_SPI0.CSR0.scbr == 1 );
+	TEST_CHECK( flash.spiClock == APPL_PBA_SPEED );
+	TEST_CHECK( (flash.readCommand == DATAFLASH_CMD_READ_ARRAY_FAST) && (flash.readDummyBytes == 1) );
+
+	// What the part told about itself
+	TEST_CHECK( flash.part.size == testW25q128.size );
+	TEST_CHECK( flash.part.eraseCommand[FLASH_ERASE_4KB] == 0x20 );
+	TEST_CHECK( flash.part.eraseCommand[FLASH_ERASE_32KB] == 0x52 );
+	TEST_CHECK( flash.part.eraseCommand[FLASH_ERASE_64KB] == 0xD8 );
+	TEST_CHECK( (flash.part.suspendCommand == 0x75) && (flash.part.resumeCommand == 0x7A) );
+
+	test_fast_read();
+	TEST_CHECK( sim_faults() == 0 );
+}
+
+void test_unknown( void ){
+	struct tSimCommand *read;
+
+	test_power_up(&testUnknown);
+
+	TEST_CHECK( flash_initDevice() == UNKNOWN_DEVICE );
+	test_identify_sequence();
+
+	// Stays on the identification clock with the plain read
+	TEST_CHECK( AVR32_SPI0.CSR0.scbr == APPL_PBA_SPEED / FLASH_SPI_BAUDRATE );
+	TEST_CHECK( flash.spiClock == FLASH_SPI_BAUDRATE );
+	TEST_CHECK( (flash.readCommand == DATAFLASH_CMD_READ_ARRAY) && (flash.readDummyBytes == 0) );
+
+	sim_clear_trace();
+	TEST_CHECK( flash_read_array(0, TEST_READ_LENGTH, testRead) == DATAFLASH_RESPONSE_OK );
+	flash_read_stop();
+
+	read = test_find(DATAFLASH_CMD_READ_ARRAY);
+	TEST_CHECK( read != NULL );
+	if(read != NULL){
+		TEST_CHECK( read->length == 1 + 3 + TEST_READ_LENGTH );
+		TEST_CHECK( read->clock == FLASH_SPI_BAUDRATE );
+	}
+	TEST_CHECK( test_find(DATAFLASH_CMD_READ_ARRAY_FAST) == NULL );
+	TEST_CHECK( sim_faults() == 0 );
+}
+
+
+int main( void ){
+	memset(testSfdp, 0xFF, sizeof(testSfdp));
+	memcpy(testSfdp, testW25q128Header, sizeof(testW25q128Header));
+	memcpy(&testSfdp[TEST_SFDP_TABLE], testW25q128Table, sizeof(testW25q128Table));
+
+	test_setup_spi();
+	test_at25df();
+	test_at25df_powered_down();
+	test_generic();
+	test_unknown();
+
+	sim_free();
+
+	return test_report("test_flash_spi");
+}
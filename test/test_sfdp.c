@@ -0,0 +1,319 @@
+/******************************************************************************
+ *
+ * Serial Flash Discoverable Parameters Host Test
+ *
+ * - Compiler:          GNU GCC, host build
+ * - Supported devices: traq|paq hardware version 1.4
+ * - AppNote:			N/A
+ *
+ * - Last Author:		Ryan David ( ryan.david@redline-electronics.com )
+ *
+ *
+ * Copyright (c) 2012 Redline Electronics LLC.
+ *
+ * This file is part of traq|paq.
+ *
+ * traq|paq is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * traq|paq is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with traq|paq. If not, see http://www.gnu.org/licenses/.
+ *
+ ******************************************************************************/
+
+
+#include <string.h>
+#include "flash_sfdp.h"
+#include "test.h"
+
+// SFDP header and basic table read from a Winbond W25Q128FV, revision 1.5 with 16 DWORDs at 0x80
+const unsigned char testW25q128Header[SFDP_HEADER_LENGTH] = {
+	0x53, 0x46, 0x44, 0x50, 0x05, 0x01, 0x00, 0xFF,
+	0x00, 0x05, 0x01, 0x10, 0x80, 0x00, 0x00, 0xFF
+};
+
+const unsigned char testW25q128Table[SFDP_BASIC_MAX_DWORDS * 4] = {
+	0xE5, 0x20, 0xF9, 0xFF, 0xFF, 0xFF, 0xFF, 0x07,		// DWORD1-2, 128Mbit
+	0x44, 0xEB, 0x08, 0x6B, 0x08, 0x3B, 0x42, 0xBB,		// DWORD3-4
+	0xFE, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00,		// DWORD5-6
+	0xFF, 0xFF, 0x40, 0xEB, 0x0C, 0x20, 0x0F, 0x52,		// DWORD7-8, 4KB 0x20 and 32KB 0x52
+	0x10, 0xD8, 0x00, 0x00, 0x36, 0x02, 0xA6, 0x00,		// DWORD9-10, 64KB 0xD8 and erase times
+	0x82, 0xEA, 0x14, 0xC9, 0xE9, 0x63, 0x76, 0x33,		// DWORD11-12, program and chip erase times
+	0x7A, 0x75, 0x7A, 0x75, 0xF7, 0xA2, 0xD5, 0x5C,		// DWORD13-14, suspend 0x75 and deep power-down 0xB9
+	0x19, 0xF7, 0x4D, 0xFF, 0xE9, 0x30, 0xF8, 0x80		// DWORD15-16
+};
+
+
+void test_put_dword(unsigned char *table, unsigned char number, unsigned long value){
+	unsigned char *dword = &table[(number - 1) * 4];
+
+	dword[0] = value & 0xFF;
+	dword[1] = (value >> 8) & 0xFF;
+	dword[2] = (value >> 16) & 0xFF;
+	dword[3] = (value >> 24) & 0xFF;
+}
+
+// Basic table whose first parameter header says it has dwords DWORDs, revision minor
+void test_header(unsigned char *header, unsigned char minor, unsigned char dwords){
+	memcpy(header, testW25q128Header, SFDP_HEADER_LENGTH);
+	header[4] = minor;
+	header[9] = minor;
+	header[11] = dwords;
+}
+
+void test_table(unsigned char *table){
+	memcpy(table, testW25q128Table, sizeof(testW25q128Table));
+}
+
+
+void test_find_basic( void ){
+	unsigned char header[SFDP_HEADER_LENGTH];
+	unsigned long tableAddress = 0;
+	unsigned char tableDwords = 0;
+
+	test_header(header, 5, 16);
+	TEST_CHECK( sfdp_find_basic(header, &tableAddress, &tableDwords) );
+	TEST_CHECK( tableAddress == 0x80 );
+	TEST_CHECK( tableDwords == 16 );
+
+	// Later revisions only grow the table, the driver reads what it knows
+	test_header(header, 8, 23);
+	TEST_CHECK( sfdp_find_basic(header, &tableAddress, &tableDwords) );
+	TEST_CHECK( tableDwords == SFDP_BASIC_MAX_DWORDS );
+
+	// Signature with one byte wrong
+	test_header(header, 5, 16);
+	header[3] = 0x51;
+	TEST_CHECK( !sfdp_find_basic(header, &tableAddress, &tableDwords) );
+
+	// Erased or unsupported SFDP area
+	memset(header, 0xFF, sizeof(header));
+	TEST_CHECK( !sfdp_find_basic(header, &tableAddress, &tableDwords) );
+
+	test_header(header, 5, 16);
+	header[5] = 2;
+	TEST_CHECK( !sfdp_find_basic(header, &tableAddress, &tableDwords) );
+
+	// First parameter header isn't the basic table
+	test_header(header, 5, 16);
+	header[8] = 0x84;
+	TEST_CHECK( !sfdp_find_basic(header, &tableAddress, &tableDwords) );
+
+	// Shorter than the JESD216 table
+	test_header(header, 0, SFDP_BASIC_MIN_DWORDS - 1);
+	TEST_CHECK( !sfdp_find_basic(header, &tableAddress, &tableDwords) );
+}
+
+
+// JESD216, 9 DWORDs: erase opcodes only, times and suspend stay with the family
+void test_jesd216( void ){
+	unsigned char header[SFDP_HEADER_LENGTH];
+	unsigned char table[SFDP_BASIC_MAX_DWORDS * 4];
+	unsigned long tableAddress;
+	unsigned char tableDwords;
+	struct tFlashPart part;
+
+	test_header(header, 0, 9);
+	test_table(table);
+	memset(&table[9 * 4], 0xFF, sizeof(table) - (9 * 4));
+
+	TEST_CHECK( sfdp_family_defaults(0xC2, 0x17, &part) );
+	TEST_CHECK( part.size == 0x800000 );
+
+	TEST_CHECK( sfdp_find_basic(header, &tableAddress, &tableDwords) );
+	TEST_CHECK( tableDwords == 9 );
+	TEST_CHECK( sfdp_parse_basic(table, tableDwords, &part) );
+
+	TEST_CHECK( part.size == 0x1000000 );
+	TEST_CHECK( part.eraseCommand[FLASH_ERASE_4KB] == 0x20 );
+	TEST_CHECK( part.eraseCommand[FLASH_ERASE_32KB] == 0x52 );
+	TEST_CHECK( part.eraseCommand[FLASH_ERASE_64KB] == 0xD8 );
+
+	TEST_CHECK( part.programTime == SFDP_DEFAULT_PROGRAM_TIME );
+	TEST_CHECK( part.eraseTime[FLASH_ERASE_4KB] == SFDP_DEFAULT_ERASE_4KB_TIME );
+	TEST_CHECK( part.eraseTime[FLASH_ERASE_64KB] == SFDP_DEFAULT_ERASE_64KB_TIME );
+	TEST_CHECK( part.chipEraseTime == SFDP_DEFAULT_CHIP_ERASE_TIME );
+
+	TEST_CHECK( part.suspendCommand == 0xB0 );
+	TEST_CHECK( part.resumeCommand == 0x30 );
+	TEST_CHECK( part.powerDownCommand == SFDP_CMD_DEEP_POWER_DOWN );
+
+	// No erase types in DWORD8-9, the 4KB opcode of DWORD1 is all there is
+	test_put_dword(table, 8, 0);
+	test_put_dword(table, 9, 0);
+	TEST_CHECK( sfdp_parse_basic(table, tableDwords, &part) );
+	TEST_CHECK( part.eraseCommand[FLASH_ERASE_4KB] == 0x20 );
+	TEST_CHECK( part.eraseCommand[FLASH_ERASE_32KB] == 0 );
+	TEST_CHECK( part.eraseCommand[FLASH_ERASE_64KB] == 0 );
+
+	// Nor that, sectors can't be erased
+	test_put_dword(table, 1, sfdp_dword(table, 1) | 0x03);
+	TEST_CHECK( !sfdp_parse_basic(table, tableDwords, &part) );
+}
+
+
+// JESD216A, 11 DWORDs: adds typical erase, program and chip erase times
+void test_jesd216a( void ){
+	unsigned char header[SFDP_HEADER_LENGTH];
+	unsigned char table[SFDP_BASIC_MAX_DWORDS * 4];
+	unsigned long tableAddress;
+	unsigned char tableDwords;
+	struct tFlashPart part;
+
+	test_header(header, 5, 11);
+	test_table(table);
+	memset(&table[11 * 4], 0xFF, sizeof(table) - (11 * 4));
+
+	// 4KB 3 x 16ms, 32KB 10 x 16ms, 64KB 2 x 128ms
+	test_put_dword(table, 10, (((2 | (1 << 5)) << 4) | ((9 | (1 << 5)) << 11) | ((1 | (2 << 5)) << 18)));
+
+	// 256 byte pages, program 32 x 64us, chip erase 25 x 4s
+	test_put_dword(table, 11, ((8 << 4) | (31 << 8) | (1 << 13) | (24UL << 24) | (2UL << 29)));
+
+	TEST_CHECK( sfdp_family_defaults(0xEF, 0x18, &part) );
+	TEST_CHECK( sfdp_find_basic(header, &tableAddress, &tableDwords) );
+	TEST_CHECK( sfdp_parse_basic(table, tableDwords, &part) );
+
+	TEST_CHECK( part.eraseTime[FLASH_ERASE_4KB] == 48 );
+	TEST_CHECK( part.eraseTime[FLASH_ERASE_32KB] == 160 );
+	TEST_CHECK( part.eraseTime[FLASH_ERASE_64KB] == 256 );
+	TEST_CHECK( part.programTime == 3 );
+	TEST_CHECK( part.chipEraseTime == 100000 );
+
+	// Suspend opcodes are still the family's
+	TEST_CHECK( part.suspendCommand == 0x75 );
+	TEST_CHECK( part.resumeCommand == 0x7A );
+
+	// Program time in 8us units rounds up to a millisecond
+	test_put_dword(table, 11, ((8 << 4) | (0 << 8)));
+	TEST_CHECK( sfdp_parse_basic(table, tableDwords, &part) );
+	TEST_CHECK( part.programTime == 1 );
+	TEST_CHECK( part.chipEraseTime == 16 );
+
+	// Pages smaller than the driver splits programs at
+	test_put_dword(table, 11, (7 << 4));
+	TEST_CHECK( !sfdp_parse_basic(table, tableDwords, &part) );
+}
+
+
+// JESD216B, 16 DWORDs: adds the suspend and deep power-down opcodes
+void test_jesd216b( void ){
+	unsigned char header[SFDP_HEADER_LENGTH];
+	unsigned char table[SFDP_BASIC_MAX_DWORDS * 4];
+	unsigned long tableAddress;
+	unsigned char tableDwords;
+	struct tFlashPart part;
+
+	test_header(header, 6, 16);
+	test_table(table);
+
+	// Manufacturer not in the family list, its tables have everything
+	TEST_CHECK( !sfdp_family_defaults(0x01, 0x18, &part) );
+	TEST_CHECK( part.suspendCommand == 0 );
+
+	TEST_CHECK( sfdp_find_basic(header, &tableAddress, &tableDwords) );
+	TEST_CHECK( sfdp_parse_basic(table, tableDwords, &part) );
+
+	TEST_CHECK( part.size == 0x1000000 );
+	TEST_CHECK( part.eraseCommand[FLASH_ERASE_4KB] == 0x20 );
+	TEST_CHECK( part.eraseCommand[FLASH_ERASE_32KB] == 0x52 );
+	TEST_CHECK( part.eraseCommand[FLASH_ERASE_64KB] == 0xD8 );
+	TEST_CHECK( part.eraseTime[FLASH_ERASE_4KB] == 64 );
+	TEST_CHECK( part.eraseTime[FLASH_ERASE_32KB] == 128 );
+	TEST_CHECK( part.eraseTime[FLASH_ERASE_64KB] == 160 );
+	TEST_CHECK( part.programTime == 1 );
+	TEST_CHECK( part.chipEraseTime == 40000 );
+	TEST_CHECK( part.suspendCommand == 0x75 );
+	TEST_CHECK( part.resumeCommand == 0x7A );
+	TEST_CHECK( part.powerDownCommand == 0xB9 );
+	TEST_CHECK( part.wakeUpCommand == 0xAB );
+
+	// Parts that say they can't suspend or power down
+	test_put_dword(table, 12, sfdp_dword(table, 12) | 0x80000000);
+	test_put_dword(table, 14, sfdp_dword(table, 14) | 0x80000000);
+	TEST_CHECK( sfdp_parse_basic(table, tableDwords, &part) );
+	TEST_CHECK( part.suspendCommand == 0 );
+	TEST_CHECK( part.resumeCommand == 0 );
+	TEST_CHECK( part.powerDownCommand == 0 );
+	TEST_CHECK( part.wakeUpCommand == 0 );
+}
+
+
+void test_address_bytes( void ){
+	unsigned char table[SFDP_BASIC_MAX_DWORDS * 4];
+	struct tFlashPart part;
+
+	sfdp_family_defaults(0xEF, 0x18, &part);
+	test_table(table);
+
+	// Three byte only
+	test_put_dword(table, 1, sfdp_dword(table, 1) & ~(0x03UL << 17));
+	TEST_CHECK( sfdp_parse_basic(table, SFDP_BASIC_MAX_DWORDS, &part) );
+
+	// Three or four byte, starts in three
+	test_put_dword(table, 1, (sfdp_dword(table, 1) & ~(0x03UL << 17)) | (0x01UL << 17));
+	TEST_CHECK( sfdp_parse_basic(table, SFDP_BASIC_MAX_DWORDS, &part) );
+
+	// Four byte only
+	test_put_dword(table, 1, (sfdp_dword(table, 1) & ~(0x03UL << 17)) | (0x02UL << 17));
+	TEST_CHECK( !sfdp_parse_basic(table, SFDP_BASIC_MAX_DWORDS, &part) );
+}
+
+
+void test_density( void ){
+	unsigned char table[SFDP_BASIC_MAX_DWORDS * 4];
+	struct tFlashPart part;
+
+	sfdp_family_defaults(0xEF, 0x18, &part);
+	test_table(table);
+
+	// Bits minus one below 2Gbit
+	test_put_dword(table, 2, 0x00FFFFFF);
+	TEST_CHECK( sfdp_parse_basic(table, SFDP_BASIC_MAX_DWORDS, &part) );
+	TEST_CHECK( part.size == 0x200000 );
+
+	test_put_dword(table, 2, 0x7FFFFFFF);
+	TEST_CHECK( sfdp_parse_basic(table, SFDP_BASIC_MAX_DWORDS, &part) );
+	TEST_CHECK( part.size == SFDP_MAX_SIZE );
+
+	// Bit 31 set, 2^N bits
+	test_put_dword(table, 2, 0x80000000 | 24);
+	TEST_CHECK( sfdp_parse_basic(table, SFDP_BASIC_MAX_DWORDS, &part) );
+	TEST_CHECK( part.size == 0x200000 );
+
+	test_put_dword(table, 2, 0x80000000 | 26);
+	TEST_CHECK( sfdp_parse_basic(table, SFDP_BASIC_MAX_DWORDS, &part) );
+	TEST_CHECK( part.size == 0x800000 );
+
+	// 4Gbit, only the first 16MB can be addressed with three bytes
+	test_put_dword(table, 2, 0x80000000 | 32);
+	TEST_CHECK( sfdp_parse_basic(table, SFDP_BASIC_MAX_DWORDS, &part) );
+	TEST_CHECK( part.size == SFDP_MAX_SIZE );
+
+	test_put_dword(table, 2, 0xFFFFFFFF);
+	TEST_CHECK( sfdp_parse_basic(table, SFDP_BASIC_MAX_DWORDS, &part) );
+	TEST_CHECK( part.size == SFDP_MAX_SIZE );
+
+	// Less than a byte
+	test_put_dword(table, 2, 0x80000000 | 2);
+	TEST_CHECK( !sfdp_parse_basic(table, SFDP_BASIC_MAX_DWORDS, &part) );
+}
+
+
+int main( void ){
+
+	test_find_basic();
+	test_jesd216();
+	test_jesd216a();
+	test_jesd216b();
+	test_address_bytes();
+	test_density();
+
+	return test_report("test_sfdp");
+}